@@ -1,6 +1,11 @@
 #include "Image.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <stdexcept>
+#include <thread>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -19,43 +24,169 @@ static uint8_t ClampColor(float c) {
 
   return static_cast<uint8_t>(tmp);
 }
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float),
+              "glm::vec3 must be tightly packed!");
+
+// Below this many pixels per thread, converting in parallel does not pay.
+const size_t kMinPixelsPerThread = 1 << 18;
+
+// Encodes linear values with the sRGB transfer curve, rounded to bytes.
+// thresholds_[b] is the smallest value that encodes to b or more, and a
+// table over [0, 1] holds the byte at the start of each of its buckets.
+// The buckets are narrower than the steepest step between thresholds, so a
+// value is at most one byte above the start of its bucket.
+class SrgbEncoder {
+ public:
+  static const SrgbEncoder& Get() {
+    static const SrgbEncoder encoder;
+    return encoder;
+  }
+
+  uint8_t Encode(float c) const {
+    // Also maps NaN to 0.
+    c = c > 0.0f ? c : 0.0f;
+    c = c < 1.0f ? c : 1.0f;
+    int b = start_bytes_[static_cast<size_t>(c * kBuckets)];
+    return static_cast<uint8_t>(b + (c >= thresholds_[b + 1]));
+  }
+
+ private:
+  static const size_t kBuckets = 4096;
+
+  static int EncodeExactly(float c) {
+    double v = c <= 0.0031308f ? 12.92 * c
+                               : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+    return static_cast<int>(255.0 * v + 0.5);
+  }
+
+  SrgbEncoder() {
+    thresholds_[0] = 0.0f;
+    for (int b = 1; b < 256; b++) {
+      double v = (b - 0.5) / 255.0;
+      float t = static_cast<float>(
+          v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4));
+      // Move to the exact float where the encoding reaches b.
+      while (EncodeExactly(t) < b) {
+        t = std::nextafter(t, 2.0f);
+      }
+      while (EncodeExactly(std::nextafter(t, 0.0f)) >= b) {
+        t = std::nextafter(t, 0.0f);
+      }
+      thresholds_[b] = t;
+    }
+    thresholds_[256] = 2.0f;
+    int b = 0;
+    for (size_t i = 0; i <= kBuckets; i++) {
+      float c = static_cast<float>(i) / kBuckets;
+      while (c >= thresholds_[b + 1]) {
+        b++;
+      }
+      start_bytes_[i] = static_cast<uint8_t>(b);
+    }
+  }
+
+  float thresholds_[257];
+  uint8_t start_bytes_[kBuckets + 1];
+};
+
+// Calls convert(begin, end) for ranges of the rows [0, height), on several
+// threads if the image is large.
+template <class F>
+void ForRowRanges(size_t width, size_t height, F&& convert) {
+  size_t num_threads = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()),
+      width * height / kMinPixelsPerThread);
+  if (num_threads <= 1) {
+    convert(size_t(0), height);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back(convert, height * i / num_threads,
+                         height * (i + 1) / num_threads);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
 }  // namespace
 
 namespace GLOO {
-std::vector<uint8_t> Image::ToByteData() const {
-  std::vector<uint8_t> buffer;
-
-  for (int y = (int)height_ - 1; y >= 0; y--)
-    for (size_t x = 0; x < width_; x++) {
-      const glm::vec3& color = GetPixel(x, static_cast<size_t>(y));
-      buffer.push_back(ClampColor(color[0]));
-      buffer.push_back(ClampColor(color[1]));
-      buffer.push_back(ClampColor(color[2]));
+void Image::ToBytes(const glm::vec3* pixels,
+                    size_t count,
+                    bool srgb,
+                    uint8_t* bytes) {
+  const float* values = &pixels[0][0];
+  if (srgb) {
+    const SrgbEncoder& encoder = SrgbEncoder::Get();
+    for (size_t i = 0; i < 3 * count; i++) {
+      bytes[i] = encoder.Encode(values[i]);
     }
+  } else {
+    // Simple enough for the compiler to vectorize.
+    for (size_t i = 0; i < 3 * count; i++) {
+      bytes[i] = ClampColor(values[i]);
+    }
+  }
+}
 
+std::vector<uint8_t> Image::ToByteData(bool srgb) const {
+  std::vector<uint8_t> buffer(width_ * height_ * 3);
+  if (buffer.empty()) {
+    return buffer;
+  }
+  if (srgb) {
+    // Built once, before the threads use it.
+    SrgbEncoder::Get();
+  }
+  ForRowRanges(width_, height_, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; row++) {
+      size_t y = height_ - 1 - row;
+      ToBytes(&data_[y * width_], width_, srgb, &buffer[row * width_ * 3]);
+    }
+  });
   return buffer;
 }
 
 std::vector<float> Image::ToFloatData() const {
-  std::vector<float> buffer;
-
-  for (int y = (int)height_ - 1; y >= 0; y--)
-    for (size_t x = 0; x < width_; x++) {
-      const glm::vec3& color = GetPixel(x, static_cast<size_t>(y));
-      buffer.push_back(color[0]);
-      buffer.push_back(color[1]);
-      buffer.push_back(color[2]);
+  std::vector<float> buffer(width_ * height_ * 3);
+  if (buffer.empty()) {
+    return buffer;
+  }
+  ForRowRanges(width_, height_, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; row++) {
+      size_t y = height_ - 1 - row;
+      std::memcpy(&buffer[row * width_ * 3], &data_[y * width_],
+                  width_ * sizeof(glm::vec3));
     }
-
+  });
   return buffer;
 }
 
-void Image::SavePNG(const std::string& filename) const {
-  auto buffer = ToByteData();
+void Image::SavePNG(const std::string& filename, bool srgb) const {
+  auto buffer = ToByteData(srgb);
   stbi_write_png(filename.c_str(), (int)width_, (int)height_, 3, buffer.data(),
                  (int)width_ * 3);
 }
 
+void Image::SavePFM(const std::string& filename) const {
+  std::ofstream os(filename, std::ios::binary);
+  // A negative scale marks little-endian values.
+  const uint16_t one = 1;
+  bool little_endian = *reinterpret_cast<const uint8_t*>(&one) == 1;
+  os << "PF\n"
+     << width_ << " " << height_ << "\n"
+     << (little_endian ? "-1.0" : "1.0") << "\n";
+  // Rows go from the bottom up, as they are stored here.
+  os.write(reinterpret_cast<const char*>(data_.data()),
+           data_.size() * sizeof(glm::vec3));
+  os.close();
+  if (os.fail()) {
+    throw std::runtime_error("Cannot write " + filename + "!");
+  }
+}
+
 std::unique_ptr<Image> Image::LoadPNG(const std::string& filename,
                                       bool y_reversed) {
   int w, h, n;
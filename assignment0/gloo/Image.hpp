@@ -45,9 +45,22 @@ class Image {
 
   static std::unique_ptr<Image> LoadPNG(const std::string& filename,
                                         bool y_reversed);
-  void SavePNG(const std::string& filename) const;
-  std::vector<uint8_t> ToByteData() const;
+  // 8-bit output, see ToByteData.
+  void SavePNG(const std::string& filename, bool srgb = false) const;
+  // Linear floating-point values as a Portable Float Map. Throws if the file
+  // cannot be written.
+  void SavePFM(const std::string& filename) const;
+  // Pixels from the top row down, 3 bytes each. Channels are clamped to
+  // [0, 1] and scaled to 255, truncating; with srgb they are encoded with
+  // the sRGB transfer curve and rounded instead.
+  std::vector<uint8_t> ToByteData(bool srgb = false) const;
+  // Pixels from the top row down, 3 floats each.
   std::vector<float> ToFloatData() const;
+  // Converts count pixels to bytes as ToByteData does.
+  static void ToBytes(const glm::vec3* pixels,
+                      size_t count,
+                      bool srgb,
+                      uint8_t* bytes);
 
  private:
   std::vector<glm::vec3> data_;
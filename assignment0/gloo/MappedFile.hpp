@@ -0,0 +1,41 @@
+#ifndef GLOO_MAPPED_FILE_H_
+#define GLOO_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace GLOO {
+// Read-only view of a whole file. On POSIX systems the file is mapped into
+// memory, so pages are only read when touched and are shared with other
+// processes mapping the same file; elsewhere it is read into a buffer.
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0), mapped_(false) {
+  }
+  ~MappedFile() {
+    Close();
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns false if the file cannot be opened or read.
+  bool Open(const std::string& path);
+  void Close();
+
+  const char* GetData() const {
+    return data_;
+  }
+  size_t GetSize() const {
+    return size_;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  bool mapped_;
+  std::vector<char> buffer_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,251 @@
+#include "BinaryMeshFile.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "gloo/utils.hpp"
+
+namespace {
+const char kMagic[8] = "GMESH";
+const uint32_t kByteOrderMark = 0x01020304;
+
+struct SectionRecord {
+  // Offset 0 marks a section the mesh does not have.
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  SectionRecord sections[6];
+};
+
+// A group refers to its strings by offset into the string section.
+struct GroupRecord {
+  uint64_t start_face_index;
+  uint64_t num_indices;
+  uint64_t name_offset;
+  uint64_t name_size;
+  uint64_t material_name_offset;
+  uint64_t material_name_size;
+  uint32_t has_material;
+  float ambient[3];
+  float diffuse[3];
+  float specular[3];
+  float shininess;
+};
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float),
+              "glm::vec3 must be tightly packed!");
+static_assert(sizeof(glm::vec2) == 2 * sizeof(float),
+              "glm::vec2 must be tightly packed!");
+
+const size_t kElementSizes[] = {sizeof(glm::vec3),   sizeof(glm::vec3),
+                                sizeof(glm::vec2),   sizeof(unsigned int),
+                                sizeof(GroupRecord), 1};
+
+size_t AlignUp(size_t offset) {
+  size_t alignment = GLOO::BinaryMeshFile::kAlignment;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+void StoreVec3(const glm::vec3& v, float* out) {
+  for (int i = 0; i < 3; i++) {
+    out[i] = v[i];
+  }
+}
+
+glm::vec3 LoadVec3(const float* v) {
+  return glm::vec3(v[0], v[1], v[2]);
+}
+}  // namespace
+
+namespace GLOO {
+bool BinaryMeshFile::IsBinaryMeshPath(const std::string& file_path) {
+  return HasExtension(file_path, ".gmesh");
+}
+
+bool BinaryMeshFile::Write(const std::string& file_path,
+                           const ObjParser::ParsedData& data) {
+  std::string strings;
+  std::vector<GroupRecord> groups;
+  for (const MeshGroup& group : data.groups) {
+    GroupRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.start_face_index = group.start_face_index;
+    record.num_indices = group.num_indices;
+    record.name_offset = strings.size();
+    record.name_size = group.name.size();
+    strings += group.name;
+    record.material_name_offset = strings.size();
+    record.material_name_size = group.material_name.size();
+    strings += group.material_name;
+    if (group.material != nullptr) {
+      record.has_material = 1;
+      StoreVec3(group.material->GetAmbientColor(), record.ambient);
+      StoreVec3(group.material->GetDiffuseColor(), record.diffuse);
+      StoreVec3(group.material->GetSpecularColor(), record.specular);
+      record.shininess = group.material->GetShininess();
+    }
+    groups.push_back(record);
+  }
+
+  const void* section_data[kNumSections] = {
+      data.positions ? data.positions->data() : nullptr,
+      data.normals ? data.normals->data() : nullptr,
+      data.tex_coords ? data.tex_coords->data() : nullptr,
+      data.indices ? data.indices->data() : nullptr,
+      groups.data(),
+      strings.data()};
+  const bool present[kNumSections] = {
+      data.positions != nullptr,  data.normals != nullptr,
+      data.tex_coords != nullptr, data.indices != nullptr,
+      true,                       true};
+  const size_t counts[kNumSections] = {
+      data.positions ? data.positions->size() : 0,
+      data.normals ? data.normals->size() : 0,
+      data.tex_coords ? data.tex_coords->size() : 0,
+      data.indices ? data.indices->size() : 0,
+      groups.size(),
+      strings.size()};
+
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrderMark;
+  size_t offset = AlignUp(sizeof(header));
+  for (int i = 0; i < kNumSections; i++) {
+    if (!present[i]) {
+      continue;
+    }
+    header.sections[i].offset = offset;
+    header.sections[i].count = counts[i];
+    offset = AlignUp(offset + counts[i] * kElementSizes[i]);
+  }
+
+  std::ofstream os(file_path, std::ios::binary);
+  static const char kZeros[kAlignment] = {};
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  size_t written = sizeof(header);
+  for (int i = 0; i < kNumSections; i++) {
+    if (!present[i]) {
+      continue;
+    }
+    os.write(kZeros, header.sections[i].offset - written);
+    size_t size = counts[i] * kElementSizes[i];
+    os.write(static_cast<const char*>(section_data[i]), size);
+    written = header.sections[i].offset + size;
+  }
+  os.close();
+  return !os.fail();
+}
+
+bool BinaryMeshFile::Open(const std::string& file_path) {
+  for (int i = 0; i < kNumSections; i++) {
+    sections_[i] = nullptr;
+    counts_[i] = 0;
+  }
+  if (!file_.Open(file_path)) {
+    std::cerr << "ERROR: Unable to open mesh file " + file_path + "!"
+              << std::endl;
+    return false;
+  }
+  FileHeader header;
+  if (file_.GetSize() < sizeof(header)) {
+    std::cerr << "ERROR: Truncated mesh file " + file_path + "!" << std::endl;
+    return false;
+  }
+  std::memcpy(&header, file_.GetData(), sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.byte_order != kByteOrderMark) {
+    std::cerr << "ERROR: " + file_path +
+                     " is not a mesh file of this version and byte order!"
+              << std::endl;
+    return false;
+  }
+  for (int i = 0; i < kNumSections; i++) {
+    const SectionRecord& section = header.sections[i];
+    if (section.offset == 0) {
+      continue;
+    }
+    size_t size = file_.GetSize();
+    if (section.offset % kAlignment != 0 || section.offset > size ||
+        section.count > (size - section.offset) / kElementSizes[i]) {
+      std::cerr << "ERROR: Corrupt section in mesh file " + file_path + "!"
+                << std::endl;
+      return false;
+    }
+    sections_[i] = file_.GetData() + section.offset;
+    counts_[i] = section.count;
+  }
+
+  // Group strings and index ranges are checked here so that GetGroups cannot
+  // fail and its groups lie within the indices. Sizes are compared first so
+  // that offset + size cannot overflow.
+  const GroupRecord* groups = static_cast<const GroupRecord*>(
+      sections_[kGroups]);
+  for (size_t i = 0; i < counts_[kGroups]; i++) {
+    const GroupRecord& group = groups[i];
+    if (group.name_size > counts_[kStrings] ||
+        group.name_offset > counts_[kStrings] - group.name_size ||
+        group.material_name_size > counts_[kStrings] ||
+        group.material_name_offset >
+            counts_[kStrings] - group.material_name_size ||
+        group.num_indices > counts_[kIndices] ||
+        group.start_face_index > counts_[kIndices] - group.num_indices) {
+      std::cerr << "ERROR: Corrupt group in mesh file " + file_path + "!"
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<MeshGroup> BinaryMeshFile::GetGroups() const {
+  const GroupRecord* records =
+      static_cast<const GroupRecord*>(sections_[kGroups]);
+  const char* strings = static_cast<const char*>(sections_[kStrings]);
+  std::vector<MeshGroup> groups(counts_[kGroups]);
+  for (size_t i = 0; i < groups.size(); i++) {
+    const GroupRecord& record = records[i];
+    MeshGroup& group = groups[i];
+    group.name.assign(strings + record.name_offset, record.name_size);
+    group.start_face_index = record.start_face_index;
+    group.num_indices = record.num_indices;
+    group.material_name.assign(strings + record.material_name_offset,
+                               record.material_name_size);
+    if (record.has_material) {
+      group.material = std::make_shared<Material>(
+          LoadVec3(record.ambient), LoadVec3(record.diffuse),
+          LoadVec3(record.specular), record.shininess);
+    }
+  }
+  return groups;
+}
+
+ObjParser::ParsedData BinaryMeshFile::ToParsedData() const {
+  ObjParser::ParsedData data;
+  if (GetPositions() != nullptr) {
+    data.positions = make_unique<PositionArray>(
+        GetPositions(), GetPositions() + GetPositionCount());
+  }
+  if (GetNormals() != nullptr) {
+    data.normals = make_unique<NormalArray>(GetNormals(),
+                                            GetNormals() + GetNormalCount());
+  }
+  if (GetTexCoords() != nullptr) {
+    data.tex_coords = make_unique<TexCoordArray>(
+        GetTexCoords(), GetTexCoords() + GetTexCoordCount());
+  }
+  if (GetIndices() != nullptr) {
+    data.indices = make_unique<IndexArray>(GetIndices(),
+                                           GetIndices() + GetIndexCount());
+  }
+  data.groups = GetGroups();
+  return data;
+}
+}  // namespace GLOO
@@ -0,0 +1,86 @@
+#ifndef GLOO_BINARY_MESH_FILE_H_
+#define GLOO_BINARY_MESH_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gloo/alias_types.hpp"
+#include "gloo/MappedFile.hpp"
+#include "gloo/MeshData.hpp"
+#include "ObjParser.hpp"
+
+namespace GLOO {
+// Binary mesh container (.gmesh) holding what ObjParser produces. A header
+// with a table of sections is followed by the sections, each starting at a
+// multiple of kAlignment: positions, normals, texture coordinates and
+// indices as raw arrays, then the groups and their strings. Opening a file
+// maps it into memory and the arrays are used in place, with no parsing.
+// Values are stored in native byte order; the header rejects files written
+// with another one.
+class BinaryMeshFile {
+ public:
+  static const uint32_t kVersion = 1;
+  static const size_t kAlignment = 64;
+
+  // Whether file_path has the .gmesh extension.
+  static bool IsBinaryMeshPath(const std::string& file_path);
+  // Writes data, e.g. as parsed from an OBJ file. Materials are stored by
+  // value with their groups. Returns false if the file cannot be written.
+  static bool Write(const std::string& file_path,
+                    const ObjParser::ParsedData& data);
+
+  // Maps the file and checks its header and sections. Returns false, with
+  // an error message, if it cannot be read or is not a valid mesh file.
+  bool Open(const std::string& file_path);
+
+  // Arrays in the mapped file, valid as long as this object is. Null if
+  // the file has no such data.
+  const glm::vec3* GetPositions() const {
+    return static_cast<const glm::vec3*>(sections_[kPositions]);
+  }
+  size_t GetPositionCount() const {
+    return counts_[kPositions];
+  }
+  const glm::vec3* GetNormals() const {
+    return static_cast<const glm::vec3*>(sections_[kNormals]);
+  }
+  size_t GetNormalCount() const {
+    return counts_[kNormals];
+  }
+  const glm::vec2* GetTexCoords() const {
+    return static_cast<const glm::vec2*>(sections_[kTexCoords]);
+  }
+  size_t GetTexCoordCount() const {
+    return counts_[kTexCoords];
+  }
+  const unsigned int* GetIndices() const {
+    return static_cast<const unsigned int*>(sections_[kIndices]);
+  }
+  size_t GetIndexCount() const {
+    return counts_[kIndices];
+  }
+  std::vector<MeshGroup> GetGroups() const;
+
+  // Copies everything into owning arrays, for users of ParsedData such as
+  // MeshLoader.
+  ObjParser::ParsedData ToParsedData() const;
+
+ private:
+  enum Section {
+    kPositions,
+    kNormals,
+    kTexCoords,
+    kIndices,
+    kGroups,
+    kStrings,
+    kNumSections
+  };
+
+  MappedFile file_;
+  const void* sections_[kNumSections];
+  size_t counts_[kNumSections];
+};
+}  // namespace GLOO
+
+#endif
@@ -41,6 +41,12 @@ std::string GetBasePath(const std::string& path) {
   return base_path;
 }
 
+bool HasExtension(const std::string& path, const std::string& extension) {
+  return path.size() >= extension.size() &&
+         path.compare(path.size() - extension.size(), extension.size(),
+                      extension) == 0;
+}
+
 const std::string kRootSentinel = "gloo.cfg";
 const int kMaxDepth = 20;
 
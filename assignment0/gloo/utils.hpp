@@ -44,6 +44,8 @@ std::vector<std::string> Split(const std::string& s, char delim);
 
 // Get the base directory of a path (including the last '/' or '\').
 std::string GetBasePath(const std::string& path);
+// Whether path ends in extension, such as ".obj".
+bool HasExtension(const std::string& path, const std::string& extension);
 
 // Helpers for managing paths.
 std::string GetProjectRootDir();
@@ -0,0 +1,70 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace GLOO {
+bool MappedFile::Open(const std::string& path) {
+  Close();
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ == 0) {
+    // mmap rejects empty ranges.
+    close(fd);
+    data_ = "";
+    return true;
+  }
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file referenced after the descriptor is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  mapped_ = true;
+  return true;
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  buffer_.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(buffer_.data(), buffer_.size())) {
+    buffer_.clear();
+    return false;
+  }
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+  return true;
+#endif
+}
+
+void MappedFile::Close() {
+#ifndef _WIN32
+  if (mapped_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+  buffer_.clear();
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+}
+}  // namespace GLOO
@@ -1,17 +1,357 @@
 #include "ObjParser.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 #include "gloo/utils.hpp"
+#include "gloo/MappedFile.hpp"
+
+namespace {
+// Files are split into chunks of at least this many bytes, at most four per
+// thread so that uneven chunks still balance.
+const size_t kMinChunkBytes = 1 << 20;
+const size_t kChunksPerThread = 4;
+
+// The result of parsing one chunk. Lines other than vertex data, faces and
+// comments are kept as events and applied in file order after the chunks
+// are merged, with the number of indices parsed before them.
+struct ObjChunk {
+  ObjChunk()
+      : has_positions(false),
+        has_normals(false),
+        has_tex_coords(false),
+        has_indices(false) {
+  }
+
+  struct Event {
+    std::string line;
+    size_t num_indices;
+    bool has_indices;
+  };
+
+  GLOO::PositionArray positions;
+  GLOO::NormalArray normals;
+  GLOO::TexCoordArray tex_coords;
+  GLOO::IndexArray indices;
+  // Whether the chunk had a line of the kind, which creates the array even
+  // if the line turns out to be empty.
+  bool has_positions;
+  bool has_normals;
+  bool has_tex_coords;
+  bool has_indices;
+  std::vector<Event> events;
+  std::exception_ptr error;
+};
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+const char* SkipSpace(const char* p, const char* end) {
+  while (p != end && IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+const char* SkipToken(const char* p, const char* end) {
+  while (p != end && !IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Whether the nearest double to a decimal number has been computed exactly
+// when converting it, which needs operations without excess precision.
+const bool kExactDoubles = FLT_EVAL_METHOD == 0;
+
+// Reads a float token [+-]digits[.digits][(e|E)[+-]digits] or
+// [+-].digits[...] that ends at whitespace or at the end of the line, and
+// gives the same value as reading it with operator>>. Returns false for
+// anything else, which the caller leaves to the stream.
+bool ScanFloat(const char*& p, const char* end, float& value) {
+  static const double kPowers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* start = p;
+  const char* q = p;
+  bool negative = false;
+  if (q != end && (*q == '+' || *q == '-')) {
+    negative = *q == '-';
+    q++;
+  }
+  uint64_t mantissa = 0;
+  int num_digits = 0;
+  int exponent = 0;
+  bool any_digits = false;
+  for (; q != end && IsDigit(*q); q++) {
+    any_digits = true;
+    if (mantissa != 0 || *q != '0') {
+      mantissa = mantissa * 10 + (*q - '0');
+      num_digits++;
+    }
+    if (num_digits > 19) {
+      return false;
+    }
+  }
+  if (q != end && *q == '.') {
+    q++;
+    for (; q != end && IsDigit(*q); q++) {
+      any_digits = true;
+      if (mantissa != 0 || *q != '0') {
+        mantissa = mantissa * 10 + (*q - '0');
+        num_digits++;
+      }
+      exponent--;
+      if (num_digits > 19) {
+        return false;
+      }
+    }
+  }
+  if (!any_digits) {
+    return false;
+  }
+  if (q != end && (*q == 'e' || *q == 'E')) {
+    q++;
+    bool negative_exponent = false;
+    if (q != end && (*q == '+' || *q == '-')) {
+      negative_exponent = *q == '-';
+      q++;
+    }
+    if (q == end || !IsDigit(*q)) {
+      return false;
+    }
+    int e = 0;
+    for (; q != end && IsDigit(*q); q++) {
+      if (e > 10000) {
+        return false;
+      }
+      e = e * 10 + (*q - '0');
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+  if (q != end && !IsSpace(*q)) {
+    return false;
+  }
+
+  // A mantissa and power of ten that are exact doubles give the correctly
+  // rounded double with one operation. Rounding that to float is only off
+  // when it lands exactly halfway between two floats, or outside the range
+  // of normal floats; strtof handles those.
+  if (kExactDoubles && mantissa < (uint64_t(1) << 53) && exponent >= -22 &&
+      exponent <= 22) {
+    double d = static_cast<double>(mantissa);
+    d = exponent < 0 ? d / kPowers[-exponent] : d * kPowers[exponent];
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    const uint64_t kLowBits = (uint64_t(1) << 29) - 1;
+    bool halfway = (bits & kLowBits) == (uint64_t(1) << 28);
+    if (d == 0.0 || (d >= FLT_MIN && d <= FLT_MAX && !halfway)) {
+      float f = static_cast<float>(d);
+      value = negative ? -f : f;
+      p = q;
+      return true;
+    }
+  }
+  // The stream converts with strtof too, but reports overflow as an error.
+  char buffer[64];
+  size_t length = q - start;
+  if (length >= sizeof(buffer)) {
+    return false;
+  }
+  std::memcpy(buffer, start, length);
+  buffer[length] = '\0';
+  float f = std::strtof(buffer, nullptr);
+  if (f > FLT_MAX || f < -FLT_MAX) {
+    return false;
+  }
+  value = f;
+  p = q;
+  return true;
+}
+
+// Reads the vertex index of a face token, digits optionally followed by '/'
+// and more, as std::stoul would. Returns false for anything else.
+bool ScanIndex(const char*& p, const char* end, unsigned int& value) {
+  const char* q = p;
+  unsigned int index = 0;
+  int num_digits = 0;
+  for (; q != end && IsDigit(*q); q++) {
+    if (++num_digits > 9) {
+      return false;
+    }
+    index = index * 10 + (*q - '0');
+  }
+  if (num_digits == 0) {
+    return false;
+  }
+  if (q != end && *q == '/') {
+    q = SkipToken(q, end);
+  } else if (q != end && !IsSpace(*q)) {
+    return false;
+  }
+  value = index;
+  p = q;
+  return true;
+}
+
+template <int N, typename T>
+bool ScanFloats(const char* p, const char* end, T& v) {
+  for (int i = 0; i < N; i++) {
+    p = SkipSpace(p, end);
+    if (!ScanFloat(p, end, v[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ScanFace(const char* p, const char* end, unsigned int* idx) {
+  for (int t = 0; t < 3; t++) {
+    p = SkipSpace(p, end);
+    if (!ScanIndex(p, end, idx[t])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The stream-based parsing of vertex data and faces, used for lines that
+// the scanners above do not accept so that they give the same results.
+void ParseGeometryLine(const std::string& line, ObjChunk& chunk) {
+  std::stringstream ss(line);
+  std::string command;
+  ss >> command;
+  if (command == "v") {
+    glm::vec3 p;
+    ss >> p.x >> p.y >> p.z;
+    chunk.positions.emplace_back(std::move(p));
+  } else if (command == "vn") {
+    glm::vec3 n;
+    ss >> n.x >> n.y >> n.z;
+    chunk.normals.emplace_back(std::move(n));
+  } else if (command == "vt") {
+    glm::vec2 uv;
+    ss >> uv.s >> uv.t;
+    chunk.tex_coords.emplace_back(std::move(uv));
+  } else if (command == "f") {
+    for (int t = 0; t < 3; t++) {
+      std::string str;
+      ss >> str;
+      unsigned int idx;
+      if (str.find('/') == std::string::npos) {
+        idx = std::stoul(str);
+      } else {
+        idx = std::stoul(GLOO::Split(str, '/')[0]);
+      }
+      // Minus 1 because OBJ indices start with 1.
+      chunk.indices.push_back(idx - 1);
+    }
+  }
+}
+
+void ParseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+  const char* line = begin;
+  while (line != end) {
+    const char* line_end =
+        static_cast<const char*>(std::memchr(line, '\n', end - line));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    const char* p = SkipSpace(line, line_end);
+    const char* command_end = SkipToken(p, line_end);
+    size_t command_length = command_end - p;
+    bool scanned = true;
+    if (command_length == 0 || (command_length == 1 && *p == '#')) {
+      // Empty line or comment.
+    } else if (command_length == 1 && *p == 'v') {
+      chunk.has_positions = true;
+      glm::vec3 v;
+      if ((scanned = ScanFloats<3>(command_end, line_end, v))) {
+        chunk.positions.push_back(v);
+      }
+    } else if (command_length == 2 && p[0] == 'v' && p[1] == 'n') {
+      chunk.has_normals = true;
+      glm::vec3 n;
+      if ((scanned = ScanFloats<3>(command_end, line_end, n))) {
+        chunk.normals.push_back(n);
+      }
+    } else if (command_length == 2 && p[0] == 'v' && p[1] == 't') {
+      chunk.has_tex_coords = true;
+      glm::vec2 uv;
+      if ((scanned = ScanFloats<2>(command_end, line_end, uv))) {
+        chunk.tex_coords.push_back(uv);
+      }
+    } else if (command_length == 1 && *p == 'f') {
+      chunk.has_indices = true;
+      unsigned int idx[3];
+      if ((scanned = ScanFace(command_end, line_end, idx))) {
+        for (int t = 0; t < 3; t++) {
+          // Minus 1 because OBJ indices start with 1.
+          chunk.indices.push_back(idx[t] - 1);
+        }
+      }
+    } else {
+      chunk.events.push_back({std::string(line, line_end),
+                              chunk.indices.size(), chunk.has_indices});
+    }
+    if (!scanned) {
+      ParseGeometryLine(std::string(line, line_end), chunk);
+    }
+    line = line_end == end ? end : line_end + 1;
+  }
+}
+
+// Appends the chunks' arrays of one kind in order; the array is only
+// created if some chunk had a line of that kind.
+template <typename T>
+void MergeArrays(std::vector<ObjChunk>& chunks,
+                 std::vector<T> ObjChunk::*array,
+                 bool ObjChunk::*present,
+                 std::unique_ptr<std::vector<T>>& result) {
+  size_t size = 0;
+  bool any = false;
+  for (const ObjChunk& chunk : chunks) {
+    size += (chunk.*array).size();
+    any |= chunk.*present;
+  }
+  if (!any) {
+    return;
+  }
+  if (chunks.size() == 1) {
+    result = GLOO::make_unique<std::vector<T>>(std::move(chunks[0].*array));
+    return;
+  }
+  result = GLOO::make_unique<std::vector<T>>();
+  result->reserve(size);
+  for (ObjChunk& chunk : chunks) {
+    result->insert(result->end(), (chunk.*array).begin(),
+                   (chunk.*array).end());
+    std::vector<T>().swap(chunk.*array);
+  }
+}
+}  // namespace
 
 namespace GLOO {
 ObjParser::ParsedData ObjParser::Parse(const std::string& file_path,
                                        bool& success) {
   success = false;
-  std::fstream fs(file_path);
-  if (!fs) {
+  MappedFile file;
+  if (!file.Open(file_path)) {
     std::cerr << "ERROR: Unable to open OBJ file " + file_path + "!"
               << std::endl;
     return {};
@@ -19,76 +359,111 @@ ObjParser::ParsedData ObjParser::Parse(const std::string& file_path,
 
   std::string base_path = GetBasePath(file_path);
 
+  // Split the file into chunks that start at line beginnings and parse
+  // them in parallel.
+  const char* begin = file.GetData();
+  const char* end = begin + file.GetSize();
+  size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t num_chunks = std::max<size_t>(
+      1, std::min(num_threads * kChunksPerThread,
+                  file.GetSize() / kMinChunkBytes));
+  std::vector<const char*> bounds(1, begin);
+  for (size_t i = 1; i < num_chunks; i++) {
+    const char* bound = std::max(bounds.back(), begin + file.GetSize() * i /
+                                                            num_chunks);
+    const char* newline =
+        static_cast<const char*>(std::memchr(bound, '\n', end - bound));
+    bounds.push_back(newline == nullptr ? end : newline + 1);
+  }
+  bounds.push_back(end);
+
+  std::vector<ObjChunk> chunks(num_chunks);
+  std::atomic<size_t> next_chunk(0);
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next_chunk++) < num_chunks) {
+      try {
+        ParseChunk(bounds[i], bounds[i + 1], chunks[i]);
+      } catch (...) {
+        chunks[i].error = std::current_exception();
+      }
+    }
+  };
+  num_threads = std::min(num_threads, num_chunks);
+  if (num_threads == 1) {
+    worker();
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
   ParsedData data;
   MaterialDict material_dict;
-
   MeshGroup current_group;
-  std::string line;
-  while (std::getline(fs, line)) {
-    std::stringstream ss(line);
-    std::string command;
-    ss >> command;
-    if (command == "#" || command == "") {
-      continue;
-    } else if (command == "v") {
-      glm::vec3 p;
-      ss >> p.x >> p.y >> p.z;
-      if (data.positions == nullptr)
-        data.positions = make_unique<PositionArray>();
-      data.positions->emplace_back(std::move(p));
-    } else if (command == "vn") {
-      glm::vec3 n;
-      ss >> n.x >> n.y >> n.z;
-      if (data.normals == nullptr)
-        data.normals = make_unique<NormalArray>();
-      data.normals->emplace_back(std::move(n));
-    } else if (command == "vt") {
-      glm::vec2 uv;
-      ss >> uv.s >> uv.t;
-      if (data.tex_coords == nullptr)
-        data.tex_coords = make_unique<TexCoordArray>();
-      data.tex_coords->emplace_back(std::move(uv));
-    } else if (command == "f") {
-      if (data.indices == nullptr)
-        data.indices = make_unique<IndexArray>();
-      for (int t = 0; t < 3; t++) {
-        std::string str;
-        ss >> str;
-        unsigned int idx;
-        if (str.find('/') == std::string::npos) {
-          idx = std::stoul(str);
-        } else {
-          idx = std::stoul(Split(str, '/')[0]);
+
+  // Index count and presence of the indices before each chunk's events.
+  std::vector<size_t> index_offsets;
+  std::vector<bool> had_indices;
+  size_t num_indices = 0;
+  bool has_indices = false;
+  for (const ObjChunk& chunk : chunks) {
+    index_offsets.push_back(num_indices);
+    had_indices.push_back(has_indices);
+    num_indices += chunk.indices.size();
+    has_indices |= chunk.has_indices;
+  }
+
+  for (size_t i = 0; i < num_chunks; i++) {
+    for (const ObjChunk::Event& event : chunks[i].events) {
+      size_t event_indices = index_offsets[i] + event.num_indices;
+      bool event_has_indices = had_indices[i] || event.has_indices;
+      std::stringstream ss(event.line);
+      std::string command;
+      ss >> command;
+      if (command == "g") {
+        if (current_group.name != "") {
+          current_group.num_indices =
+              event_indices - current_group.start_face_index;
+          data.groups.push_back(std::move(current_group));
         }
-        // Minus 1 because OBJ indices start with 1.
-        data.indices->push_back(idx - 1);
-      }
-    } else if (command == "g") {
-      if (current_group.name != "") {
-        current_group.num_indices =
-            data.indices->size() - current_group.start_face_index;
-        data.groups.push_back(std::move(current_group));
+        ss >> current_group.name;
+        if (!event_has_indices)
+          current_group.start_face_index = 0;
+        else
+          current_group.start_face_index = event_indices;
+      } else if (command == "usemtl") {
+        ss >> current_group.material_name;
+      } else if (command == "mtllib") {
+        std::string mtl_file;
+        ss >> mtl_file;
+        material_dict = ParseMTL(base_path + mtl_file);
+      } else if (command == "o" || command == "s") {
+        std::cout << "Skipped command: " << command << std::endl;
+      } else {
+        std::cerr << "Unknown obj command: " << command << std::endl;
+        continue;
       }
-      ss >> current_group.name;
-      if (data.indices == nullptr)
-        current_group.start_face_index = 0;
-      else
-        current_group.start_face_index = data.indices->size();
-    } else if (command == "usemtl") {
-      ss >> current_group.material_name;
-    } else if (command == "mtllib") {
-      std::string mtl_file;
-      ss >> mtl_file;
-      material_dict = ParseMTL(base_path + mtl_file);
-    } else if (command == "o" || command == "s") {
-      std::cout << "Skipped command: " << command << std::endl;
-    } else {
-      std::cerr << "Unknown obj command: " << command << std::endl;
-      success = false;
-      continue;
+    }
+    // Stop at the first failing line, as a sequential parse would, once
+    // the lines before it have been reported.
+    if (chunks[i].error) {
+      std::rethrow_exception(chunks[i].error);
     }
   }
 
+  MergeArrays(chunks, &ObjChunk::positions, &ObjChunk::has_positions,
+              data.positions);
+  MergeArrays(chunks, &ObjChunk::normals, &ObjChunk::has_normals,
+              data.normals);
+  MergeArrays(chunks, &ObjChunk::tex_coords, &ObjChunk::has_tex_coords,
+              data.tex_coords);
+  MergeArrays(chunks, &ObjChunk::indices, &ObjChunk::has_indices,
+              data.indices);
+
   if (current_group.name != "") {
     current_group.num_indices =
         data.indices->size() - current_group.start_face_index;
@@ -0,0 +1,111 @@
+#include "AABB.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "hittable/Triangle.hpp"
+#include "hittable/Mesh.hpp"
+
+namespace {
+bool IntervalIntersect(float* a, float* b) {
+  if (a[0] > b[1]) {
+    return a[0] <= b[1];
+  } else {
+    return b[0] <= a[1];
+  }
+}
+}  // namespace
+
+namespace GLOO {
+bool AABB::Overlap(const AABB& other) const {
+  for (int dim = 0; dim < 3; dim++) {
+    float ia[2] = {mn[dim], mx[dim]};
+    float ib[2] = {other.mn[dim], other.mx[dim]};
+    bool intersect = IntervalIntersect(ia, ib);
+    if (!intersect) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AABB::Contain(const AABB& other) const {
+  for (int dim = 0; dim < 3; dim++) {
+    if (mn[dim] > other.mn[dim] || mx[dim] < other.mx[dim]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void AABB::UnionWith(const AABB& other) {
+  for (int dim = 0; dim < 3; dim++) {
+    mn[dim] = std::min(mn[dim], other.mn[dim]);
+    mx[dim] = std::max(mx[dim], other.mx[dim]);
+  }
+}
+
+AABB AABB::FromTriangle(const Triangle& triangle) {
+  AABB bbox;
+  bbox.mn = bbox.mx = triangle.GetPosition(0);
+  for (int i = 1; i < 3; i++) {
+    for (int dim = 0; dim < 3; dim++) {
+      bbox.mn[dim] = std::min(bbox.mn[dim], triangle.GetPosition(i)[dim]);
+      bbox.mx[dim] = std::max(bbox.mx[dim], triangle.GetPosition(i)[dim]);
+    }
+  }
+  return bbox;
+}
+
+AABB AABB::FromMesh(const Mesh& mesh) {
+  AABB bbox(mesh.GetTriangleBounds(0));
+  for (uint32_t i = 1; i < mesh.GetTriangleCount(); i++) {
+    bbox.UnionWith(mesh.GetTriangleBounds(i));
+  }
+  return bbox;
+}
+
+AABB AABB::Empty() {
+  float inf = std::numeric_limits<float>::max();
+  return AABB(glm::vec3(inf), glm::vec3(-inf));
+}
+
+void AABB::UnionWith(const glm::vec3& point) {
+  for (int dim = 0; dim < 3; dim++) {
+    mn[dim] = std::min(mn[dim], point[dim]);
+    mx[dim] = std::max(mx[dim], point[dim]);
+  }
+}
+
+AABB AABB::Transformed(const glm::mat4& transform) const {
+  AABB bbox = Empty();
+  for (int corner = 0; corner < 8; corner++) {
+    glm::vec3 p((corner & 4) ? mx[0] : mn[0], (corner & 2) ? mx[1] : mn[1],
+                (corner & 1) ? mx[2] : mn[2]);
+    bbox.UnionWith(glm::vec3(transform * glm::vec4(p, 1.0f)));
+  }
+  return bbox;
+}
+
+bool AABB::Intersect(const glm::vec3& origin,
+                     const glm::vec3& inv_direction,
+                     float t_min,
+                     float t_max,
+                     float& t_entry) const {
+  for (int dim = 0; dim < 3; dim++) {
+    float t0 = (mn[dim] - origin[dim]) * inv_direction[dim];
+    float t1 = (mx[dim] - origin[dim]) * inv_direction[dim];
+    if (t0 > t1) {
+      std::swap(t0, t1);
+    }
+    // Written so that NaNs (ray on a slab plane) keep the current interval.
+    t_min = t0 > t_min ? t0 : t_min;
+    t_max = t1 < t_max ? t1 : t_max;
+    if (t_min > t_max) {
+      return false;
+    }
+  }
+  t_entry = t_min;
+  return true;
+}
+}  // namespace GLOO
@@ -0,0 +1,50 @@
+#ifndef AABB_H_
+#define AABB_H_
+
+#include <glm/glm.hpp>
+
+namespace GLOO {
+// Forward declarations.
+class Triangle;
+class Mesh;
+
+struct AABB {
+  AABB() {
+  }
+  AABB(const glm::vec3& _mn, const glm::vec3& _mx) : mn(_mn), mx(_mx) {
+  }
+  AABB(float mnx, float mny, float mnz, float mxx, float mxy, float mxz)
+      : mn(glm::vec3(mnx, mny, mnz)), mx(glm::vec3(mxx, mxy, mxz)) {
+  }
+  static AABB FromTriangle(const Triangle& triangle);
+  static AABB FromMesh(const Mesh& mesh);
+  // An inverted box that any UnionWith overrides.
+  static AABB Empty();
+
+  void UnionWith(const AABB& other);
+  void UnionWith(const glm::vec3& point);
+  bool Overlap(const AABB& other) const;
+  bool Contain(const AABB& other) const;
+
+  glm::vec3 GetCenter() const {
+    return 0.5f * (mn + mx);
+  }
+  float GetSurfaceArea() const {
+    glm::vec3 d = mx - mn;
+    return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+  }
+  // Bounds of this box after an affine transform.
+  AABB Transformed(const glm::mat4& transform) const;
+  // Slab test against the ray interval [t_min, t_max]. On success t_entry is
+  // the parameter at which the ray enters the box, clipped to t_min.
+  bool Intersect(const glm::vec3& origin,
+                 const glm::vec3& inv_direction,
+                 float t_min,
+                 float t_max,
+                 float& t_entry) const;
+
+  glm::vec3 mn, mx;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ACCELERATOR_TYPE_H_
+#define ACCELERATOR_TYPE_H_
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+namespace GLOO {
+enum class AcceleratorType {
+  Octree,
+  BVH,
+};
+
+inline AcceleratorType ParseAcceleratorType(const std::string& name) {
+  if (name == "octree") {
+    return AcceleratorType::Octree;
+  } else if (name == "bvh") {
+    return AcceleratorType::BVH;
+  }
+  throw std::invalid_argument("Invalid accelerator type: " + name);
+}
+
+// Build and traversal settings shared by the mesh accelerators.
+struct AcceleratorOptions {
+  AcceleratorOptions()
+      : type(AcceleratorType::Octree), max_leaf_size(0), simd(true) {
+  }
+
+  AcceleratorType type;
+  // Most triangles per leaf; 0 keeps the accelerator's own default. A
+  // multiple of TriangleBlocks::kWidth fills the SIMD lanes best.
+  size_t max_leaf_size;
+  // Test leaves with the SIMD kernel rather than one triangle at a time.
+  bool simd;
+};
+}  // namespace GLOO
+
+#endif
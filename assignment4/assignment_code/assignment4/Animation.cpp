@@ -0,0 +1,80 @@
+#include "Animation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "gloo/parsers/ObjParser.hpp"
+
+#include "helpers.hpp"
+
+namespace GLOO {
+std::string GetFramePath(const std::string& pattern, size_t frame) {
+  size_t begin = pattern.find('#');
+  if (begin == std::string::npos) {
+    throw std::runtime_error("No # for the frame number in " + pattern + "!");
+  }
+  size_t end = pattern.find_first_not_of('#', begin);
+  if (end == std::string::npos) {
+    end = pattern.size();
+  }
+  std::string number = std::to_string(frame);
+  if (number.size() < end - begin) {
+    number.insert(0, end - begin - number.size(), '0');
+  }
+  return pattern.substr(0, begin) + number + pattern.substr(end);
+}
+
+void Animation::AddNodeMotion(SceneNode& node, const glm::mat4& step) {
+  node_motions_.push_back(
+      {&node, node.GetTransform().GetLocalToParentMatrix(), step});
+}
+
+void Animation::AddMeshSequence(std::shared_ptr<Mesh> mesh,
+                                const std::string& path_pattern) {
+  // Fails early on a pattern without a frame number.
+  GetFramePath(path_pattern, 0);
+  mesh_sequences_.push_back({std::move(mesh), path_pattern});
+}
+
+FrameUpdate Animation::SetFrame(size_t frame, float max_cost_ratio) {
+  auto start = std::chrono::steady_clock::now();
+  FrameUpdate update;
+  for (const NodeMotion& motion : node_motions_) {
+    glm::mat4 matrix = motion.start;
+    for (size_t i = 0; i < frame; i++) {
+      matrix = matrix * motion.step;
+    }
+    motion.node->GetTransform().SetMatrix4x4(matrix);
+  }
+
+  for (const MeshSequence& sequence : mesh_sequences_) {
+    std::string path = GetFramePath(sequence.path_pattern, frame);
+    bool success;
+    auto data = ObjParser::Parse(path, success);
+    if (!success || data.positions == nullptr || data.indices == nullptr) {
+      throw std::runtime_error("Failed at parsing " + path);
+    }
+    Mesh::IndexView indices = sequence.mesh->GetIndices();
+    if (data.indices->size() != indices.size() ||
+        !std::equal(indices.begin(), indices.end(), data.indices->begin())) {
+      throw std::runtime_error("Triangles of " + path +
+                               " differ from those of the mesh!");
+    }
+    if (data.normals == nullptr) {
+      data.normals = CalculateNormals(*data.positions, *data.indices);
+    }
+    if (sequence.mesh->UpdateVertices(std::move(data.positions),
+                                      std::move(data.normals),
+                                      max_cost_ratio)) {
+      update.refit_meshes++;
+    } else {
+      update.rebuilt_meshes++;
+    }
+  }
+  update.ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  return update;
+}
+}  // namespace GLOO
@@ -0,0 +1,66 @@
+#ifndef ANIMATION_H_
+#define ANIMATION_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "gloo/SceneNode.hpp"
+
+#include "hittable/Mesh.hpp"
+
+namespace GLOO {
+// What SetFrame did to the meshes.
+struct FrameUpdate {
+  FrameUpdate() : ms(0.0), refit_meshes(0), rebuilt_meshes(0) {
+  }
+
+  double ms;
+  size_t refit_meshes;
+  size_t rebuilt_meshes;
+};
+
+// Replaces the run of '#' in pattern with frame, zero-padded to its length:
+// "wave_###.obj" -> "wave_007.obj".
+std::string GetFramePath(const std::string& pattern, size_t frame);
+
+// Changes of a scene from frame to frame, for scenes in which only node
+// transforms and mesh vertices move. Everything else, including the
+// acceleration structures, stays in memory between frames.
+class Animation {
+ public:
+  // At frame f the node's transform is its current one followed by step,
+  // f times over.
+  void AddNodeMotion(SceneNode& node, const glm::mat4& step);
+  // At frame f the mesh takes its vertices from the OBJ file
+  // GetFramePath(path_pattern, f), which must have the mesh's triangles.
+  void AddMeshSequence(std::shared_ptr<Mesh> mesh,
+                       const std::string& path_pattern);
+  bool IsEmpty() const {
+    return node_motions_.empty() && mesh_sequences_.empty();
+  }
+
+  // Poses the scene for frame. Meshes are refit to their new vertices, or
+  // built again where that would raise their SAH cost above max_cost_ratio
+  // times that of their last build.
+  FrameUpdate SetFrame(size_t frame, float max_cost_ratio);
+
+ private:
+  struct NodeMotion {
+    SceneNode* node;
+    glm::mat4 start;
+    glm::mat4 step;
+  };
+  struct MeshSequence {
+    std::shared_ptr<Mesh> mesh;
+    std::string path_pattern;
+  };
+
+  std::vector<NodeMotion> node_motions_;
+  std::vector<MeshSequence> mesh_sequences_;
+};
+}  // namespace GLOO
+
+#endif
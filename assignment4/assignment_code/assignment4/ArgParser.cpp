@@ -35,6 +35,99 @@ ArgParser::ArgParser(int argc, const char* argv[]) {
       i++;
       assert(i < argc);
       samples = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-threads")) {
+      i++;
+      assert(i < argc);
+      threads = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-tile")) {
+      i++;
+      assert(i < argc);
+      tile_width = atoi(argv[i]);
+      i++;
+      assert(i < argc);
+      tile_height = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-seed")) {
+      i++;
+      assert(i < argc);
+      seed = strtoul(argv[i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-packets")) {
+      i++;
+      assert(i < argc);
+      packet_size = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-adaptive")) {
+      i++;
+      assert(i < argc);
+      adaptive_min_samples = atoi(argv[i]);
+      i++;
+      assert(i < argc);
+      adaptive_max_samples = atoi(argv[i]);
+      i++;
+      assert(i < argc);
+      adaptive_threshold = atof(argv[i]);
+    } else if (!strcmp(argv[i], "-profile")) {
+      profile = true;
+    } else if (!strcmp(argv[i], "-heatmap")) {
+      i++;
+      assert(i < argc);
+      heatmap_file = argv[i];
+    } else if (!strcmp(argv[i], "-accelerator")) {
+      i++;
+      assert(i < argc);
+      accelerator = argv[i];
+    } else if (!strcmp(argv[i], "-leaf_size")) {
+      i++;
+      assert(i < argc);
+      leaf_size = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-scalar")) {
+      scalar = true;
+    } else if (!strcmp(argv[i], "-mesh_cache")) {
+      i++;
+      assert(i < argc);
+      mesh_cache = argv[i];
+    } else if (!strcmp(argv[i], "-stream")) {
+      stream = true;
+    } else if (!strcmp(argv[i], "-srgb")) {
+      srgb = true;
+    } else if (!strcmp(argv[i], "-filter_background")) {
+      filter_background = true;
+    } else if (!strcmp(argv[i], "-light_threshold")) {
+      i++;
+      assert(i < argc);
+      light_threshold = atof(argv[i]);
+    } else if (!strcmp(argv[i], "-light_samples")) {
+      i++;
+      assert(i < argc);
+      light_samples = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-wavefront")) {
+      wavefront = true;
+    } else if (!strcmp(argv[i], "-frames")) {
+      i++;
+      assert(i < argc);
+      frames = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-refit_threshold")) {
+      i++;
+      assert(i < argc);
+      refit_threshold = atof(argv[i]);
+    } else if (!strcmp(argv[i], "-workers")) {
+      i++;
+      assert(i < argc);
+      workers = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-worker_timeout")) {
+      i++;
+      assert(i < argc);
+      worker_timeout = atof(argv[i]);
+    } else if (!strcmp(argv[i], "-worker_ready_timeout")) {
+      i++;
+      assert(i < argc);
+      worker_ready_timeout = atof(argv[i]);
+    } else if (!strcmp(argv[i], "-worker_fd")) {
+      i++;
+      assert(i < argc);
+      worker_fd = atoi(argv[i]);
+    } else if (!strcmp(argv[i], "-worker_index")) {
+      i++;
+      assert(i < argc);
+      worker_index = atoi(argv[i]);
     } else if (!strcmp(argv[i], "-camera_type")) {
       i++;
       assert(i < argc);
@@ -59,6 +152,44 @@ ArgParser::ArgParser(int argc, const char* argv[]) {
   std::cout << "- height: " << height << std::endl;
   std::cout << "- bounces: " << bounces << std::endl;
   std::cout << "- shadows: " << shadows << std::endl;
+  std::cout << "- threads: " << threads << std::endl;
+  if (accelerator.size())
+    std::cout << "- accelerator: " << accelerator << std::endl;
+  if (leaf_size)
+    std::cout << "- leaf size: " << leaf_size << std::endl;
+  std::cout << "- scalar: " << scalar << std::endl;
+  if (mesh_cache.size())
+    std::cout << "- mesh cache: " << mesh_cache << std::endl;
+  if (stream)
+    std::cout << "- stream output: " << stream << std::endl;
+  if (srgb)
+    std::cout << "- srgb: " << srgb << std::endl;
+  if (filter_background)
+    std::cout << "- filter background: " << filter_background << std::endl;
+  if (light_threshold > 0.0f)
+    std::cout << "- light threshold: " << light_threshold << std::endl;
+  if (light_samples)
+    std::cout << "- light samples: " << light_samples << std::endl;
+  if (wavefront)
+    std::cout << "- wavefront: " << wavefront << std::endl;
+  if (frames) {
+    std::cout << "- frames: " << frames << std::endl;
+    std::cout << "- refit threshold: " << refit_threshold << std::endl;
+  }
+  if (workers) {
+    std::cout << "- workers: " << workers << std::endl;
+    std::cout << "- worker timeout: " << worker_timeout << std::endl;
+    std::cout << "- worker ready timeout: " << worker_ready_timeout
+              << std::endl;
+  }
+  std::cout << "- tile: " << tile_width << "x" << tile_height << std::endl;
+  if (packet_size)
+    std::cout << "- packets: " << packet_size << "x" << packet_size
+              << std::endl;
+  if (adaptive_max_samples)
+    std::cout << "- adaptive: " << adaptive_min_samples << " to "
+              << adaptive_max_samples << " samples, threshold "
+              << adaptive_threshold << std::endl;
 }
 
 void ArgParser::SetDefaultValues() {
@@ -71,4 +202,31 @@ void ArgParser::SetDefaultValues() {
   bounces = 0;
   shadows = false;
   samples = 1;
+  threads = 0;
+  tile_width = 32;
+  tile_height = 32;
+  seed = 0;
+  packet_size = 0;
+  adaptive_min_samples = 0;
+  adaptive_max_samples = 0;
+  adaptive_threshold = 0.0f;
+  profile = false;
+  heatmap_file = "";
+  accelerator = "";
+  leaf_size = 0;
+  scalar = false;
+  mesh_cache = "";
+  stream = false;
+  srgb = false;
+  filter_background = false;
+  light_threshold = 0.0f;
+  light_samples = 0;
+  wavefront = false;
+  frames = 0;
+  refit_threshold = 2.0f;
+  workers = 0;
+  worker_timeout = 10000.0f;
+  worker_ready_timeout = 300000.0f;
+  worker_fd = -1;
+  worker_index = 0;
 }
@@ -24,6 +24,53 @@ class ArgParser {
   bool jitter;
   bool filter;
   GLOO::CameraType camera_type;
+  // Multithreading.
+  size_t threads;
+  size_t tile_width;
+  size_t tile_height;
+  unsigned int seed;
+  // Side of the square ray packets; 0 disables packet tracing.
+  size_t packet_size;
+  // Adaptive sampling; adaptive_max_samples of 0 keeps a fixed sample count.
+  size_t adaptive_min_samples;
+  size_t adaptive_max_samples;
+  float adaptive_threshold;
+  // Time traversal and shading separately in the render statistics.
+  bool profile;
+  // Image of the samples taken per pixel under adaptive sampling.
+  std::string heatmap_file;
+  // Acceleration structure for every mesh; empty keeps the scene's choice.
+  std::string accelerator;
+  // Most triangles per accelerator leaf; 0 keeps the default.
+  size_t leaf_size;
+  // Test leaf triangles one at a time instead of with the SIMD kernel.
+  bool scalar;
+  // Directory of the persistent mesh cache; empty disables it.
+  std::string mesh_cache;
+  // Write the output a row of tiles at a time while rendering.
+  bool stream;
+  // sRGB-encode 8-bit output.
+  bool srgb;
+  // Filter cube map lookups by ray footprint.
+  bool filter_background;
+  // Light culling threshold and lights sampled per hit; 0 disables either.
+  float light_threshold;
+  size_t light_samples;
+  // Breadth-first wavefront rendering.
+  bool wavefront;
+  // Number of animation frames to render, 0 for a single still image, and
+  // the SAH cost ratio past which refit structures are built again.
+  size_t frames;
+  float refit_threshold;
+  // Worker processes to render tiles with, 0 to render in this process, the
+  // milliseconds a worker may sit on a tile before it is reassigned, and
+  // those it may take to load the scene before it is given up.
+  size_t workers;
+  float worker_timeout;
+  float worker_ready_timeout;
+  // Set when this process was started as a worker by a coordinator.
+  int worker_fd;
+  size_t worker_index;
  private:
   void SetDefaultValues();
 };
@@ -0,0 +1,43 @@
+#ifndef ARRAY_VIEW_H_
+#define ARRAY_VIEW_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace GLOO {
+// Read-only view of an array owned elsewhere, such as a std::vector or the
+// sections of a mapped file.
+template <typename T>
+class ArrayView {
+ public:
+  ArrayView() : data_(nullptr), size_(0) {
+  }
+  ArrayView(const T* data, size_t size) : data_(data), size_(size) {
+  }
+  ArrayView(const std::vector<T>& values)
+      : data_(values.data()), size_(values.size()) {
+  }
+
+  const T* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+  const T& operator[](size_t i) const {
+    return data_[i];
+  }
+  const T* begin() const {
+    return data_;
+  }
+  const T* end() const {
+    return data_ + size_;
+  }
+
+ private:
+  const T* data_;
+  size_t size_;
+};
+}  // namespace GLOO
+
+#endif
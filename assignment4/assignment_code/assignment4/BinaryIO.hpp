@@ -0,0 +1,122 @@
+#ifndef BINARY_IO_H_
+#define BINARY_IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace GLOO {
+// Writes plain values and arrays in native layout and byte order, for files
+// that are read back on the same kind of machine (see MeshCache). An array
+// is a 64-bit element count followed by the elements, which start at a
+// multiple of kAlignment from the beginning of the stream.
+class BinaryWriter {
+ public:
+  static const size_t kAlignment = 16;
+
+  explicit BinaryWriter(std::ostream& os) : os_(os), offset_(0) {
+  }
+
+  template <typename T>
+  void Write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be written!");
+    WriteBytes(&value, sizeof(T));
+  }
+  template <typename T>
+  void WriteArray(const std::vector<T>& values) {
+    WriteArray(values.data(), values.size());
+  }
+  template <typename T>
+  void WriteArray(const T* values, size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be written!");
+    Write<uint64_t>(count);
+    Align();
+    WriteBytes(values, count * sizeof(T));
+  }
+
+ private:
+  void WriteBytes(const void* data, size_t size) {
+    os_.write(static_cast<const char*>(data), size);
+    offset_ += size;
+  }
+  void Align() {
+    static const char kZeros[kAlignment] = {};
+    WriteBytes(kZeros, (kAlignment - offset_ % kAlignment) % kAlignment);
+  }
+
+  std::ostream& os_;
+  size_t offset_;
+};
+
+// Reads what BinaryWriter wrote from a block of memory, such as a
+// MappedFile. Reading past the end throws instead of returning garbage.
+class BinaryReader {
+ public:
+  BinaryReader(const char* data, size_t size)
+      : data_(data), size_(size), offset_(0) {
+  }
+
+  template <typename T>
+  T Read() {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be read!");
+    T value;
+    std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+    return value;
+  }
+  template <typename T>
+  void ReadArray(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be read!");
+    size_t count;
+    const char* bytes = TakeArray(sizeof(T), count);
+    values.resize(count);
+    if (count > 0) {
+      std::memcpy(values.data(), bytes, count * sizeof(T));
+    }
+  }
+  // Returns the elements where they are instead of copying them. The data
+  // must be aligned for T, as a mapped file written by BinaryWriter is for
+  // alignments up to kAlignment.
+  template <typename T>
+  const T* ReadArrayInPlace(size_t& count) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be read!");
+    static_assert(alignof(T) <= BinaryWriter::kAlignment,
+                  "Array elements would be misaligned!");
+    return reinterpret_cast<const T*>(TakeArray(sizeof(T), count));
+  }
+
+ private:
+  const char* TakeArray(size_t element_size, size_t& count) {
+    uint64_t stored_count = Read<uint64_t>();
+    Take((BinaryWriter::kAlignment - offset_ % BinaryWriter::kAlignment) %
+         BinaryWriter::kAlignment);
+    if (stored_count > (size_ - offset_) / element_size) {
+      throw std::runtime_error("Truncated binary data!");
+    }
+    count = static_cast<size_t>(stored_count);
+    return Take(count * element_size);
+  }
+  const char* Take(size_t size) {
+    if (size > size_ - offset_) {
+      throw std::runtime_error("Truncated binary data!");
+    }
+    const char* bytes = data_ + offset_;
+    offset_ += size;
+    return bytes;
+  }
+
+  const char* data_;
+  size_t size_;
+  size_t offset_;
+};
+}  // namespace GLOO
+
+#endif
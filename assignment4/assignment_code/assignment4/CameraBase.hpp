@@ -21,6 +21,10 @@ class CameraBase {
 
   virtual float GetTMin() const = 0;
 
+  // Angle in radians between the rays of two points spacing apart near the
+  // center of the image plane.
+  virtual float GetSpreadAngle(float spacing) const = 0;
+
  protected:
   glm::vec3 center_;
   glm::vec3 direction_;
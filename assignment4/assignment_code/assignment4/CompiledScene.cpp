@@ -0,0 +1,65 @@
+#include "CompiledScene.hpp"
+
+#include <unordered_map>
+
+#include "gloo/lights/DirectionalLight.hpp"
+#include "gloo/lights/PointLight.hpp"
+#include "gloo/components/MaterialComponent.hpp"
+#include "gloo/SceneNode.hpp"
+#include "gloo/Transform.hpp"
+
+namespace GLOO {
+const uint32_t CompiledScene::kNoMaterial;
+
+void CompiledScene::Compile(const std::vector<TracingComponent*>& components,
+                            const std::vector<LightComponent*>& lights) {
+  object_materials_.clear();
+  materials_.clear();
+  lights_.clear();
+
+  // Objects that share a Material share its entry.
+  std::unordered_map<const Material*, uint32_t> material_ids;
+  object_materials_.reserve(components.size());
+  for (TracingComponent* component : components) {
+    auto material_component =
+        component->GetNodePtr()->GetComponentPtr<MaterialComponent>();
+    if (material_component == nullptr) {
+      object_materials_.push_back(kNoMaterial);
+      continue;
+    }
+    const Material& material = material_component->GetMaterial();
+    auto inserted = material_ids.emplace(
+        &material, static_cast<uint32_t>(materials_.size()));
+    if (inserted.second) {
+      CompiledMaterial compiled;
+      compiled.ambient_color = material.GetAmbientColor();
+      compiled.diffuse_color = material.GetDiffuseColor();
+      compiled.specular_color = material.GetSpecularColor();
+      compiled.shininess = material.GetShininess();
+      materials_.push_back(compiled);
+    }
+    object_materials_.push_back(inserted.first->second);
+  }
+
+  lights_.reserve(lights.size());
+  for (LightComponent* light_component : lights) {
+    auto light_ptr = light_component->GetLightPtr();
+    CompiledLight light;
+    light.type = light_ptr->GetType();
+    light.color = light_ptr->GetDiffuseColor();
+    light.position = glm::vec3(0.0f);
+    light.dir_to_light = glm::vec3(0.0f);
+    light.attenuation = 1.0f;
+    if (light.type == LightType::Directional) {
+      light.dir_to_light =
+          -static_cast<DirectionalLight*>(light_ptr)->GetDirection();
+    } else if (light.type == LightType::Point) {
+      light.position =
+          light_component->GetNodePtr()->GetTransform().GetWorldPosition();
+      light.attenuation =
+          static_cast<PointLight*>(light_ptr)->GetAttenuation().x;
+    }
+    lights_.push_back(light);
+  }
+}
+}  // namespace GLOO
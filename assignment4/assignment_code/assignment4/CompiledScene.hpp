@@ -0,0 +1,86 @@
+#ifndef COMPILED_SCENE_H_
+#define COMPILED_SCENE_H_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "gloo/lights/LightBase.hpp"
+#include "gloo/components/LightComponent.hpp"
+
+#include "TracingComponent.hpp"
+
+namespace GLOO {
+struct CompiledMaterial {
+  glm::vec3 ambient_color;
+  glm::vec3 diffuse_color;
+  glm::vec3 specular_color;
+  float shininess;
+};
+
+struct CompiledLight {
+  LightType type;
+  // Diffuse color of the light.
+  glm::vec3 color;
+  // World-space position of a point light.
+  glm::vec3 position;
+  // Direction toward a directional light.
+  glm::vec3 dir_to_light;
+  // Constant attenuation of a point light.
+  float attenuation;
+};
+
+// Flat copies of what shading reads from the scene graph, made once per
+// render: a material ID per object, the distinct materials, and the lights
+// in world space. Shading then only follows indices into these tables.
+class CompiledScene {
+ public:
+  // Objects without a material.
+  static const uint32_t kNoMaterial = ~0u;
+
+  // Object i is components[i] and light i is lights[i].
+  void Compile(const std::vector<TracingComponent*>& components,
+               const std::vector<LightComponent*>& lights);
+
+  // The material of an object, or null if it has none.
+  const CompiledMaterial* GetObjectMaterial(uint32_t object) const {
+    uint32_t id = object_materials_[object];
+    return id == kNoMaterial ? nullptr : &materials_[id];
+  }
+  size_t GetMaterialCount() const {
+    return materials_.size();
+  }
+  const std::vector<CompiledLight>& GetLights() const {
+    return lights_;
+  }
+
+  // Direction and distance from hit_pos to the light, and its intensity
+  // there: color / (attenuation * d^2) for a point light, and color from
+  // infinitely far away for a directional one.
+  static void GetIllumination(const CompiledLight& light,
+                              const glm::vec3& hit_pos,
+                              glm::vec3& dir_to_light,
+                              glm::vec3& intensity,
+                              float& dist_to_light) {
+    if (light.type == LightType::Point) {
+      dir_to_light = glm::normalize(light.position - hit_pos);
+      dist_to_light = glm::length(light.position - hit_pos);
+      intensity = light.color /
+                  (light.attenuation * dist_to_light * dist_to_light);
+    } else {
+      dir_to_light = light.dir_to_light;
+      intensity = light.color;
+      dist_to_light = std::numeric_limits<float>::max();
+    }
+  }
+
+ private:
+  std::vector<uint32_t> object_materials_;
+  std::vector<CompiledMaterial> materials_;
+  std::vector<CompiledLight> lights_;
+};
+}  // namespace GLOO
+
+#endif
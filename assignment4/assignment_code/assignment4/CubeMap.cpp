@@ -1,9 +1,11 @@
 #include "CubeMap.hpp"
 
 #include <cmath>
+#include <limits>
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
 
 namespace {
 enum FACE {
@@ -14,33 +16,155 @@ enum FACE {
   FRONT,
   BACK,
 };
+
+// Faces whose U or V coordinate is one minus (q / major + 1) / 2 rather
+// than (q / major + 1) / 2.
+const unsigned kFlipU = (1u << DOWN) | (1u << FRONT);
+const unsigned kFlipV = (1u << LEFT) | (1u << DOWN) | (1u << BACK);
+
+// Directions resolved at a time by GetTexels.
+const size_t kBatchSize = 64;
+
+// Floor of a value that is at least -1.
+inline int FloorIndex(float x) {
+  int i = static_cast<int>(x);
+  return i - (x < i);
 }
+}  // namespace
 
 namespace GLOO {
 CubeMap::CubeMap(const std::string& directory) {
   std::string side[6] = {"left", "right", "up", "down", "front", "back"};
+  std::unique_ptr<Image> images[6];
+  const Image* faces[6];
   for (int i = 0; i < 6; i++) {
     std::string filename = directory + "/" + side[i] + ".png";
-    images_[i] = Image::LoadPNG(filename, false);
+    images[i] = Image::LoadPNG(filename, false);
+    faces[i] = images[i].get();
+  }
+  BuildLevels(faces);
+}
+
+CubeMap::CubeMap(const Image* const faces[6]) {
+  BuildLevels(faces);
+}
+
+void CubeMap::BuildLevels(const Image* const faces[6]) {
+  size_t width = faces[0]->GetWidth();
+  size_t height = faces[0]->GetHeight();
+  for (int i = 1; i < 6; i++) {
+    if (faces[i]->GetWidth() != width || faces[i]->GetHeight() != height) {
+      throw std::runtime_error("Cube map faces differ in size!");
+    }
   }
+  if (width == 0 || height == 0) {
+    throw std::runtime_error("Cube map faces are empty!");
+  }
+
+  while (true) {
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.stride = width + 3;
+    level.face_size = level.stride * (height + 3);
+    level.x_scale = width;
+    level.y_scale = height;
+    level.x_offset = 0.5f * width / faces[0]->GetWidth() - 0.5f;
+    level.y_offset = 0.5f * height / faces[0]->GetHeight() - 0.5f;
+    level.texels.resize(6 * level.face_size);
+    const Level* finer = levels_.empty() ? nullptr : &levels_.back();
+    for (int face = 0; face < 6; face++) {
+      glm::vec3* texels = level.texels.data() + face * level.face_size;
+      // Rows and columns -1 to size + 1, the border repeating the edge.
+      for (int y = -1; y <= int(height) + 1; y++) {
+        int sy = std::min(std::max(0, y), int(height) - 1);
+        for (int x = -1; x <= int(width) + 1; x++) {
+          int sx = std::min(std::max(0, x), int(width) - 1);
+          glm::vec3& texel = *texels++;
+          if (finer == nullptr) {
+            texel = faces[face]->GetPixel(sx, sy);
+          } else {
+            // Odd sizes drop the last row or column of the finer level.
+            const glm::vec3* p = finer->GetTexel(2 * sx, 2 * sy, face);
+            texel = 0.25f * (p[0] + p[1] + p[finer->stride] +
+                             p[finer->stride + 1]);
+          }
+        }
+      }
+    }
+    levels_.push_back(std::move(level));
+    if (width == 1 && height == 1) {
+      break;
+    }
+    width = std::max<size_t>(1, width / 2);
+    height = std::max<size_t>(1, height / 2);
+  }
+}
+
+inline CubeMap::FacePoint CubeMap::GetFacePoint(const glm::vec3& dir) {
+  // Face and UV only depend on ratios to the major component, so the
+  // direction is not normalized.
+  float ax = std::abs(dir.x);
+  float ay = std::abs(dir.y);
+  float az = std::abs(dir.z);
+  // Ties go to x, then y. Everything else follows from selects, which
+  // compile without branches.
+  bool x_major = (ax >= ay) & (ax >= az);
+  bool y_major = !x_major & (ay >= az);
+  bool z_major = !x_major & !y_major;
+  float major = x_major ? dir.x : (y_major ? dir.y : dir.z);
+  // U comes from z on the x faces and from x otherwise, V from z on the y
+  // faces and from y otherwise.
+  float u_value = x_major ? dir.z : dir.x;
+  float v_value = y_major ? dir.z : dir.y;
+  bool negative = major < 0.0f;
+  FacePoint point;
+  // The sum is NaN or infinite if any component is, and zero only for the
+  // zero direction.
+  float sum = ax + ay + az;
+  point.valid = sum > 0.0f && sum <= std::numeric_limits<float>::max();
+  // LEFT, RIGHT: 0 + positive; UP, DOWN: 2 + negative; FRONT, BACK: 4 +
+  // negative.
+  point.face = 2 * (y_major + 2 * z_major) + (x_major ? !negative : negative);
+  point.major = std::abs(major);
+  float inv_major = 1.0f / major;
+  float u = (u_value * inv_major + 1.0f) * 0.5f;
+  float v = (v_value * inv_major + 1.0f) * 0.5f;
+  point.u = (kFlipU >> point.face) & 1 ? 1.0f - u : u;
+  point.v = (kFlipV >> point.face) & 1 ? 1.0f - v : v;
+  return point;
+}
+
+inline float CubeMap::GetLod(const FacePoint& point,
+                             const glm::vec3& direction,
+                             float footprint) const {
+  // A solid angle covers major^-3 times as much of the face plane, which
+  // spans 2 units at a distance of 1, for the major component of the
+  // normalized direction.
+  float major = point.major / glm::length(direction);
+  float plane_width = footprint / (major * std::sqrt(major));
+  float texels = 0.5f * plane_width * levels_[0].width;
+  return texels > 1.0f ? std::log2(texels) : 0.0f;
 }
 
-glm::vec3 CubeMap::GetFaceTexel(float x, float y, int face) const {
-  x = x * images_[face]->GetWidth();
-  y = (1 - y) * images_[face]->GetHeight();
-  int ix = (int)x;
-  int iy = (int)y;
+inline glm::vec3 CubeMap::GetFaceTexel(const FacePoint& point,
+                                       size_t level) const {
+  const Level& mip = levels_[level];
+  float x = point.u * mip.x_scale + mip.x_offset;
+  float y = (1 - point.v) * mip.y_scale + mip.y_offset;
+  int ix = FloorIndex(x);
+  int iy = FloorIndex(y);
   float alpha = x - ix;
   float beta = y - iy;
 
-  const glm::vec3& pixel0 = GetTexturePixel(ix + 0, iy + 0, face);
-  const glm::vec3& pixel1 = GetTexturePixel(ix + 1, iy + 0, face);
-  const glm::vec3& pixel2 = GetTexturePixel(ix + 0, iy + 1, face);
-  const glm::vec3& pixel3 = GetTexturePixel(ix + 1, iy + 1, face);
+  const glm::vec3* pixel0 = mip.GetTexel(ix, iy, point.face);
+  const glm::vec3& pixel1 = pixel0[1];
+  const glm::vec3& pixel2 = pixel0[mip.stride];
+  const glm::vec3& pixel3 = pixel0[mip.stride + 1];
 
   glm::vec3 color;
   for (int i = 0; i < 3; i++) {
-    color[i] = (1 - alpha) * (1 - beta) * pixel0[i] +
+    color[i] = (1 - alpha) * (1 - beta) * (*pixel0)[i] +
                alpha * (1 - beta) * pixel1[i] + (1 - alpha) * beta * pixel2[i] +
                alpha * beta * pixel3[i];
   }
@@ -48,44 +172,71 @@ glm::vec3 CubeMap::GetFaceTexel(float x, float y, int face) const {
   return color;
 }
 
+inline glm::vec3 CubeMap::GetFilteredTexel(const FacePoint& point,
+                                           float lod) const {
+  if (!std::isfinite(lod)) {
+    return GetFaceTexel(point, 0);
+  }
+  size_t level = static_cast<size_t>(
+      std::min(lod, static_cast<float>(levels_.size() - 1)));
+  if (level + 1 >= levels_.size()) {
+    return GetFaceTexel(point, levels_.size() - 1);
+  }
+  glm::vec3 color = GetFaceTexel(point, level);
+  float t = lod - level;
+  if (t > 0.0f) {
+    color += t * (GetFaceTexel(point, level + 1) - color);
+  }
+  return color;
+}
+
 glm::vec3 CubeMap::GetTexel(const glm::vec3& direction) const {
-  glm::vec3 dir = glm::normalize(direction);
-  glm::vec3 outputColor(0.0f);
-  if ((std::abs(dir[0]) >= std::abs(dir[1])) &&
-      (std::abs(dir[0]) >= std::abs(dir[2]))) {
-    if (dir[0] > 0.0f) {
-      outputColor = GetFaceTexel((dir[2] / dir[0] + 1.0f) * 0.5f,
-                                 (dir[1] / dir[0] + 1.0f) * 0.5f, RIGHT);
-    } else if (dir[0] < 0.0f) {
-      outputColor = GetFaceTexel((dir[2] / dir[0] + 1.0f) * 0.5f,
-                                 1.0f - (dir[1] / dir[0] + 1.0f) * 0.5f, LEFT);
-    }
-  } else if ((std::abs(dir[1]) >= std::abs(dir[0])) &&
-             (std::abs(dir[1]) >= std::abs(dir[2]))) {
-    if (dir[1] > 0.0f) {
-      outputColor = GetFaceTexel((dir[0] / dir[1] + 1.0f) * 0.5f,
-                                 (dir[2] / dir[1] + 1.0f) * 0.5f, UP);
-    } else if (dir[1] < 0.0f) {
-      outputColor = GetFaceTexel(1.0f - (dir[0] / dir[1] + 1.0f) * 0.5f,
-                                 1.0f - (dir[2] / dir[1] + 1.0f) * 0.5f, DOWN);
-    }
-  } else if ((std::abs(dir[2]) >= std::abs(dir[0])) &&
-             (std::abs(dir[2]) >= std::abs(dir[1]))) {
-    if (dir[2] > 0.0f) {
-      outputColor = GetFaceTexel(1.0f - (dir[0] / dir[2] + 1.0f) * 0.5f,
-                                 (dir[1] / dir[2] + 1.0f) * 0.5f, FRONT);
-    } else if (dir[2] < 0.0f) {
-      outputColor = GetFaceTexel((dir[0] / dir[2] + 1.0f) * 0.5f,
-                                 1.0f - (dir[1] / dir[2] + 1.0f) * 0.5f, BACK);
-    }
+  FacePoint point = GetFacePoint(direction);
+  if (!point.valid) {
+    return glm::vec3(0.0f);
   }
+  return GetFaceTexel(point, 0);
+}
 
-  return outputColor;
+glm::vec3 CubeMap::GetTexel(const glm::vec3& direction,
+                            float footprint) const {
+  FacePoint point = GetFacePoint(direction);
+  if (!point.valid) {
+    return glm::vec3(0.0f);
+  }
+  if (footprint <= 0.0f) {
+    return GetFaceTexel(point, 0);
+  }
+  return GetFilteredTexel(point, GetLod(point, direction, footprint));
 }
 
-const glm::vec3& CubeMap::GetTexturePixel(int x, int y, int face) const {
-  x = std::min(std::max(0, x), (int)(images_[face]->GetWidth() - 1));
-  y = std::min(std::max(0, y), (int)(images_[face]->GetHeight() - 1));
-  return images_[face]->GetPixel(x, y);
+void CubeMap::GetTexels(const glm::vec3* directions,
+                        size_t count,
+                        float footprint,
+                        glm::vec3* colors) const {
+  FacePoint points[kBatchSize];
+  float lods[kBatchSize];
+  for (size_t start = 0; start < count; start += kBatchSize) {
+    size_t n = std::min(kBatchSize, count - start);
+    // Face selection first, then the texel fetches, which depend on it.
+    for (size_t i = 0; i < n; i++) {
+      points[i] = GetFacePoint(directions[start + i]);
+    }
+    if (footprint <= 0.0f) {
+      for (size_t i = 0; i < n; i++) {
+        colors[start + i] =
+            points[i].valid ? GetFaceTexel(points[i], 0) : glm::vec3(0.0f);
+      }
+      continue;
+    }
+    for (size_t i = 0; i < n; i++) {
+      lods[i] = GetLod(points[i], directions[start + i], footprint);
+    }
+    for (size_t i = 0; i < n; i++) {
+      colors[start + i] = points[i].valid
+                              ? GetFilteredTexel(points[i], lods[i])
+                              : glm::vec3(0.0f);
+    }
+  }
 }
 }  // namespace GLOO
@@ -3,27 +3,85 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 #include "gloo/Image.hpp"
 
 namespace GLOO {
+// Faces are stored with a border of copied edge texels, so lookups never
+// clamp, and with a chain of box filtered mip levels for lookups by ray
+// footprint. All faces must have the same size.
 class CubeMap {
  public:
   // Assumes a directory containing {left,right,up,down,front,back}.png.
   CubeMap(const std::string& directory);
+  // Faces in the order left, right, up, down, front, back.
+  CubeMap(const Image* const faces[6]);
 
   // Returns color for given directory
   glm::vec3 GetTexel(const glm::vec3& direction) const;
+  // The color averaged over a cone of directions footprint radians wide.
+  // Footprints up to a texel give the same color as GetTexel.
+  glm::vec3 GetTexel(const glm::vec3& direction, float footprint) const;
+  // colors[i] receives GetTexel(directions[i], footprint).
+  void GetTexels(const glm::vec3* directions,
+                 size_t count,
+                 float footprint,
+                 glm::vec3* colors) const;
+
+  size_t GetLevelCount() const {
+    return levels_.size();
+  }
 
  private:
+  // The texels of all six faces at one mip level. Face rows are stride
+  // texels apart, starting with one border row and column; two more border
+  // rows and columns follow the face.
+  struct Level {
+    size_t width;
+    size_t height;
+    size_t stride;
+    size_t face_size;
+    // Texel coordinates are u * width + x_offset and (1 - v) * height +
+    // y_offset, which lines texel centers up with those of level 0.
+    float x_scale;
+    float y_scale;
+    float x_offset;
+    float y_offset;
+    std::vector<glm::vec3> texels;
+
+    const glm::vec3* GetTexel(int x, int y, int face) const {
+      return texels.data() + face * face_size + (y + 1) * stride + (x + 1);
+    }
+  };
+  // Where a direction lands: the face, its UV coordinates, which are
+  // normalized between 0 and 1, and the magnitude of the major component of
+  // the direction as given, which need not be normalized. Zero and
+  // non-finite directions are not valid and look up black.
+  struct FacePoint {
+    int face;
+    float u;
+    float v;
+    float major;
+    bool valid;
+  };
+
+  void BuildLevels(const Image* const faces[6]);
+  static FacePoint GetFacePoint(const glm::vec3& direction);
+  // Mip level, possibly fractional, for a footprint at the face point of
+  // direction.
+  float GetLod(const FacePoint& point,
+               const glm::vec3& direction,
+               float footprint) const;
   // The UV (x, y) coordinates are assumed to be normalized between 0 and 1.
   // The resulting look up is box filtered in the local 2x2 neighborhood.
-  glm::vec3 GetFaceTexel(float x, float y, int face) const;
-  const glm::vec3& GetTexturePixel(int x, int y, int face) const;
+  glm::vec3 GetFaceTexel(const FacePoint& point, size_t level) const;
+  // Blends the two mip levels around lod.
+  glm::vec3 GetFilteredTexel(const FacePoint& point, float lod) const;
 
-  std::unique_ptr<Image> images_[6];
+  std::vector<Level> levels_;
 };
 }  // namespace GLOO
 
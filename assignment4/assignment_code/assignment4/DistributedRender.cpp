@@ -0,0 +1,579 @@
+#include "DistributedRender.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "gloo/utils.hpp"
+
+#include "TileScheduler.hpp"
+
+namespace {
+using namespace GLOO;
+
+typedef std::chrono::steady_clock Clock;
+
+// Every message starts with this header. Hello goes from a worker to the
+// coordinator once the scene is loaded, with the worker index in tile and
+// the image size in x1 and y1. Tile asks a worker to render a tile, and
+// Pixels answers with the same header, a TileResult and the tile's pixels,
+// rows from y0 up, as RGB floats. Stop tells a worker to exit.
+enum MessageType : uint32_t {
+  kHello = 1,
+  kTile = 2,
+  kPixels = 3,
+  kStop = 4,
+};
+
+struct Message {
+  uint32_t type;
+  uint32_t tile;
+  uint32_t x0, y0;
+  uint32_t x1, y1;
+};
+
+// What the worker measured while rendering a tile.
+struct TileResult {
+  RenderCounters counters;
+  double ms;
+};
+
+size_t GetPixelBytes(const Message& message) {
+  return size_t(message.x1 - message.x0) * (message.y1 - message.y0) * 3 *
+         sizeof(float);
+}
+
+#ifndef _WIN32
+bool SendAll(int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+// Returns false if the other end hung up or the read failed.
+bool ReceiveAll(int fd, void* data, size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t received = recv(fd, bytes, size, 0);
+    if (received == 0) {
+      return false;
+    }
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool SendMessage(int fd,
+                 uint32_t type,
+                 uint32_t tile,
+                 const Tile& rect) {
+  Message message = {type,
+                     tile,
+                     uint32_t(rect.x0),
+                     uint32_t(rect.y0),
+                     uint32_t(rect.x1),
+                     uint32_t(rect.y1)};
+  return SendAll(fd, &message, sizeof(message));
+}
+#endif
+}  // namespace
+
+namespace GLOO {
+#ifdef _WIN32
+struct TileCoordinator::Worker {};
+
+TileCoordinator::TileCoordinator(const std::vector<std::string>&,
+                                 const glm::ivec2&,
+                                 const glm::ivec2&,
+                                 const DistributedOptions&) {
+  throw std::runtime_error("Distributed rendering needs a POSIX system!");
+}
+
+TileCoordinator::~TileCoordinator() {
+}
+
+std::unique_ptr<Image> TileCoordinator::Render() {
+  return nullptr;
+}
+
+void RunTileWorker(int,
+                   size_t,
+                   const Tracer&,
+                   const std::function<void(size_t)>&) {
+  throw std::runtime_error("Distributed rendering needs a POSIX system!");
+}
+#else
+struct TileCoordinator::Worker {
+  struct Assignment {
+    uint32_t tile;
+    // When the worker started on the tile, as far as the coordinator can
+    // tell: when it was sent, or when the tile before it came back.
+    Clock::time_point start;
+  };
+
+  pid_t pid = -1;
+  int fd = -1;
+  Clock::time_point started;
+  // Sent Hello; until then the worker is loading the scene.
+  bool ready = false;
+  bool alive = true;
+  bool stalled = false;
+  std::deque<Assignment> in_flight;
+  // Received bytes not yet parsed into messages.
+  std::vector<char> inbox;
+};
+
+TileCoordinator::TileCoordinator(const std::vector<std::string>& worker_args,
+                                 const glm::ivec2& image_size,
+                                 const glm::ivec2& tile_size,
+                                 const DistributedOptions& options)
+    : image_size_(image_size),
+      tile_size_(tile_size),
+      options_(options),
+      reassigned_tiles_(0),
+      duplicate_results_(0),
+      lost_workers_(0) {
+  if (options_.workers == 0 || options_.tiles_in_flight == 0) {
+    throw std::invalid_argument("Bad worker count or tiles in flight!");
+  }
+  tiles_per_worker_.resize(options_.workers);
+  stats_.width = image_size_.x;
+  stats_.height = image_size_.y;
+  stats_.per_worker.resize(options_.workers);
+  try {
+    StartWorkers(worker_args);
+  } catch (...) {
+    StopWorkers();
+    throw;
+  }
+}
+
+TileCoordinator::~TileCoordinator() {
+  StopWorkers();
+}
+
+void TileCoordinator::StartWorkers(
+    const std::vector<std::string>& worker_args) {
+  for (size_t i = 0; i < options_.workers; i++) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+      throw std::runtime_error(std::string("Cannot create socket pair: ") +
+                               strerror(errno));
+    }
+    // Everything the child needs is built before the fork.
+    std::vector<std::string> args = worker_args;
+    args.push_back("-worker_fd");
+    args.push_back(std::to_string(fds[1]));
+    args.push_back("-worker_index");
+    args.push_back(std::to_string(i));
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+      argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      throw std::runtime_error(std::string("Cannot start worker: ") +
+                               strerror(errno));
+    }
+    if (pid == 0) {
+      // Only the worker's end of its own socket pair survives the exec.
+      fcntl(fds[1], F_SETFD, 0);
+      int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+      if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+      }
+      execv("/proc/self/exe", argv.data());
+      _exit(127);
+    }
+    close(fds[1]);
+    workers_.push_back(make_unique<Worker>());
+    workers_.back()->pid = pid;
+    workers_.back()->started = Clock::now();
+    workers_.back()->fd = fds[0];
+  }
+}
+
+void TileCoordinator::StopWorkers() {
+  for (auto& worker : workers_) {
+    if (worker->fd >= 0) {
+      Message stop = {kStop, 0, 0, 0, 0, 0};
+      SendAll(worker->fd, &stop, sizeof(stop));
+      close(worker->fd);
+      worker->fd = -1;
+    }
+  }
+  // Give the workers a moment to exit on their own; stalled ones are
+  // killed.
+  auto deadline = Clock::now() + std::chrono::milliseconds(500);
+  for (auto& worker : workers_) {
+    while (worker->pid > 0) {
+      if (waitpid(worker->pid, nullptr, WNOHANG) != 0) {
+        worker->pid = -1;
+      } else if (Clock::now() > deadline) {
+        kill(worker->pid, SIGKILL);
+        waitpid(worker->pid, nullptr, 0);
+        worker->pid = -1;
+      } else {
+        usleep(1000);
+      }
+    }
+  }
+}
+
+std::unique_ptr<Image> TileCoordinator::Render() {
+  auto render_start = Clock::now();
+  std::vector<Tile> tiles;
+  TileScheduler scheduler(image_size_, tile_size_, 1);
+  Tile next_tile;
+  while (scheduler.Next(0, next_tile)) {
+    tiles.push_back(next_tile);
+  }
+  std::deque<uint32_t> pending;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    pending.push_back(static_cast<uint32_t>(i));
+  }
+  std::vector<bool> done(tiles.size(), false);
+  // Outstanding assignments of each tile, counting copies.
+  std::vector<size_t> copies(tiles.size(), 0);
+  size_t tiles_left = tiles.size();
+  auto image = make_unique<Image>(image_size_.x, image_size_.y);
+  size_t total_pixels = image_size_.x * image_size_.y;
+  size_t current_pixel = 0;
+  int progress = 0;
+
+  // Requeues the tiles the worker still holds, oldest first.
+  auto requeue = [&](Worker& worker) {
+    for (auto it = worker.in_flight.rbegin(); it != worker.in_flight.rend();
+         ++it) {
+      if (!done[it->tile]) {
+        pending.push_front(it->tile);
+        reassigned_tiles_++;
+      }
+    }
+  };
+  auto lose = [&](size_t index, const std::string& reason) {
+    Worker& worker = *workers_[index];
+    std::cout << "Lost worker " << index << " (" << reason << ")"
+              << std::endl;
+    if (!worker.stalled) {
+      requeue(worker);
+    }
+    for (const Worker::Assignment& assignment : worker.in_flight) {
+      copies[assignment.tile]--;
+    }
+    worker.in_flight.clear();
+    worker.alive = false;
+    close(worker.fd);
+    worker.fd = -1;
+    kill(worker.pid, SIGKILL);
+    waitpid(worker.pid, nullptr, 0);
+    worker.pid = -1;
+    lost_workers_++;
+  };
+  // The next tile for the worker: a pending one, or near the end of the
+  // frame, for an idle worker, a copy of the oldest tile out elsewhere.
+  auto next = [&](size_t index, uint32_t& tile) {
+    while (!pending.empty()) {
+      tile = pending.front();
+      pending.pop_front();
+      if (!done[tile]) {
+        return true;
+      }
+    }
+    if (!workers_[index]->in_flight.empty()) {
+      return false;
+    }
+    const Worker::Assignment* oldest = nullptr;
+    for (size_t i = 0; i < workers_.size(); i++) {
+      if (i == index || !workers_[i]->alive) {
+        continue;
+      }
+      for (const Worker::Assignment& assignment : workers_[i]->in_flight) {
+        if (!done[assignment.tile] && copies[assignment.tile] == 1 &&
+            (oldest == nullptr || assignment.start < oldest->start)) {
+          oldest = &assignment;
+        }
+      }
+    }
+    if (oldest == nullptr) {
+      return false;
+    }
+    tile = oldest->tile;
+    return true;
+  };
+  // Parses the complete messages in the worker's inbox. Returns false on a
+  // malformed one.
+  auto receive = [&](size_t index) {
+    Worker& worker = *workers_[index];
+    size_t offset = 0;
+    bool ok = true;
+    while (worker.inbox.size() - offset >= sizeof(Message)) {
+      Message message;
+      memcpy(&message, worker.inbox.data() + offset, sizeof(message));
+      if (message.type == kHello) {
+        if (message.x1 != uint32_t(image_size_.x) ||
+            message.y1 != uint32_t(image_size_.y)) {
+          ok = false;
+          break;
+        }
+        worker.ready = true;
+        offset += sizeof(message);
+        continue;
+      }
+      if (message.type != kPixels || message.tile >= tiles.size()) {
+        ok = false;
+        break;
+      }
+      const Tile& tile = tiles[message.tile];
+      if (message.x0 != tile.x0 || message.y0 != tile.y0 ||
+          message.x1 != tile.x1 || message.y1 != tile.y1) {
+        ok = false;
+        break;
+      }
+      size_t size =
+          sizeof(message) + sizeof(TileResult) + GetPixelBytes(message);
+      if (worker.inbox.size() - offset < size) {
+        break;
+      }
+      auto it = std::find_if(
+          worker.in_flight.begin(), worker.in_flight.end(),
+          [&](const Worker::Assignment& assignment) {
+            return assignment.tile == message.tile;
+          });
+      if (it == worker.in_flight.end()) {
+        ok = false;
+        break;
+      }
+      bool was_oldest = it == worker.in_flight.begin();
+      worker.in_flight.erase(it);
+      if (was_oldest && !worker.in_flight.empty()) {
+        worker.in_flight.front().start = Clock::now();
+      }
+      copies[message.tile]--;
+      worker.stalled = false;
+      TileResult result;
+      memcpy(&result, worker.inbox.data() + offset + sizeof(message),
+             sizeof(result));
+      stats_.per_worker[index].Add(result.counters);
+
+      if (done[message.tile]) {
+        duplicate_results_++;
+      } else {
+        stats_.tiles.push_back({tile, index, result.ms});
+        const char* pixels = worker.inbox.data() + offset + sizeof(message) +
+                             sizeof(result);
+        for (size_t y = tile.y0; y < tile.y1; y++) {
+          for (size_t x = tile.x0; x < tile.x1; x++) {
+            float rgb[3];
+            memcpy(rgb, pixels, sizeof(rgb));
+            pixels += sizeof(rgb);
+            image->SetPixel(x, y, glm::vec3(rgb[0], rgb[1], rgb[2]));
+          }
+        }
+        done[message.tile] = true;
+        tiles_left--;
+        tiles_per_worker_[index]++;
+        current_pixel += (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+        float fprogress = 100.0f * current_pixel / total_pixels;
+        if (fprogress > progress + 1) {
+          progress = fprogress;
+          std::cout << "Rendered: " << progress << "%" << std::endl;
+        }
+      }
+      offset += size;
+    }
+    worker.inbox.erase(worker.inbox.begin(), worker.inbox.begin() + offset);
+    return ok;
+  };
+
+  int poll_ms = static_cast<int>(
+      std::max(1.0, std::min(50.0, options_.timeout_ms / 2)));
+  std::vector<char> buffer(1 << 16);
+  while (tiles_left > 0) {
+    for (size_t i = 0; i < workers_.size(); i++) {
+      Worker& worker = *workers_[i];
+      uint32_t tile;
+      while (worker.alive && worker.ready && !worker.stalled &&
+             worker.in_flight.size() < options_.tiles_in_flight &&
+             next(i, tile)) {
+        if (!SendMessage(worker.fd, kTile, tile, tiles[tile])) {
+          pending.push_front(tile);
+          lose(i, "send failed");
+          break;
+        }
+        worker.in_flight.push_back({tile, Clock::now()});
+        copies[tile]++;
+      }
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<size_t> fd_workers;
+    for (size_t i = 0; i < workers_.size(); i++) {
+      if (workers_[i]->alive) {
+        fds.push_back({workers_[i]->fd, POLLIN, 0});
+        fd_workers.push_back(i);
+      }
+    }
+    if (fds.empty()) {
+      throw std::runtime_error("Every worker was lost!");
+    }
+    if (poll(fds.data(), fds.size(), poll_ms) < 0 && errno != EINTR) {
+      throw std::runtime_error(std::string("Cannot poll workers: ") +
+                               strerror(errno));
+    }
+    for (size_t f = 0; f < fds.size(); f++) {
+      if (fds[f].revents == 0) {
+        continue;
+      }
+      size_t index = fd_workers[f];
+      Worker& worker = *workers_[index];
+      ssize_t received =
+          recv(worker.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+      if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                           errno == EINTR)) {
+        continue;
+      }
+      if (received <= 0) {
+        lose(index, worker.ready ? "exited" : "exited while loading");
+        continue;
+      }
+      worker.inbox.insert(worker.inbox.end(), buffer.begin(),
+                          buffer.begin() + received);
+      if (!receive(index)) {
+        lose(index, "bad message");
+      }
+    }
+
+    bool responsive = false;
+    for (size_t i = 0; i < workers_.size(); i++) {
+      Worker& worker = *workers_[i];
+      if (worker.alive && !worker.ready &&
+          MsSince(worker.started) > options_.ready_timeout_ms) {
+        lose(i, "not ready in time");
+      }
+      if (worker.alive && !worker.stalled && !worker.in_flight.empty() &&
+          MsSince(worker.in_flight.front().start) > options_.timeout_ms) {
+        std::cout << "Worker " << i << " stalled, reassigning "
+                  << worker.in_flight.size() << " tiles" << std::endl;
+        worker.stalled = true;
+        requeue(worker);
+      }
+      responsive |= worker.alive && !worker.stalled;
+    }
+    // With nobody left to take their tiles, stalled workers get a second
+    // timeout to answer before they count as lost.
+    for (size_t i = 0; i < workers_.size() && !responsive; i++) {
+      Worker& worker = *workers_[i];
+      if (worker.alive &&
+          MsSince(worker.in_flight.front().start) > 2 * options_.timeout_ms) {
+        lose(i, "stalled");
+      }
+    }
+  }
+  StopWorkers();
+  stats_.render_ms = MsSince(render_start);
+  for (const RenderCounters& counters : stats_.per_worker) {
+    stats_.totals.Add(counters);
+  }
+
+  std::cout << "Rendered " << tiles.size() << " tiles on "
+            << workers_.size() << " workers in " << stats_.render_ms
+            << " ms (";
+  for (size_t i = 0; i < tiles_per_worker_.size(); i++) {
+    std::cout << (i ? ", " : "") << tiles_per_worker_[i];
+  }
+  std::cout << " tiles per worker; " << reassigned_tiles_ << " reassigned, "
+            << duplicate_results_ << " duplicate results, " << lost_workers_
+            << " workers lost)" << std::endl;
+  return image;
+}
+
+void RunTileWorker(int fd,
+                   size_t worker_index,
+                   const Tracer& tracer,
+                   const std::function<void(size_t)>& before_tile) {
+  const glm::ivec2& image_size = tracer.GetImageSize();
+  Message hello = {kHello, uint32_t(worker_index), 0, 0,
+                   uint32_t(image_size.x), uint32_t(image_size.y)};
+  if (!SendAll(fd, &hello, sizeof(hello))) {
+    return;
+  }
+  size_t tiles_done = 0;
+  Message request;
+  std::vector<char> reply;
+  RenderCounters& counters = RenderCounters::Local();
+  while (ReceiveAll(fd, &request, sizeof(request)) && request.type == kTile) {
+    if (before_tile) {
+      before_tile(tiles_done);
+    }
+    if (request.x0 >= request.x1 || request.y0 >= request.y1 ||
+        request.x1 > uint32_t(image_size.x) ||
+        request.y1 > uint32_t(image_size.y)) {
+      throw std::runtime_error("Tile request out of the image!");
+    }
+    Tile tile = {request.x0, request.y0, request.x1, request.y1};
+    Image pixels(tile.x1 - tile.x0, tile.y1 - tile.y0);
+    counters.Clear();
+    auto tile_start = Clock::now();
+    tracer.RenderTileImage(tile, pixels);
+    TileResult result;
+    result.counters = counters;
+    result.ms = MsSince(tile_start);
+
+    reply.resize(sizeof(request) + sizeof(result) + GetPixelBytes(request));
+    request.type = kPixels;
+    memcpy(reply.data(), &request, sizeof(request));
+    memcpy(reply.data() + sizeof(request), &result, sizeof(result));
+    char* out = reply.data() + sizeof(request) + sizeof(result);
+    for (size_t y = 0; y < pixels.GetHeight(); y++) {
+      for (size_t x = 0; x < pixels.GetWidth(); x++) {
+        glm::vec3 color = pixels.GetPixel(x, y);
+        float rgb[3] = {color.r, color.g, color.b};
+        memcpy(out, rgb, sizeof(rgb));
+        out += sizeof(rgb);
+      }
+    }
+    if (!SendAll(fd, reply.data(), reply.size())) {
+      return;
+    }
+    tiles_done++;
+  }
+}
+#endif
+}  // namespace GLOO
@@ -0,0 +1,102 @@
+#ifndef DISTRIBUTED_RENDER_H_
+#define DISTRIBUTED_RENDER_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "gloo/Image.hpp"
+
+#include "Tracer.hpp"
+
+namespace GLOO {
+struct DistributedOptions {
+  size_t workers = 1;
+  // Tiles a worker holds at once, so that it never waits on a round trip.
+  size_t tiles_in_flight = 2;
+  // A worker whose oldest tile has been out this long is considered
+  // stalled: its tiles go to the others and it gets no new ones until it
+  // answers again.
+  double timeout_ms = 10000.0;
+  // A worker that has not loaded the scene this long after it was started
+  // is lost.
+  double ready_timeout_ms = 300000.0;
+};
+
+// Renders an image with worker processes on this machine. Each worker is
+// this executable started again with worker_args plus "-worker_fd F
+// -worker_index I"; it loads the scene once and then runs RunTileWorker on
+// its end of a socket pair. The coordinator hands out the tiles of the
+// image, at most tiles_in_flight per worker, and assembles the pixels that
+// come back. Tiles of a worker that exits or stalls are handed out again,
+// and once no tiles are left, idle workers take copies of the oldest tiles
+// still out; the first result for a tile wins. When every worker left has
+// stalled, those that stay silent for twice the timeout are lost too, as
+// are workers that are still loading the scene at the ready timeout.
+// Throws once every worker is lost. Linux only, as workers are started
+// through /proc/self/exe.
+class TileCoordinator {
+ public:
+  TileCoordinator(const std::vector<std::string>& worker_args,
+                  const glm::ivec2& image_size,
+                  const glm::ivec2& tile_size,
+                  const DistributedOptions& options);
+  // Stops the workers that are still running.
+  ~TileCoordinator();
+
+  std::unique_ptr<Image> Render();
+
+  // Tiles whose result each worker delivered first.
+  const std::vector<size_t>& GetTilesPerWorker() const {
+    return tiles_per_worker_;
+  }
+  // Tiles handed out again after their worker exited or stalled.
+  size_t GetReassignedTiles() const {
+    return reassigned_tiles_;
+  }
+  // Results that arrived for tiles that were already done.
+  size_t GetDuplicateResults() const {
+    return duplicate_results_;
+  }
+  size_t GetLostWorkers() const {
+    return lost_workers_;
+  }
+  // Image size, render time, and the counters and tile times the workers
+  // reported, one per_worker entry per worker process. Results for tiles
+  // that were already done add to the counters but not to the tiles.
+  const RenderStats& GetStats() const {
+    return stats_;
+  }
+
+ private:
+  struct Worker;
+
+  void StartWorkers(const std::vector<std::string>& worker_args);
+  void StopWorkers();
+
+  glm::ivec2 image_size_;
+  glm::ivec2 tile_size_;
+  DistributedOptions options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<size_t> tiles_per_worker_;
+  size_t reassigned_tiles_;
+  size_t duplicate_results_;
+  size_t lost_workers_;
+  RenderStats stats_;
+};
+
+// Serves tile requests from the coordinator on fd until it says to stop or
+// hangs up. scene must already be prepared with tracer.Prepare. before_tile,
+// if set, is called with the number of tiles done before each tile is
+// rendered; tests use it to make a worker exit or hang.
+void RunTileWorker(
+    int fd,
+    size_t worker_index,
+    const Tracer& tracer,
+    const std::function<void(size_t)>& before_tile = nullptr);
+}  // namespace GLOO
+
+#endif
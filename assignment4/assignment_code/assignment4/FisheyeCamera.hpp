@@ -45,6 +45,10 @@ class FisheyeCamera : public CameraBase {
     return 0.0f;
   }
 
+  float GetSpreadAngle(float spacing) const override {
+    return spacing * fov_radian_ * fisheye_strength_;
+  }
+
  private:
   float fisheye_strength_;
 };
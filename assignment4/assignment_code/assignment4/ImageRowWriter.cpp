@@ -0,0 +1,521 @@
+#include "ImageRowWriter.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "gloo/utils.hpp"
+
+namespace {
+using namespace GLOO;
+
+void PutBigEndian(uint32_t value, uint8_t* out) {
+  out[0] = static_cast<uint8_t>(value >> 24);
+  out[1] = static_cast<uint8_t>(value >> 16);
+  out[2] = static_cast<uint8_t>(value >> 8);
+  out[3] = static_cast<uint8_t>(value);
+}
+
+uint32_t UpdateCrc(uint32_t crc, const uint8_t* data, size_t size) {
+  static const std::vector<uint32_t> table = []() {
+    std::vector<uint32_t> t(256);
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      t[n] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Deflate (RFC 1951) compressor in a zlib wrapper (RFC 1950) that takes its
+// input in pieces. Everything is encoded with the fixed Huffman codes, as
+// stb_image_write does, and matches are found with hash chains over the
+// last 32 KB of input, including earlier pieces.
+class DeflateStream {
+ public:
+  DeflateStream()
+      : base_(0),
+        pos_(0),
+        head_(kHashSize, -1),
+        prev_(kWindowSize, -1),
+        bit_buffer_(0),
+        bit_count_(0),
+        adler_a_(1),
+        adler_b_(0) {
+    output_.push_back(0x78);
+    output_.push_back(0x01);
+    // One long block that is not the last one, see Finish.
+    PutBits(0, 1);
+    PutBits(1, 2);
+  }
+
+  void Write(const uint8_t* data, size_t size) {
+    UpdateAdler(data, size);
+    window_.insert(window_.end(), data, data + size);
+    // The last bytes wait for more input, so that matches can reach them.
+    uint64_t end = base_ + window_.size();
+    if (end > kMaxMatch) {
+      Encode(end - kMaxMatch);
+    }
+    // Keep only what later matches can refer to.
+    uint64_t keep_from = pos_ > kWindowSize ? pos_ - kWindowSize : 0;
+    if (keep_from > base_) {
+      window_.erase(window_.begin(), window_.begin() + (keep_from - base_));
+      base_ = keep_from;
+    }
+  }
+
+  void Finish() {
+    Encode(base_ + window_.size());
+    PutSymbol(kEndOfBlock);
+    // An empty last block.
+    PutBits(1, 1);
+    PutBits(1, 2);
+    PutSymbol(kEndOfBlock);
+    if (bit_count_ > 0) {
+      PutBits(0, 8 - bit_count_);
+    }
+    uint8_t adler[4];
+    PutBigEndian((adler_b_ << 16) | adler_a_, adler);
+    output_.insert(output_.end(), adler, adler + 4);
+  }
+
+  // Compressed bytes produced so far and not yet taken.
+  std::vector<uint8_t>& GetOutput() {
+    return output_;
+  }
+
+ private:
+  static const uint64_t kWindowSize = 32768;
+  static const size_t kHashSize = 1 << 15;
+  static const size_t kMinMatch = 3;
+  static const size_t kMaxMatch = 258;
+  static const int kMaxChainLength = 32;
+  static const int kEndOfBlock = 256;
+
+  const uint8_t* At(uint64_t pos) const {
+    return &window_[pos - base_];
+  }
+
+  static size_t Hash(const uint8_t* p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (kHashSize - 1);
+  }
+
+  void Insert(uint64_t pos, uint64_t end) {
+    if (pos + kMinMatch > end) {
+      return;
+    }
+    size_t hash = Hash(At(pos));
+    prev_[pos & (kWindowSize - 1)] = head_[hash];
+    head_[hash] = static_cast<int64_t>(pos);
+  }
+
+  // Encodes the input up to, not including, position limit.
+  void Encode(uint64_t limit) {
+    uint64_t end = base_ + window_.size();
+    while (pos_ < limit) {
+      size_t max_length =
+          static_cast<size_t>(std::min<uint64_t>(end - pos_, kMaxMatch));
+      size_t best_length = 0;
+      uint64_t best_distance = 0;
+      if (max_length >= kMinMatch) {
+        const uint8_t* current = At(pos_);
+        int64_t candidate = head_[Hash(current)];
+        for (int chain = 0; chain < kMaxChainLength && candidate >= 0 &&
+                            pos_ - candidate <= kWindowSize;
+             chain++) {
+          const uint8_t* match = At(candidate);
+          size_t length = 0;
+          while (length < max_length && match[length] == current[length]) {
+            length++;
+          }
+          if (length > best_length) {
+            best_length = length;
+            best_distance = pos_ - candidate;
+            if (length == max_length) {
+              break;
+            }
+          }
+          candidate = prev_[candidate & (kWindowSize - 1)];
+        }
+      }
+      if (best_length >= kMinMatch) {
+        PutMatch(best_length, static_cast<size_t>(best_distance));
+        for (size_t i = 0; i < best_length; i++) {
+          Insert(pos_ + i, end);
+        }
+        pos_ += best_length;
+      } else {
+        PutSymbol(*At(pos_));
+        Insert(pos_, end);
+        pos_++;
+      }
+    }
+  }
+
+  void PutBits(uint32_t bits, int count) {
+    bit_buffer_ |= bits << bit_count_;
+    bit_count_ += count;
+    while (bit_count_ >= 8) {
+      output_.push_back(static_cast<uint8_t>(bit_buffer_));
+      bit_buffer_ >>= 8;
+      bit_count_ -= 8;
+    }
+  }
+
+  // Huffman codes are stored starting from their most significant bit.
+  void PutCode(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+      reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    PutBits(reversed, length);
+  }
+
+  // A literal byte, the end of a block or a length symbol (RFC 1951 3.2.6).
+  void PutSymbol(int symbol) {
+    if (symbol < 144) {
+      PutCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+      PutCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+      PutCode(symbol - 256, 7);
+    } else {
+      PutCode(0xc0 + symbol - 280, 8);
+    }
+  }
+
+  void PutMatch(size_t length, size_t distance) {
+    static const uint16_t kLengthBase[] = {
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t kLengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                           1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                           4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t kDistanceBase[] = {
+        1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+        33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t kDistanceExtra[] = {0, 0, 0,  0,  1,  1,  2,  2,
+                                             3, 3, 4,  4,  5,  5,  6,  6,
+                                             7, 7, 8,  8,  9,  9,  10, 10,
+                                             11, 11, 12, 12, 13, 13};
+    int l = 28;
+    while (kLengthBase[l] > length) {
+      l--;
+    }
+    PutSymbol(257 + l);
+    PutBits(static_cast<uint32_t>(length - kLengthBase[l]), kLengthExtra[l]);
+    int d = 29;
+    while (kDistanceBase[d] > distance) {
+      d--;
+    }
+    PutCode(d, 5);
+    PutBits(static_cast<uint32_t>(distance - kDistanceBase[d]),
+            kDistanceExtra[d]);
+  }
+
+  void UpdateAdler(const uint8_t* data, size_t size) {
+    // 5552 is the most bytes before the sums can overflow 32 bits.
+    while (size > 0) {
+      size_t n = std::min<size_t>(size, 5552);
+      for (size_t i = 0; i < n; i++) {
+        adler_a_ += data[i];
+        adler_b_ += adler_a_;
+      }
+      adler_a_ %= 65521;
+      adler_b_ %= 65521;
+      data += n;
+      size -= n;
+    }
+  }
+
+  // Input from absolute position base_ on; pos_ is the next one to encode.
+  std::vector<uint8_t> window_;
+  uint64_t base_;
+  uint64_t pos_;
+  // Most recent position per hash, and the previous one with the same hash
+  // per position modulo the window size.
+  std::vector<int64_t> head_;
+  std::vector<int64_t> prev_;
+  uint32_t bit_buffer_;
+  int bit_count_;
+  uint32_t adler_a_;
+  uint32_t adler_b_;
+  std::vector<uint8_t> output_;
+};
+
+// Rows are filtered as in stb_image_write: each row uses the PNG filter
+// whose output has the smallest sum of absolute values.
+class PngRowWriter : public ImageRowWriter {
+ public:
+  PngRowWriter(const std::string& filename,
+               size_t width,
+               size_t height,
+               bool srgb)
+      : filename_(filename),
+        width_(width),
+        height_(height),
+        srgb_(srgb),
+        rows_written_(0),
+        os_(filename, std::ios::binary),
+        previous_row_(width * 3, 0),
+        filtered_(1 + width * 3),
+        best_(1 + width * 3) {
+    if (!os_) {
+      throw std::runtime_error("Unable to write " + filename + "!");
+    }
+    static const uint8_t kSignature[] = {137, 80, 78, 71, 13, 10, 26, 10};
+    os_.write(reinterpret_cast<const char*>(kSignature), sizeof(kSignature));
+    uint8_t header[13];
+    PutBigEndian(static_cast<uint32_t>(width), header);
+    PutBigEndian(static_cast<uint32_t>(height), header + 4);
+    header[8] = 8;  // Bits per channel.
+    header[9] = 2;  // RGB.
+    header[10] = header[11] = header[12] = 0;
+    WriteChunk("IHDR", header, sizeof(header));
+  }
+
+  void WriteRows(const Image& image) override {
+    std::vector<uint8_t> rows = image.ToByteData(srgb_);
+    size_t count = image.GetHeight();
+    size_t stride = width_ * 3;
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t* row = &rows[i * stride];
+      FilterRow(row);
+      deflate_.Write(best_.data(), best_.size());
+      std::copy(row, row + stride, previous_row_.begin());
+    }
+    rows_written_ += count;
+    std::vector<uint8_t>& output = deflate_.GetOutput();
+    if (output.size() >= kChunkSize) {
+      WriteChunk("IDAT", output.data(), output.size());
+      output.clear();
+    }
+  }
+
+  void Finish() override {
+    if (rows_written_ != height_) {
+      throw std::runtime_error("Wrong number of rows for " + filename_ + "!");
+    }
+    deflate_.Finish();
+    std::vector<uint8_t>& output = deflate_.GetOutput();
+    WriteChunk("IDAT", output.data(), output.size());
+    output.clear();
+    WriteChunk("IEND", nullptr, 0);
+    os_.close();
+    if (os_.fail()) {
+      throw std::runtime_error("Unable to write " + filename_ + "!");
+    }
+  }
+
+ private:
+  static const size_t kChunkSize = 1 << 16;
+
+  void WriteChunk(const char* type, const uint8_t* data, size_t size) {
+    uint8_t length[4];
+    PutBigEndian(static_cast<uint32_t>(size), length);
+    os_.write(reinterpret_cast<const char*>(length), 4);
+    uint32_t crc = UpdateCrc(0, reinterpret_cast<const uint8_t*>(type), 4);
+    crc = UpdateCrc(crc, data, size);
+    os_.write(type, 4);
+    os_.write(reinterpret_cast<const char*>(data), size);
+    uint8_t crc_bytes[4];
+    PutBigEndian(crc, crc_bytes);
+    os_.write(reinterpret_cast<const char*>(crc_bytes), 4);
+  }
+
+  static int Paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+      return a;
+    }
+    return pb <= pc ? b : c;
+  }
+
+  // Leaves the filtered row, led by its filter type, in best_.
+  void FilterRow(const uint8_t* row) {
+    size_t stride = width_ * 3;
+    const uint8_t* up = previous_row_.data();
+    int best_sum = -1;
+    for (int type = 0; type < 5; type++) {
+      filtered_[0] = static_cast<uint8_t>(type);
+      int sum = 0;
+      for (size_t i = 0; i < stride; i++) {
+        int left = i >= 3 ? row[i - 3] : 0;
+        int up_left = i >= 3 ? up[i - 3] : 0;
+        int predicted;
+        switch (type) {
+          case 0:
+            predicted = 0;
+            break;
+          case 1:
+            predicted = left;
+            break;
+          case 2:
+            predicted = up[i];
+            break;
+          case 3:
+            predicted = (left + up[i]) >> 1;
+            break;
+          default:
+            predicted = Paeth(left, up[i], up_left);
+            break;
+        }
+        uint8_t value = static_cast<uint8_t>(row[i] - predicted);
+        filtered_[1 + i] = value;
+        sum += std::abs(static_cast<int8_t>(value));
+      }
+      if (best_sum < 0 || sum < best_sum) {
+        best_sum = sum;
+        best_.swap(filtered_);
+      }
+    }
+  }
+
+  std::string filename_;
+  size_t width_;
+  size_t height_;
+  bool srgb_;
+  size_t rows_written_;
+  std::ofstream os_;
+  DeflateStream deflate_;
+  std::vector<uint8_t> previous_row_;
+  std::vector<uint8_t> filtered_;
+  std::vector<uint8_t> best_;
+};
+
+// Binary PPM (P6), which stores the rows as they are.
+class PpmRowWriter : public ImageRowWriter {
+ public:
+  PpmRowWriter(const std::string& filename,
+               size_t width,
+               size_t height,
+               bool srgb)
+      : filename_(filename),
+        width_(width),
+        height_(height),
+        srgb_(srgb),
+        rows_written_(0),
+        os_(filename, std::ios::binary) {
+    if (!os_) {
+      throw std::runtime_error("Unable to write " + filename + "!");
+    }
+    os_ << "P6\n" << width << " " << height << "\n255\n";
+  }
+
+  void WriteRows(const Image& image) override {
+    std::vector<uint8_t> rows = image.ToByteData(srgb_);
+    os_.write(reinterpret_cast<const char*>(rows.data()), rows.size());
+    rows_written_ += image.GetHeight();
+  }
+
+  void Finish() override {
+    if (rows_written_ != height_) {
+      throw std::runtime_error("Wrong number of rows for " + filename_ + "!");
+    }
+    os_.close();
+    if (os_.fail()) {
+      throw std::runtime_error("Unable to write " + filename_ + "!");
+    }
+  }
+
+ private:
+  std::string filename_;
+  size_t width_;
+  size_t height_;
+  bool srgb_;
+  size_t rows_written_;
+  std::ofstream os_;
+};
+
+// Portable Float Map, which stores the rows from the bottom up: the rows
+// are placed from the end of the file toward its header.
+class PfmRowWriter : public ImageRowWriter {
+ public:
+  PfmRowWriter(const std::string& filename, size_t width, size_t height)
+      : filename_(filename),
+        width_(width),
+        height_(height),
+        rows_written_(0),
+        os_(filename, std::ios::binary) {
+    if (!os_) {
+      throw std::runtime_error("Unable to write " + filename + "!");
+    }
+    // A negative scale marks little-endian values.
+    const uint16_t one = 1;
+    bool little_endian = *reinterpret_cast<const uint8_t*>(&one) == 1;
+    os_ << "PF\n"
+        << width << " " << height << "\n"
+        << (little_endian ? "-1.0" : "1.0") << "\n";
+    data_offset_ = static_cast<size_t>(os_.tellp());
+  }
+
+  void WriteRows(const Image& image) override {
+    size_t count = image.GetHeight();
+    if (rows_written_ + count > height_) {
+      throw std::runtime_error("Too many rows for " + filename_ + "!");
+    }
+    // Top-down rows, reversed to go bottom up in the file.
+    std::vector<float> rows = image.ToFloatData();
+    size_t stride = width_ * 3;
+    std::vector<float> reversed(rows.size());
+    for (size_t i = 0; i < count; i++) {
+      std::copy(rows.begin() + i * stride, rows.begin() + (i + 1) * stride,
+                reversed.begin() + (count - 1 - i) * stride);
+    }
+    size_t first_row = height_ - rows_written_ - count;
+    os_.seekp(data_offset_ + first_row * stride * sizeof(float));
+    os_.write(reinterpret_cast<const char*>(reversed.data()),
+              reversed.size() * sizeof(float));
+    rows_written_ += count;
+  }
+
+  void Finish() override {
+    if (rows_written_ != height_) {
+      throw std::runtime_error("Wrong number of rows for " + filename_ + "!");
+    }
+    os_.close();
+    if (os_.fail()) {
+      throw std::runtime_error("Unable to write " + filename_ + "!");
+    }
+  }
+
+ private:
+  std::string filename_;
+  size_t width_;
+  size_t height_;
+  size_t rows_written_;
+  size_t data_offset_;
+  std::ofstream os_;
+};
+}  // namespace
+
+namespace GLOO {
+std::unique_ptr<ImageRowWriter> ImageRowWriter::Create(
+    const std::string& filename,
+    size_t width,
+    size_t height,
+    bool srgb) {
+  if (HasExtension(filename, ".pfm")) {
+    return make_unique<PfmRowWriter>(filename, width, height);
+  }
+  if (HasExtension(filename, ".ppm")) {
+    return make_unique<PpmRowWriter>(filename, width, height, srgb);
+  }
+  return make_unique<PngRowWriter>(filename, width, height, srgb);
+}
+}  // namespace GLOO
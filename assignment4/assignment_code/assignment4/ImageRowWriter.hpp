@@ -0,0 +1,37 @@
+#ifndef IMAGE_ROW_WRITER_H_
+#define IMAGE_ROW_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "gloo/Image.hpp"
+
+namespace GLOO {
+// Writes an image to a file a few rows at a time, from the top row down, so
+// that the image never has to be held in memory as a whole.
+class ImageRowWriter {
+ public:
+  virtual ~ImageRowWriter() {
+  }
+
+  // A float PFM writer for .pfm files, an 8-bit binary PPM writer for .ppm
+  // files and an 8-bit PNG writer for anything else. 8-bit values are
+  // converted as by Image::ToByteData(srgb). Throws if the file cannot be
+  // created.
+  static std::unique_ptr<ImageRowWriter> Create(const std::string& filename,
+                                                size_t width,
+                                                size_t height,
+                                                bool srgb = false);
+
+  // Writes all rows of the image, which continue the output downward: its
+  // top row (the largest y) comes right after the rows written so far.
+  virtual void WriteRows(const Image& rows) = 0;
+  // Completes the file once every row has been written. Throws if the
+  // rows do not add up to the image height or the file cannot be written.
+  virtual void Finish() = 0;
+};
+}  // namespace GLOO
+
+#endif
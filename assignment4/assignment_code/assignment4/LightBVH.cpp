@@ -0,0 +1,123 @@
+#include "LightBVH.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Leaves hold at most this many lights.
+static const size_t kMaxLeafSize = 4;
+}  // namespace
+
+namespace GLOO {
+void LightBVH::Build(const std::vector<CompiledLight>& lights,
+                     float threshold) {
+  bounded_.clear();
+  unbounded_.clear();
+  nodes_.clear();
+
+  for (size_t i = 0; i < lights.size(); i++) {
+    LightInstance light;
+    light.index = static_cast<uint32_t>(i);
+    light.is_point = false;
+    light.power = 0.0f;
+    light.radius = std::numeric_limits<float>::infinity();
+    if (lights[i].type == LightType::Point) {
+      // Same position and falloff as CompiledScene::GetIllumination.
+      light.is_point = true;
+      light.position = lights[i].position;
+      glm::vec3 color = lights[i].color;
+      float alpha = lights[i].attenuation;
+      light.power = std::max(color.x, std::max(color.y, color.z)) / alpha;
+      if (threshold > 0.0f && alpha > 0.0f) {
+        light.radius = std::sqrt(std::max(0.0f, light.power) / threshold);
+      }
+    }
+    if (std::isfinite(light.radius)) {
+      bounded_.push_back(light);
+    } else {
+      unbounded_.push_back(light);
+    }
+  }
+
+  if (!bounded_.empty()) {
+    nodes_.reserve(2 * bounded_.size());
+    BuildNode(0, bounded_.size());
+  }
+}
+
+uint32_t LightBVH::BuildNode(size_t begin, size_t end) {
+  uint32_t index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+
+  AABB bbox = AABB::Empty();
+  AABB center_bbox = AABB::Empty();
+  for (size_t i = begin; i < end; i++) {
+    glm::vec3 r(bounded_[i].radius);
+    bbox.UnionWith(AABB(bounded_[i].position - r, bounded_[i].position + r));
+    center_bbox.UnionWith(bounded_[i].position);
+  }
+  nodes_[index].bbox = bbox;
+
+  if (end - begin <= kMaxLeafSize) {
+    nodes_[index].offset = static_cast<uint32_t>(begin);
+    nodes_[index].count = static_cast<uint32_t>(end - begin);
+    return index;
+  }
+
+  // Median split along the axis with the widest spread of light positions.
+  glm::vec3 extent = center_bbox.mx - center_bbox.mn;
+  int axis = 0;
+  if (extent[1] > extent[axis])
+    axis = 1;
+  if (extent[2] > extent[axis])
+    axis = 2;
+  size_t mid = (begin + end) / 2;
+  std::nth_element(bounded_.begin() + begin, bounded_.begin() + mid,
+                   bounded_.begin() + end,
+                   [axis](const LightInstance& a, const LightInstance& b) {
+                     return a.position[axis] < b.position[axis];
+                   });
+
+  BuildNode(begin, mid);
+  uint32_t right = BuildNode(mid, end);
+  nodes_[index].offset = right;
+  nodes_[index].count = 0;
+  return index;
+}
+
+void LightBVH::Query(const glm::vec3& position,
+                     std::vector<const LightInstance*>& candidates) const {
+  for (const LightInstance& light : unbounded_) {
+    candidates.push_back(&light);
+  }
+  if (nodes_.empty()) {
+    return;
+  }
+
+  uint32_t stack[64];
+  size_t stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    const Node& node = nodes_[stack[--stack_size]];
+    const AABB& bbox = node.bbox;
+    if (position.x < bbox.mn.x || position.y < bbox.mn.y ||
+        position.z < bbox.mn.z || position.x > bbox.mx.x ||
+        position.y > bbox.mx.y || position.z > bbox.mx.z) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        const LightInstance& light = bounded_[i];
+        glm::vec3 d = position - light.position;
+        if (glm::dot(d, d) <= light.radius * light.radius) {
+          candidates.push_back(&light);
+        }
+      }
+      continue;
+    }
+    stack[stack_size++] = node.offset;
+    stack[stack_size++] = static_cast<uint32_t>(&node - nodes_.data()) + 1;
+  }
+}
+}  // namespace GLOO
@@ -0,0 +1,67 @@
+#ifndef LIGHT_BVH_H_
+#define LIGHT_BVH_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AABB.hpp"
+#include "CompiledScene.hpp"
+
+namespace GLOO {
+// A light resolved once per render. Point lights have an intensity of
+// power / d^2 at distance d, which falls below the culling threshold past
+// radius; other lights reach everywhere.
+struct LightInstance {
+  // Index of the light in the list passed to LightBVH::Build.
+  uint32_t index;
+  bool is_point;
+  glm::vec3 position;
+  // Largest channel of color / constant attenuation.
+  float power;
+  float radius;
+};
+
+// BVH over the spheres of influence of the scene's point lights, so a hit
+// point only visits the lights that reach it with at least the threshold
+// intensity in some channel. Lights without a finite radius are kept in a
+// separate list that every query returns.
+class LightBVH {
+ public:
+  // A threshold of 0 culls nothing.
+  void Build(const std::vector<CompiledLight>& lights, float threshold);
+
+  // Appends the lights that may reach position to candidates: every light
+  // without a finite radius, then the point lights whose sphere of
+  // influence contains it, in no particular order.
+  void Query(const glm::vec3& position,
+             std::vector<const LightInstance*>& candidates) const;
+
+  size_t GetLightCount() const {
+    return bounded_.size() + unbounded_.size();
+  }
+  // Point lights with a finite sphere of influence.
+  size_t GetBoundedLightCount() const {
+    return bounded_.size();
+  }
+
+ private:
+  // Same layout as SceneBVH: depth-first order, an interior node's left
+  // child directly follows it and offset points at the right child. A leaf
+  // covers bounded_[offset, offset + count).
+  struct Node {
+    AABB bbox;
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  uint32_t BuildNode(size_t begin, size_t end);
+
+  std::vector<LightInstance> bounded_;
+  std::vector<LightInstance> unbounded_;
+  std::vector<Node> nodes_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef MESH_ACCELERATOR_H_
+#define MESH_ACCELERATOR_H_
+
+#include <ostream>
+
+#include "AABB.hpp"
+#include "BinaryIO.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "HitRecord.hpp"
+
+namespace GLOO {
+// Forward declarations.
+class Mesh;
+
+struct AcceleratorStats {
+  AcceleratorStats()
+      : build_ms(0.0),
+        load_ms(0.0),
+        node_count(0),
+        leaf_count(0),
+        triangle_count(0),
+        triangle_refs(0),
+        max_depth(0) {
+  }
+
+  // Time of the last build or refit, and of loading a saved structure
+  // instead; only one of them is set.
+  double build_ms;
+  double load_ms;
+  size_t node_count;
+  size_t leaf_count;
+  size_t triangle_count;
+  // Sum of leaf sizes; exceeds triangle_count when triangles are duplicated.
+  size_t triangle_refs;
+  size_t max_depth;
+};
+
+inline std::ostream& operator<<(std::ostream& os,
+                                const AcceleratorStats& stats) {
+  os << stats.node_count << " nodes, " << stats.leaf_count << " leaves, "
+     << stats.triangle_refs << " triangle refs for " << stats.triangle_count
+     << " triangles, max depth " << stats.max_depth;
+  if (stats.load_ms > 0.0) {
+    os << ", loaded in " << stats.load_ms << " ms";
+  } else {
+    os << ", built in " << stats.build_ms << " ms";
+  }
+  return os;
+}
+
+// Acceleration structure over the triangles of a single Mesh.
+class MeshAccelerator {
+ public:
+  virtual ~MeshAccelerator() {
+  }
+  virtual const char* GetName() const = 0;
+  virtual void Build(const Mesh& mesh) = 0;
+  // Writes the built structure. Load restores it in place of Build, for the
+  // same mesh and options; data derived from the mesh is rebuilt.
+  virtual void Save(BinaryWriter& writer) const = 0;
+  virtual void Load(const Mesh& mesh, BinaryReader& reader) = 0;
+  // Updates the structure in place after the mesh's vertices moved, keeping
+  // its topology. Returns false if the mesh must be built again instead:
+  // when the structure cannot be refit, or when refitting made its SAH cost
+  // more than max_cost_ratio times that of its last build.
+  virtual bool Refit(const Mesh& mesh, float max_cost_ratio) {
+    return false;
+  }
+  // Closest hit in the mesh's local space.
+  virtual bool Intersect(const Ray& ray,
+                         float t_min,
+                         HitRecord& record) const = 0;
+  // Closest hits for the active rays of a packet, as in
+  // HittableBase::IntersectPacket.
+  virtual uint64_t IntersectPacket(const RayPacket& packet,
+                                   uint64_t active,
+                                   float t_min,
+                                   HitRecord* records) const = 0;
+  // Any-hit query in [t_min, t_max), as in HittableBase::Occluded.
+  virtual bool Occluded(const Ray& ray, float t_min, float t_max) const = 0;
+  // Packet version of Occluded. By default the rays are tested one at a
+  // time, which already stops each of them at its first occluder.
+  virtual uint64_t OccludedPacket(const RayPacket& packet,
+                                  uint64_t active,
+                                  float t_min,
+                                  const float* t_max) const {
+    uint64_t occluded = 0;
+    for (size_t i = 0; i < packet.GetSize(); i++) {
+      if (((active >> i) & 1) && Occluded(packet.GetRay(i), t_min, t_max[i]))
+        occluded |= uint64_t(1) << i;
+    }
+    return occluded;
+  }
+  virtual const AABB& GetBounds() const = 0;
+  // Everything except build_ms and load_ms, which are measured by the
+  // caller.
+  virtual AcceleratorStats GetStats() const = 0;
+};
+}  // namespace GLOO
+
+#endif
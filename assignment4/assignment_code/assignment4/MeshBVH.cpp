@@ -0,0 +1,494 @@
+#include "MeshBVH.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "hittable/Mesh.hpp"
+#include "RenderStats.hpp"
+
+namespace {
+static const int kNumBins = 16;
+// Ranges of at most this many triangles may become leaves when the SAH says
+// splitting does not pay off. Larger ranges are always split if possible.
+static const size_t kMaxLeafSize = 8;
+// Cost of visiting a node relative to one ray-triangle test.
+static const float kTraversalCost = 1.0f;
+// Keeps the traversal stack bounded on degenerate input.
+static const size_t kMaxDepth = 60;
+}  // namespace
+
+namespace GLOO {
+MeshBVH::MeshBVH(const AcceleratorOptions& options)
+    : max_leaf_size_(options.max_leaf_size ? options.max_leaf_size
+                                           : kMaxLeafSize),
+      use_simd_(options.simd),
+      mesh_(nullptr),
+      max_depth_(0),
+      build_cost_(0.0f) {
+}
+
+void MeshBVH::Build(const Mesh& mesh) {
+  mesh_ = &mesh;
+  nodes_.clear();
+  indices_.clear();
+  max_depth_ = 0;
+
+  // Bounds and centroids are computed once, up front.
+  size_t num_triangles = mesh.GetTriangleCount();
+  std::vector<BuildItem> items(num_triangles);
+  indices_.resize(num_triangles);
+  for (size_t i = 0; i < num_triangles; i++) {
+    items[i].bbox = mesh.GetTriangleBounds(static_cast<uint32_t>(i));
+    items[i].centroid = items[i].bbox.GetCenter();
+    indices_[i] = static_cast<uint32_t>(i);
+  }
+
+  BuildNode(items, 0, num_triangles, 0);
+  build_cost_ = GetSahCost();
+  if (use_simd_) {
+    PadLeaves();
+    blocks_.Build(mesh, indices_);
+  } else {
+    blocks_.Clear();
+  }
+}
+
+void MeshBVH::Save(BinaryWriter& writer) const {
+  writer.Write<uint64_t>(max_depth_);
+  writer.WriteArray(nodes_);
+  writer.WriteArray(indices_);
+}
+
+void MeshBVH::Load(const Mesh& mesh, BinaryReader& reader) {
+  mesh_ = &mesh;
+  max_depth_ = reader.Read<uint64_t>();
+  reader.ReadArray(nodes_);
+  reader.ReadArray(indices_);
+  if (nodes_.empty()) {
+    throw std::runtime_error("Empty BVH!");
+  }
+  CheckLoaded(mesh);
+  build_cost_ = GetSahCost();
+  if (use_simd_) {
+    blocks_.Build(mesh, indices_);
+  } else {
+    blocks_.Clear();
+  }
+}
+
+bool MeshBVH::Refit(const Mesh& mesh, float max_cost_ratio) {
+  if (nodes_.empty()) {
+    return false;
+  }
+  mesh_ = &mesh;
+  // Children come after their parent, so a backward sweep sees them first.
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    Node& node = nodes_[i];
+    if (node.count > 0) {
+      node.bbox = AABB::Empty();
+      for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+        node.bbox.UnionWith(mesh.GetTriangleBounds(indices_[k]));
+      }
+    } else {
+      node.bbox = nodes_[i + 1].bbox;
+      node.bbox.UnionWith(nodes_[node.offset].bbox);
+    }
+  }
+  if (use_simd_) {
+    blocks_.Build(mesh, indices_);
+  }
+  return GetSahCost() <= max_cost_ratio * build_cost_;
+}
+
+void MeshBVH::CheckLoaded(const Mesh& mesh) {
+  size_t num_triangles = mesh.GetTriangleCount();
+  for (uint32_t index : indices_) {
+    if (index >= num_triangles && index != TriangleBlocks::kInvalidTriangle) {
+      throw std::runtime_error("BVH does not match the mesh!");
+    }
+  }
+  // Children follow their parent, so depths are known in node order.
+  std::vector<size_t> depths(nodes_.size(), 0);
+  max_depth_ = 0;
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    const Node& node = nodes_[i];
+    if (depths[i] > kMaxDepth) {
+      throw std::runtime_error("BVH is too deep!");
+    }
+    max_depth_ = std::max(max_depth_, depths[i]);
+    if (node.count > 0) {
+      if (uint64_t(node.offset) + node.count > indices_.size()) {
+        throw std::runtime_error("BVH leaf out of range!");
+      }
+      for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+        if (indices_[k] >= num_triangles) {
+          throw std::runtime_error("BVH does not match the mesh!");
+        }
+      }
+      continue;
+    }
+    if (i + 1 >= nodes_.size() || node.offset <= i + 1 ||
+        node.offset >= nodes_.size()) {
+      throw std::runtime_error("BVH child out of range!");
+    }
+    depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+    depths[node.offset] = std::max(depths[node.offset], depths[i] + 1);
+  }
+}
+
+void MeshBVH::PadLeaves() {
+  std::vector<uint32_t> padded;
+  padded.reserve(indices_.size() + nodes_.size() * TriangleBlocks::kWidth);
+  for (Node& node : nodes_) {
+    if (node.count == 0) {
+      continue;
+    }
+    uint32_t offset = static_cast<uint32_t>(padded.size());
+    padded.insert(padded.end(), indices_.begin() + node.offset,
+                  indices_.begin() + node.offset + node.count);
+    TriangleBlocks::PadToBlock(padded);
+    node.offset = offset;
+  }
+  indices_.swap(padded);
+}
+
+uint32_t MeshBVH::BuildNode(std::vector<BuildItem>& items,
+                            size_t begin,
+                            size_t end,
+                            size_t depth) {
+  uint32_t index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+  max_depth_ = std::max(max_depth_, depth);
+
+  AABB bbox = AABB::Empty();
+  AABB centroid_bbox = AABB::Empty();
+  for (size_t i = begin; i < end; i++) {
+    const BuildItem& item = items[indices_[i]];
+    bbox.UnionWith(item.bbox);
+    centroid_bbox.UnionWith(item.centroid);
+  }
+  nodes_[index].bbox = bbox;
+
+  size_t count = end - begin;
+  int best_axis = -1;
+  int best_bin = 0;
+  float best_cost = std::numeric_limits<float>::max();
+  if (count > 1 && depth < kMaxDepth) {
+    for (int axis = 0; axis < 3; axis++) {
+      float extent = centroid_bbox.mx[axis] - centroid_bbox.mn[axis];
+      if (extent <= 0.0f) {
+        continue;
+      }
+      float scale = kNumBins / extent;
+
+      AABB bin_bbox[kNumBins];
+      size_t bin_count[kNumBins] = {0};
+      for (int b = 0; b < kNumBins; b++) {
+        bin_bbox[b] = AABB::Empty();
+      }
+      for (size_t i = begin; i < end; i++) {
+        const BuildItem& item = items[indices_[i]];
+        int b = std::min(
+            kNumBins - 1,
+            static_cast<int>((item.centroid[axis] - centroid_bbox.mn[axis]) *
+                             scale));
+        bin_count[b]++;
+        bin_bbox[b].UnionWith(item.bbox);
+      }
+
+      // Sweep from the right to get the cost of everything above each plane.
+      float right_cost[kNumBins];
+      AABB right_bbox = AABB::Empty();
+      size_t right_count = 0;
+      for (int b = kNumBins - 1; b > 0; b--) {
+        right_bbox.UnionWith(bin_bbox[b]);
+        right_count += bin_count[b];
+        right_cost[b] = right_count == 0
+                            ? 0.0f
+                            : right_count * right_bbox.GetSurfaceArea();
+      }
+      AABB left_bbox = AABB::Empty();
+      size_t left_count = 0;
+      for (int b = 0; b < kNumBins - 1; b++) {
+        left_bbox.UnionWith(bin_bbox[b]);
+        left_count += bin_count[b];
+        if (left_count == 0 || left_count == count) {
+          continue;
+        }
+        float cost = left_count * left_bbox.GetSurfaceArea() + right_cost[b + 1];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+        }
+      }
+    }
+  }
+
+  // Compare in units of the parent's surface area.
+  float leaf_cost = count * bbox.GetSurfaceArea();
+  float split_cost = kTraversalCost * bbox.GetSurfaceArea() + best_cost;
+  if (best_axis < 0 || (count <= max_leaf_size_ && split_cost >= leaf_cost)) {
+    nodes_[index].offset = static_cast<uint32_t>(begin);
+    nodes_[index].count = static_cast<uint32_t>(count);
+    return index;
+  }
+
+  float mn = centroid_bbox.mn[best_axis];
+  float scale = kNumBins / (centroid_bbox.mx[best_axis] - mn);
+  auto mid_itr = std::partition(
+      indices_.begin() + begin, indices_.begin() + end, [&](uint32_t t) {
+        int b = std::min(
+            kNumBins - 1,
+            static_cast<int>((items[t].centroid[best_axis] - mn) * scale));
+        return b <= best_bin;
+      });
+  size_t mid = mid_itr - indices_.begin();
+
+  BuildNode(items, begin, mid, depth + 1);
+  uint32_t right = BuildNode(items, mid, end, depth + 1);
+  nodes_[index].offset = right;
+  nodes_[index].count = 0;
+  return index;
+}
+
+bool MeshBVH::Intersect(const Ray& ray,
+                        float t_min,
+                        HitRecord& record) const {
+  const glm::vec3& origin = ray.GetOrigin();
+  glm::vec3 inv_direction = glm::vec3(1.0f) / ray.GetDirection();
+  bool intersected = false;
+
+  uint32_t stack[kMaxDepth + 4];
+  size_t stack_size = 0;
+  RenderCounters& counters = RenderCounters::Local();
+  float t_entry;
+  if (nodes_[0].bbox.Intersect(origin, inv_direction, t_min, record.time,
+                               t_entry)) {
+    stack[stack_size++] = 0;
+  }
+  while (stack_size > 0) {
+    uint32_t node_index = stack[--stack_size];
+    counters.node_visits++;
+    const Node& node = nodes_[node_index];
+    if (node.count > 0) {
+      intersected |= IntersectLeaf(node, ray, t_min, record);
+      continue;
+    }
+    uint32_t left = node_index + 1;
+    uint32_t right = node.offset;
+    float t_left, t_right;
+    bool hit_left = nodes_[left].bbox.Intersect(origin, inv_direction, t_min,
+                                                record.time, t_left);
+    bool hit_right = nodes_[right].bbox.Intersect(origin, inv_direction, t_min,
+                                                  record.time, t_right);
+    if (hit_left && hit_right) {
+      // Push the farther child first so the nearer one is visited first.
+      if (t_left < t_right) {
+        stack[stack_size++] = right;
+        stack[stack_size++] = left;
+      } else {
+        stack[stack_size++] = left;
+        stack[stack_size++] = right;
+      }
+    } else if (hit_left) {
+      stack[stack_size++] = left;
+    } else if (hit_right) {
+      stack[stack_size++] = right;
+    }
+  }
+  return intersected;
+}
+
+uint64_t MeshBVH::IntersectPacket(const RayPacket& packet,
+                                  uint64_t active,
+                                  float t_min,
+                                  HitRecord* records) const {
+  // Each entry carries the rays that reached its parent.
+  struct StackEntry {
+    uint32_t node_index;
+    uint64_t mask;
+  };
+  uint64_t hits = 0;
+  StackEntry stack[kMaxDepth + 4];
+  size_t stack_size = 0;
+  RenderCounters& counters = RenderCounters::Local();
+  stack[stack_size++] = {0, active};
+  while (stack_size > 0) {
+    StackEntry entry = stack[--stack_size];
+    counters.node_visits++;
+    uint32_t node_index = entry.node_index;
+    const Node& node = nodes_[node_index];
+    // Rays whose closest hit so far lies in front of the box drop out here.
+    uint64_t mask =
+        packet.IntersectBox(node.bbox, entry.mask, t_min, records);
+    if (mask == 0) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint64_t rest = mask; rest != 0; rest &= rest - 1) {
+        size_t i = LowestBit(rest);
+        if (IntersectLeaf(node, packet.GetRay(i), t_min, records[i])) {
+          hits |= uint64_t(1) << i;
+        }
+      }
+      continue;
+    }
+    // The first ray that reaches this node decides which child is nearer.
+    uint32_t left = node_index + 1;
+    uint32_t right = node.offset;
+    Ray ray = packet.GetRay(LowestBit(mask));
+    glm::vec3 inv_direction = glm::vec3(1.0f) / ray.GetDirection();
+    float t_left, t_right;
+    bool hit_left = nodes_[left].bbox.Intersect(
+        ray.GetOrigin(), inv_direction, t_min,
+        std::numeric_limits<float>::max(), t_left);
+    bool hit_right = nodes_[right].bbox.Intersect(
+        ray.GetOrigin(), inv_direction, t_min,
+        std::numeric_limits<float>::max(), t_right);
+    if (hit_left && (!hit_right || t_left < t_right)) {
+      stack[stack_size++] = {right, mask};
+      stack[stack_size++] = {left, mask};
+    } else {
+      stack[stack_size++] = {left, mask};
+      stack[stack_size++] = {right, mask};
+    }
+  }
+  return hits;
+}
+
+bool MeshBVH::Occluded(const Ray& ray, float t_min, float t_max) const {
+  const glm::vec3& origin = ray.GetOrigin();
+  glm::vec3 inv_direction = glm::vec3(1.0f) / ray.GetDirection();
+
+  // Any occluder will do, so children are visited in plain order.
+  uint32_t stack[kMaxDepth + 4];
+  size_t stack_size = 0;
+  RenderCounters& counters = RenderCounters::Local();
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    uint32_t node_index = stack[--stack_size];
+    counters.node_visits++;
+    const Node& node = nodes_[node_index];
+    float t_entry;
+    if (!node.bbox.Intersect(origin, inv_direction, t_min, t_max, t_entry)) {
+      continue;
+    }
+    if (node.count > 0) {
+      if (OccludedLeaf(node, ray, t_min, t_max)) {
+        return true;
+      }
+      continue;
+    }
+    stack[stack_size++] = node.offset;
+    stack[stack_size++] = node_index + 1;
+  }
+  return false;
+}
+
+uint64_t MeshBVH::OccludedPacket(const RayPacket& packet,
+                                 uint64_t active,
+                                 float t_min,
+                                 const float* t_max) const {
+  // IntersectBox reads each ray's interval end from a record.
+  HitRecord limits[RayPacket::kMaxSize];
+  for (size_t i = 0; i < packet.GetSize(); i++) {
+    limits[i].time = t_max[i];
+  }
+
+  struct StackEntry {
+    uint32_t node_index;
+    uint64_t mask;
+  };
+  uint64_t occluded = 0;
+  StackEntry stack[kMaxDepth + 4];
+  size_t stack_size = 0;
+  RenderCounters& counters = RenderCounters::Local();
+  stack[stack_size++] = {0, active};
+  while (stack_size > 0) {
+    StackEntry entry = stack[--stack_size];
+    counters.node_visits++;
+    const Node& node = nodes_[entry.node_index];
+    // Rays already known to be occluded drop out.
+    uint64_t mask =
+        packet.IntersectBox(node.bbox, entry.mask & ~occluded, t_min, limits);
+    if (mask == 0) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint64_t rest = mask; rest != 0; rest &= rest - 1) {
+        size_t i = LowestBit(rest);
+        if (OccludedLeaf(node, packet.GetRay(i), t_min, t_max[i])) {
+          occluded |= uint64_t(1) << i;
+        }
+      }
+      continue;
+    }
+    stack[stack_size++] = {node.offset, mask};
+    stack[stack_size++] = {entry.node_index + 1, mask};
+  }
+  return occluded;
+}
+
+bool MeshBVH::OccludedLeaf(const Node& node,
+                           const Ray& ray,
+                           float t_min,
+                           float t_max) const {
+  if (use_simd_) {
+    return blocks_.Occluded(node.offset, node.count, ray, t_min, t_max);
+  }
+  for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+    if (mesh_->OccludedByTriangle(indices_[i], ray, t_min, t_max)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MeshBVH::IntersectLeaf(const Node& node,
+                            const Ray& ray,
+                            float t_min,
+                            HitRecord& record) const {
+  if (use_simd_) {
+    return blocks_.Intersect(node.offset, node.count, ray, t_min, record);
+  }
+  bool intersected = false;
+  for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+    intersected |= mesh_->IntersectTriangle(indices_[i], ray, t_min, record);
+  }
+  return intersected;
+}
+
+AcceleratorStats MeshBVH::GetStats() const {
+  AcceleratorStats stats;
+  stats.node_count = nodes_.size();
+  stats.triangle_count = mesh_->GetTriangleCount();
+  stats.max_depth = max_depth_;
+  for (const Node& node : nodes_) {
+    if (node.count > 0) {
+      stats.leaf_count++;
+      stats.triangle_refs += node.count;
+    }
+  }
+  return stats;
+}
+
+float MeshBVH::GetSahCost() const {
+  if (nodes_.empty()) {
+    return 0.0f;
+  }
+  float root_area = nodes_[0].bbox.GetSurfaceArea();
+  if (!(root_area > 0.0f)) {
+    return 0.0f;
+  }
+  // Same costs as the build: kTraversalCost per interior node, one per
+  // triangle of a leaf.
+  float cost = 0.0f;
+  for (const Node& node : nodes_) {
+    cost += node.bbox.GetSurfaceArea() *
+            (node.count > 0 ? float(node.count) : kTraversalCost);
+  }
+  return cost / root_area;
+}
+}  // namespace GLOO
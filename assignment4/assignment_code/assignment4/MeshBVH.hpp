@@ -0,0 +1,91 @@
+#ifndef MESH_BVH_H_
+#define MESH_BVH_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "AABB.hpp"
+#include "AcceleratorType.hpp"
+#include "MeshAccelerator.hpp"
+#include "TriangleBlocks.hpp"
+
+namespace GLOO {
+// Bounding volume hierarchy built with the binned surface area heuristic.
+// Unlike the octree every triangle is referenced by exactly one leaf.
+class MeshBVH : public MeshAccelerator {
+ public:
+  explicit MeshBVH(const AcceleratorOptions& options = AcceleratorOptions());
+  const char* GetName() const override {
+    return "bvh";
+  }
+  void Build(const Mesh& mesh) override;
+  void Save(BinaryWriter& writer) const override;
+  void Load(const Mesh& mesh, BinaryReader& reader) override;
+  // Recomputes the node bounds bottom-up, keeping the tree.
+  bool Refit(const Mesh& mesh, float max_cost_ratio) override;
+  bool Intersect(const Ray& ray,
+                 float t_min,
+                 HitRecord& record) const override;
+  uint64_t IntersectPacket(const RayPacket& packet,
+                           uint64_t active,
+                           float t_min,
+                           HitRecord* records) const override;
+  bool Occluded(const Ray& ray, float t_min, float t_max) const override;
+  uint64_t OccludedPacket(const RayPacket& packet,
+                          uint64_t active,
+                          float t_min,
+                          const float* t_max) const override;
+  const AABB& GetBounds() const override {
+    return nodes_[0].bbox;
+  }
+  AcceleratorStats GetStats() const override;
+  // Expected cost of a ray that hits the root, in ray-triangle tests: every
+  // node weighted by its surface area relative to the root's.
+  float GetSahCost() const;
+
+ private:
+  // Depth-first layout: an interior node's left child directly follows it
+  // and offset points at the right child. A leaf covers
+  // indices_[offset, offset + count). With the SIMD kernel the leaves are
+  // laid out again after the build so each starts on a block boundary.
+  struct Node {
+    AABB bbox;
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  struct BuildItem {
+    AABB bbox;
+    glm::vec3 centroid;
+  };
+
+  uint32_t BuildNode(std::vector<BuildItem>& items,
+                     size_t begin,
+                     size_t end,
+                     size_t depth);
+  // Throws unless the loaded nodes and indices form a tree over the mesh's
+  // triangles that traversal can walk without leaving the arrays.
+  void CheckLoaded(const Mesh& mesh);
+  void PadLeaves();
+  bool IntersectLeaf(const Node& node,
+                     const Ray& ray,
+                     float t_min,
+                     HitRecord& record) const;
+  bool OccludedLeaf(const Node& node,
+                    const Ray& ray,
+                    float t_min,
+                    float t_max) const;
+
+  size_t max_leaf_size_;
+  bool use_simd_;
+  const Mesh* mesh_;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> indices_;
+  size_t max_depth_;
+  // GetSahCost right after the last build.
+  float build_cost_;
+  TriangleBlocks blocks_;
+};
+}  // namespace GLOO
+
+#endif
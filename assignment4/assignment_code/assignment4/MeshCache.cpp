@@ -0,0 +1,174 @@
+#include "MeshCache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "gloo/MappedFile.hpp"
+#include "gloo/utils.hpp"
+
+#include "BinaryIO.hpp"
+#include "TriangleBlocks.hpp"
+
+namespace {
+const char kMagic[8] = "GLOOMSH";
+const uint32_t kByteOrderMark = 0x01020304;
+
+// Starts every entry. Besides the key it records what the layout of the
+// rest depends on, so entries from another version or machine are ignored.
+struct EntryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t simd_width;
+  uint32_t accelerator_type;
+  uint32_t simd;
+  uint32_t reserved;
+  uint64_t max_leaf_size;
+  uint64_t content_hash;
+  uint64_t content_size;
+};
+
+EntryHeader MakeHeader(const GLOO::MeshCache::Key& key) {
+  EntryHeader header;
+  // Zero the padding too, so headers can be compared bytewise.
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = GLOO::MeshCache::kVersion;
+  header.byte_order = kByteOrderMark;
+  header.simd_width = GLOO::TriangleBlocks::kWidth;
+  header.accelerator_type = static_cast<uint32_t>(key.options.type);
+  header.simd = key.options.simd;
+  header.max_leaf_size = key.options.max_leaf_size;
+  header.content_hash = key.content_hash;
+  header.content_size = key.content_size;
+  return header;
+}
+
+// 64-bit FNV-1a applied to whole words, which is fast enough to hash large
+// OBJ files on every run.
+uint64_t HashBytes(const char* data, size_t size, uint64_t hash) {
+  const uint64_t kPrime = 1099511628211ull;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * kPrime;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * kPrime;
+  }
+  return hash;
+}
+
+const uint64_t kHashSeed = 14695981039346656037ull;
+}  // namespace
+
+namespace GLOO {
+MeshCache::MeshCache(const std::string& directory)
+    : directory_(directory), hits_(0), misses_(0) {
+  // An existing directory makes this fail, which is fine; any other problem
+  // shows up when entries are written.
+#ifdef _WIN32
+  _mkdir(directory_.c_str());
+#else
+  mkdir(directory_.c_str(), 0755);
+#endif
+}
+
+MeshCache::Key MeshCache::GetKey(const std::string& obj_file,
+                                 const AcceleratorOptions& options) const {
+  MappedFile file;
+  if (!file.Open(obj_file)) {
+    throw std::runtime_error("Unable to read " + obj_file);
+  }
+  Key key;
+  key.content_hash = HashBytes(file.GetData(), file.GetSize(), kHashSeed);
+  key.content_size = file.GetSize();
+  key.options = options;
+  return key;
+}
+
+std::string MeshCache::GetEntryPath(const Key& key) const {
+  EntryHeader header = MakeHeader(key);
+  uint64_t hash = HashBytes(reinterpret_cast<const char*>(&header),
+                            sizeof(header), kHashSeed);
+  std::ostringstream path;
+  path << directory_ << "/" << std::hex << std::setfill('0')
+       << std::setw(16) << hash << ".mesh";
+  return path.str();
+}
+
+std::shared_ptr<Mesh> MeshCache::Find(const Key& key) {
+  std::string path = GetEntryPath(key);
+  // The mesh refers to the vertex data in the mapping and keeps it open.
+  auto file = std::make_shared<MappedFile>();
+  if (!file->Open(path)) {
+    misses_++;
+    return nullptr;
+  }
+  try {
+    BinaryReader reader(file->GetData(), file->GetSize());
+    EntryHeader expected = MakeHeader(key);
+    EntryHeader header = reader.Read<EntryHeader>();
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+      throw std::runtime_error("Mismatched header!");
+    }
+    size_t num_positions, num_normals, num_indices;
+    const glm::vec3* positions =
+        reader.ReadArrayInPlace<glm::vec3>(num_positions);
+    const glm::vec3* normals = reader.ReadArrayInPlace<glm::vec3>(num_normals);
+    const unsigned int* indices =
+        reader.ReadArrayInPlace<unsigned int>(num_indices);
+    auto mesh = std::make_shared<Mesh>(
+        Mesh::PositionView(positions, num_positions),
+        Mesh::NormalView(normals, num_normals),
+        Mesh::IndexView(indices, num_indices), file, key.options, reader);
+    hits_++;
+    return mesh;
+  } catch (const std::exception& e) {
+    std::cerr << "Ignoring mesh cache entry " << path << ": " << e.what()
+              << std::endl;
+    misses_++;
+    return nullptr;
+  }
+}
+
+void MeshCache::Store(const Key& key, const Mesh& mesh) {
+  // Written under a unique name and renamed into place, so that runs
+  // sharing the cache never map a partial entry.
+  std::string path = GetEntryPath(key);
+  std::random_device device;
+  std::ostringstream temp_path;
+  temp_path << path << ".tmp" << std::hex << device()
+            << std::chrono::steady_clock::now().time_since_epoch().count();
+  bool success;
+  {
+    std::ofstream os(temp_path.str(), std::ios::binary);
+    BinaryWriter writer(os);
+    writer.Write(MakeHeader(key));
+    writer.WriteArray(mesh.GetPositions().data(), mesh.GetPositions().size());
+    writer.WriteArray(mesh.GetNormals().data(), mesh.GetNormals().size());
+    writer.WriteArray(mesh.GetIndices().data(), mesh.GetIndices().size());
+    mesh.GetAccelerator().Save(writer);
+    os.close();
+    success = !os.fail();
+  }
+  if (!success || std::rename(temp_path.str().c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.str().c_str());
+    std::cerr << "Unable to write mesh cache entry " << path << std::endl;
+  }
+}
+}  // namespace GLOO
@@ -0,0 +1,56 @@
+#ifndef MESH_CACHE_H_
+#define MESH_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "AcceleratorType.hpp"
+#include "hittable/Mesh.hpp"
+
+namespace GLOO {
+// Persistent cache of meshes loaded from OBJ files, together with their
+// built acceleration structures. An entry is keyed by a hash of the OBJ
+// contents and the accelerator options, so an edited asset or a different
+// build setting never picks up a stale entry. Entries are versioned binary
+// files that later runs map into memory instead of parsing and building.
+class MeshCache {
+ public:
+  // Bump whenever the entry layout or the output of a build changes.
+  static const uint32_t kVersion = 1;
+
+  struct Key {
+    uint64_t content_hash;
+    uint64_t content_size;
+    AcceleratorOptions options;
+  };
+
+  // Entries live in directory, which is created if missing.
+  explicit MeshCache(const std::string& directory);
+
+  // Reads the OBJ file and hashes its contents. Throws if it cannot be read.
+  Key GetKey(const std::string& obj_file,
+             const AcceleratorOptions& options) const;
+  // Returns the cached mesh, or nullptr if there is no usable entry.
+  std::shared_ptr<Mesh> Find(const Key& key);
+  // Writes an entry for a mesh built with the key's options. Failures are
+  // reported but not fatal, as the mesh is already built.
+  void Store(const Key& key, const Mesh& mesh);
+
+  size_t GetHits() const {
+    return hits_;
+  }
+  size_t GetMisses() const {
+    return misses_;
+  }
+
+ private:
+  std::string GetEntryPath(const Key& key) const;
+
+  std::string directory_;
+  size_t hits_;
+  size_t misses_;
+};
+}  // namespace GLOO
+
+#endif
@@ -1,22 +1,70 @@
 #include "Octree.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 #include "gloo/utils.hpp"
 
 #include "hittable/Mesh.hpp"
+#include "RenderStats.hpp"
 
 namespace {
 // If a node contains more than 7 triangles and it
 // hasn't reached the max level yet, split.
-static const int kMaxTerminalCapacity = 7;
+static const size_t kMaxTerminalCapacity = 7;
+// Subtrees at this level are built in parallel, for meshes with at least
+// kMinParallelTriangles triangles; smaller ones do not pay for the threads.
+static const int kParallelLevel = 2;
+static const size_t kMinParallelTriangles = 4096;
 
-bool IntervalIntersect(float* a, float* b) {
-  if (a[0] > b[1]) {
-    return a[0] <= b[1];
-  } else {
-    return b[0] <= a[1];
+// Child i covers the upper half of the box along x, y and z when bit 2, 1
+// and 0 of i are set, respectively.
+void ComputeChildBoxes(const GLOO::AABB& bbox, GLOO::AABB child_bbox[8]) {
+  const glm::vec3& mn = bbox.mn;
+  const glm::vec3& mx = bbox.mx;
+  glm::vec3 mid = (mn + mx) / 2.0f;
+
+  child_bbox[0] = GLOO::AABB(mn, mid);
+  child_bbox[1] = GLOO::AABB(mn[0], mn[1], mid[2], mid[0], mid[1], mx[2]);
+  child_bbox[2] = GLOO::AABB(mn[0], mid[1], mn[2], mid[0], mx[1], mid[2]);
+  child_bbox[3] = GLOO::AABB(mn[0], mid[1], mid[2], mid[0], mx[1], mx[2]);
+  child_bbox[4] = GLOO::AABB(mid[0], mn[1], mn[2], mx[0], mid[1], mid[2]);
+  child_bbox[5] = GLOO::AABB(mid[0], mn[1], mid[2], mx[0], mid[1], mx[2]);
+  child_bbox[6] = GLOO::AABB(mid[0], mid[1], mn[2], mx[0], mx[1], mid[2]);
+  child_bbox[7] = GLOO::AABB(mid[0], mid[1], mid[2], mx[0], mx[1], mx[2]);
+}
+
+// Bit i of the result is set when child i of bbox, as laid out by
+// ComputeChildBoxes with mid at the center, contains or overlaps the triangle
+// bounds tb. Decides exactly as AABB::Contain and AABB::Overlap would on the
+// child boxes, but compares each axis once for both halves.
+uint8_t ComputeChildMask(const GLOO::AABB& bbox,
+                         const glm::vec3& mid,
+                         const GLOO::AABB& tb) {
+  bool overlap[3][2];
+  bool contain[3][2];
+  for (int dim = 0; dim < 3; dim++) {
+    overlap[dim][0] = !(bbox.mn[dim] > tb.mx[dim]) && tb.mn[dim] <= mid[dim];
+    overlap[dim][1] = !(mid[dim] > tb.mx[dim]) && tb.mn[dim] <= bbox.mx[dim];
+    contain[dim][0] = !(bbox.mn[dim] > tb.mn[dim] || mid[dim] < tb.mx[dim]);
+    contain[dim][1] = !(mid[dim] > tb.mn[dim] || bbox.mx[dim] < tb.mx[dim]);
+  }
+  uint8_t mask = 0;
+  for (int i = 0; i < 8; i++) {
+    int x = (i >> 2) & 1;
+    int y = (i >> 1) & 1;
+    int z = i & 1;
+    if ((overlap[0][x] && overlap[1][y] && overlap[2][z]) ||
+        (contain[0][x] && contain[1][y] && contain[2][z])) {
+      mask |= 1 << i;
+    }
   }
+  return mask;
 }
 
 // Below are Octree magic based on Revelles' algorithm.
@@ -58,6 +106,14 @@ size_t FirstChildIndex(float tx0,
   return bits;
 }
 
+float MinOf(float x, float y, float z) {
+  return std::min(std::min(x, y), z);
+}
+
+float MaxOf(float x, float y, float z) {
+  return std::max(std::max(x, y), z);
+}
+
 size_t NextChildIndex(float txm,
                       size_t x,
                       float tym,
@@ -79,105 +135,260 @@ size_t NextChildIndex(float txm,
 }  // namespace
 
 namespace GLOO {
-bool AABB::Overlap(const AABB& other) const {
-  for (int dim = 0; dim < 3; dim++) {
-    float ia[2] = {mn[dim], mx[dim]};
-    float ib[2] = {other.mn[dim], other.mx[dim]};
-    bool intersect = IntervalIntersect(ia, ib);
-    if (!intersect) {
-      return false;
-    }
-  }
-  return true;
+Octree::Octree(const AcceleratorOptions& options, int max_level)
+    : max_level_(max_level),
+      max_leaf_size_(options.max_leaf_size ? options.max_leaf_size
+                                           : kMaxTerminalCapacity),
+      use_simd_(options.simd),
+      triangle_count_(0),
+      mesh_(nullptr) {
 }
 
-bool AABB::Contain(const AABB& other) const {
-  for (int dim = 0; dim < 3; dim++) {
-    if (mn[dim] > other.mn[dim] || mx[dim] < other.mx[dim]) {
-      return false;
-    }
+void Octree::BuildNode(BuildTree& tree,
+                       uint32_t node_index,
+                       const AABB& bbox,
+                       BuildScratch& scratch,
+                       size_t begin,
+                       size_t end,
+                       int level,
+                       std::vector<BuildJob>* jobs) const {
+  size_t count = end - begin;
+  if (count <= max_leaf_size_ || level > max_level_) {
+    tree.nodes[node_index].offset = static_cast<uint32_t>(tree.indices.size());
+    tree.nodes[node_index].triangle_count = static_cast<uint32_t>(count);
+    tree.indices.insert(tree.indices.end(), scratch.triangles.begin() + begin,
+                        scratch.triangles.begin() + end);
+    return;
+  }
+  if (jobs != nullptr && level == kParallelLevel) {
+    tree.nodes[node_index].offset = static_cast<uint32_t>(jobs->size());
+    tree.nodes[node_index].triangle_count = kDeferred;
+    jobs->push_back({bbox, level,
+                     std::vector<uint32_t>(scratch.triangles.begin() + begin,
+                                           scratch.triangles.begin() + end),
+                     BuildTree()});
+    return;
   }
-  return true;
-}
 
-void AABB::UnionWith(const AABB& other) {
-  for (int dim = 0; dim < 3; dim++) {
-    mn[dim] = std::min(mn[dim], other.mn[dim]);
-    mx[dim] = std::max(mx[dim], other.mx[dim]);
+  // Reserve the eight children together; their subtrees follow in order.
+  uint32_t first_child = static_cast<uint32_t>(tree.nodes.size());
+  tree.nodes[node_index].offset = first_child;
+  tree.nodes[node_index].triangle_count = OctNode::kInterior;
+  tree.nodes.resize(tree.nodes.size() + 8);
+
+  AABB child_bbox[8];
+  ComputeChildBoxes(bbox, child_bbox);
+  for (size_t i = begin; i < end; i++) {
+    scratch.child_masks[i] = ComputeChildMask(
+        bbox, child_bbox[0].mx, triangle_bounds_[scratch.triangles[i]]);
+  }
+
+  for (uint32_t i = 0; i < 8; i++) {
+    // The scratch arrays may grow, so they are indexed rather than iterated.
+    size_t child_begin = scratch.triangles.size();
+    for (size_t vi = begin; vi < end; vi++) {
+      if (scratch.child_masks[vi] & (1 << i)) {
+        scratch.triangles.push_back(scratch.triangles[vi]);
+      }
+    }
+    size_t child_end = scratch.triangles.size();
+    scratch.child_masks.resize(child_end);
+    BuildNode(tree, first_child + i, child_bbox[i], scratch, child_begin,
+              child_end, level + 1, jobs);
+    scratch.triangles.resize(child_begin);
+    scratch.child_masks.resize(child_begin);
   }
 }
 
-AABB AABB::FromTriangle(const Triangle& triangle) {
-  AABB bbox;
-  bbox.mn = bbox.mx = triangle.GetPosition(0);
-  for (int i = 1; i < 3; i++) {
-    for (int dim = 0; dim < 3; dim++) {
-      bbox.mn[dim] = std::min(bbox.mn[dim], triangle.GetPosition(i)[dim]);
-      bbox.mx[dim] = std::max(bbox.mx[dim], triangle.GetPosition(i)[dim]);
+void Octree::RunJobs(std::vector<BuildJob>& jobs) const {
+  std::atomic<size_t> next_job(0);
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto worker = [&]() {
+    try {
+      BuildScratch scratch;
+      size_t job_index;
+      while ((job_index = next_job++) < jobs.size()) {
+        BuildJob& job = jobs[job_index];
+        scratch.triangles.swap(job.triangles);
+        scratch.child_masks.resize(scratch.triangles.size());
+        job.tree.nodes.assign(1, OctNode());
+        BuildNode(job.tree, 0, job.bbox, scratch, 0, scratch.triangles.size(),
+                  job.level, nullptr);
+        scratch.triangles.clear();
+        scratch.child_masks.clear();
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  };
+
+  size_t num_threads = std::min<size_t>(
+      jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+  if (num_threads <= 1) {
+    worker();
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
     }
   }
-  return bbox;
+  if (error) {
+    std::rethrow_exception(error);
+  }
 }
 
-AABB AABB::FromMesh(const Mesh& mesh) {
-  auto& triangles = mesh.GetTriangles();
-  AABB bbox(FromTriangle(triangles[0]));
-  for (size_t i = 1; i < triangles.size(); i++) {
-    bbox.UnionWith(FromTriangle(triangles[i]));
+void Octree::EmitNode(const BuildTree& tree,
+                      uint32_t tree_index,
+                      uint32_t node_index,
+                      const std::vector<BuildJob>& jobs) {
+  const OctNode& node = tree.nodes[tree_index];
+  if (node.triangle_count == kDeferred) {
+    EmitNode(jobs[node.offset].tree, 0, node_index, jobs);
+  } else if (node.IsTerminal()) {
+    nodes_[node_index].offset = static_cast<uint32_t>(triangle_indices_.size());
+    nodes_[node_index].triangle_count = node.triangle_count;
+    triangle_indices_.insert(
+        triangle_indices_.end(), tree.indices.begin() + node.offset,
+        tree.indices.begin() + node.offset + node.triangle_count);
+    if (use_simd_) {
+      TriangleBlocks::PadToBlock(triangle_indices_);
+    }
+  } else {
+    uint32_t first_child = static_cast<uint32_t>(nodes_.size());
+    nodes_[node_index].offset = first_child;
+    nodes_[node_index].triangle_count = OctNode::kInterior;
+    nodes_.resize(nodes_.size() + 8);
+    for (uint32_t i = 0; i < 8; i++) {
+      EmitNode(tree, node.offset + i, first_child + i, jobs);
+    }
   }
-  return bbox;
 }
 
-void Octree::BuildNode(OctNode& node,
-                       const AABB& bbox,
-                       const std::vector<const Triangle*>& triangles,
-                       int level) {
-  if (triangles.size() <= kMaxTerminalCapacity || level > max_level_) {
-    node.triangles = triangles;
-    return;
+void Octree::Build(const Mesh& mesh) {
+  bbox_ = AABB::FromMesh(mesh);
+  triangle_count_ = mesh.GetTriangleCount();
+  mesh_ = &mesh;
+
+  // Bounds are computed once, up front.
+  triangle_bounds_.resize(triangle_count_);
+  BuildScratch scratch;
+  scratch.triangles.resize(triangle_count_);
+  scratch.child_masks.resize(triangle_count_);
+  for (size_t i = 0; i < triangle_count_; i++) {
+    triangle_bounds_[i] = mesh.GetTriangleBounds(static_cast<uint32_t>(i));
+    scratch.triangles[i] = static_cast<uint32_t>(i);
   }
 
-  for (size_t i = 0; i < 8; i++) {
-    node.child[i] = make_unique<OctNode>();
+  // The top levels are built here; the subtrees below them are independent
+  // and built in parallel. Emitting afterwards lays the pieces out exactly
+  // as a single depth-first build would.
+  BuildTree top;
+  top.nodes.assign(1, OctNode());
+  std::vector<BuildJob> jobs;
+  BuildNode(top, 0, bbox_, scratch, 0, triangle_count_, 0,
+            triangle_count_ >= kMinParallelTriangles ? &jobs : nullptr);
+  RunJobs(jobs);
+
+  nodes_.assign(1, OctNode());
+  triangle_indices_.clear();
+  EmitNode(top, 0, 0, jobs);
+  nodes_.shrink_to_fit();
+  triangle_indices_.shrink_to_fit();
+  std::vector<AABB>().swap(triangle_bounds_);
+  if (use_simd_) {
+    blocks_.Build(mesh, triangle_indices_);
+  } else {
+    blocks_.Clear();
   }
+}
 
-  const glm::vec3& mn = bbox.mn;
-  const glm::vec3& mx = bbox.mx;
-  glm::vec3 mid = (mn + mx) / 2.0f;
+void Octree::Save(BinaryWriter& writer) const {
+  writer.Write(bbox_);
+  writer.Write<uint64_t>(triangle_count_);
+  writer.WriteArray(nodes_);
+  writer.WriteArray(triangle_indices_);
+}
 
-  AABB child_bbox[8];
-  child_bbox[0] = AABB(mn, mid);
-  child_bbox[1] = AABB(mn[0], mn[1], mid[2], mid[0], mid[1], mx[2]);
-  child_bbox[2] = AABB(mn[0], mid[1], mn[2], mid[0], mx[1], mid[2]);
-  child_bbox[3] = AABB(mn[0], mid[1], mid[2], mid[0], mx[1], mx[2]);
-  child_bbox[4] = AABB(mid[0], mn[1], mn[2], mx[0], mid[1], mid[2]);
-  child_bbox[5] = AABB(mid[0], mn[1], mid[2], mx[0], mid[1], mx[2]);
-  child_bbox[6] = AABB(mid[0], mid[1], mn[2], mx[0], mx[1], mid[2]);
-  child_bbox[7] = AABB(mid[0], mid[1], mid[2], mx[0], mx[1], mx[2]);
+void Octree::Load(const Mesh& mesh, BinaryReader& reader) {
+  bbox_ = reader.Read<AABB>();
+  triangle_count_ = reader.Read<uint64_t>();
+  mesh_ = &mesh;
+  reader.ReadArray(nodes_);
+  reader.ReadArray(triangle_indices_);
+  if (triangle_count_ != mesh.GetTriangleCount() || nodes_.empty()) {
+    throw std::runtime_error("Octree does not match the mesh!");
+  }
+  CheckLoaded();
+  if (use_simd_) {
+    blocks_.Build(mesh, triangle_indices_);
+  } else {
+    blocks_.Clear();
+  }
+}
 
-  for (size_t i = 0; i < 8; i++) {
-    std::vector<const Triangle*> child_triangles;
-    for (size_t vi = 0; vi < triangles.size(); vi++) {
-      const Triangle* triangle = triangles[vi];
-      AABB triangle_bbox = AABB::FromTriangle(*triangle);
-      if (child_bbox[i].Contain(triangle_bbox) ||
-          child_bbox[i].Overlap(triangle_bbox)) {
-        child_triangles.push_back(triangle);
+void Octree::CheckLoaded() const {
+  for (uint32_t index : triangle_indices_) {
+    if (index >= triangle_count_ && index != TriangleBlocks::kInvalidTriangle) {
+      throw std::runtime_error("Octree does not match the mesh!");
+    }
+  }
+  // Children follow their parent, so depths are known in node order. A
+  // build stops splitting below level max_level_ + 1.
+  std::vector<int> depths(nodes_.size(), 0);
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    const OctNode& node = nodes_[i];
+    if (depths[i] > max_level_ + 1) {
+      throw std::runtime_error("Octree is too deep!");
+    }
+    if (node.IsTerminal()) {
+      if (uint64_t(node.offset) + node.triangle_count >
+          triangle_indices_.size()) {
+        throw std::runtime_error("Octree leaf out of range!");
       }
+      for (uint32_t k = node.offset; k < node.offset + node.triangle_count;
+           k++) {
+        if (triangle_indices_[k] >= triangle_count_) {
+          throw std::runtime_error("Octree does not match the mesh!");
+        }
+      }
+      continue;
+    }
+    if (node.offset <= i || uint64_t(node.offset) + 8 > nodes_.size()) {
+      throw std::runtime_error("Octree child out of range!");
+    }
+    for (uint32_t k = node.offset; k < node.offset + 8; k++) {
+      depths[k] = std::max(depths[k], depths[i] + 1);
     }
-    BuildNode(*node.child[i], child_bbox[i], child_triangles, level + 1);
   }
 }
 
-void Octree::Build(const Mesh& mesh) {
-  auto& triangles = mesh.GetTriangles();
-  bbox_ = AABB::FromMesh(mesh);
+AcceleratorStats Octree::GetStats() const {
+  AcceleratorStats stats;
+  stats.triangle_count = triangle_count_;
+  stats.node_count = nodes_.size();
+  CollectStats(nodes_[0], 0, stats);
+  return stats;
+}
 
-  std::vector<const Triangle*> triangle_ptrs;
-  for (size_t i = 0; i < triangles.size(); i++)
-    triangle_ptrs.push_back(&triangles[i]);
-  root_ = make_unique<OctNode>();
-  BuildNode(*root_, bbox_, triangle_ptrs, 0);
+void Octree::CollectStats(const OctNode& node,
+                          size_t depth,
+                          AcceleratorStats& stats) const {
+  stats.max_depth = std::max(stats.max_depth, depth);
+  if (node.IsTerminal()) {
+    stats.leaf_count++;
+    stats.triangle_refs += node.triangle_count;
+    return;
+  }
+  for (size_t i = 0; i < 8; i++) {
+    CollectStats(nodes_[node.offset + i], depth + 1, stats);
+  }
 }
 
 bool Octree::IntersectSubtree(uint8_t aa,
@@ -190,74 +401,206 @@ bool Octree::IntersectSubtree(uint8_t aa,
                               float tz1,
                               const Ray& ray,
                               float t_min,
-                              HitRecord& record) {
+                              HitRecord& record,
+                              bool any_hit) const {
   bool intersected = false;
-  if (tx1 < 0 || ty1 < 0 || tz1 < 0) {
+  RenderCounters::Local().node_visits++;
+  // Skip nodes that lie outside the ray interval [t_min, record.time): they
+  // end before t_min or start behind the closest hit found so far.
+  if (MinOf(tx1, ty1, tz1) < t_min || MaxOf(tx0, ty0, tz0) >= record.time) {
     return intersected;
   }
 
   if (node.IsTerminal()) {
-    // Brute force over things.
-    for (auto& t : node.triangles) {
-      bool result = t->Intersect(ray, t_min, record);
-      intersected |= result;
+    if (any_hit) {
+      return OccludedLeaf(node, ray, t_min, record.time);
     }
-    return intersected;
+    return IntersectLeaf(node, ray, t_min, record);
   }
 
   float txm = 0.5f * (tx0 + tx1);
   float tym = 0.5f * (ty0 + ty1);
   float tzm = 0.5f * (tz0 + tz1);
   std::size_t cur = FirstChildIndex(tx0, ty0, tz0, txm, tym, tzm);
+  const OctNode* child = &nodes_[node.offset];
+  float t_exit = std::numeric_limits<float>::max();
   do {
     switch (cur) {
       case 0: {
-        intersected |= IntersectSubtree(aa, *node.child[aa], tx0, ty0, tz0, txm,
-                                        tym, tzm, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[aa], tx0, ty0, tz0, txm,
+                                        tym, tzm, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(txm, tym, tzm);
         cur = NextChildIndex(txm, 4, tym, 2, tzm, 1);
       } break;
       case 1: {
-        intersected |= IntersectSubtree(aa, *node.child[1 ^ aa], tx0, ty0, tzm,
-                                        txm, tym, tz1, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[1 ^ aa], tx0, ty0, tzm,
+                                        txm, tym, tz1, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(txm, tym, tz1);
         cur = NextChildIndex(txm, 5, tym, 3, tz1, 8);
       } break;
       case 2: {
-        intersected |= IntersectSubtree(aa, *node.child[2 ^ aa], tx0, tym, tz0,
-                                        txm, ty1, tzm, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[2 ^ aa], tx0, tym, tz0,
+                                        txm, ty1, tzm, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(txm, ty1, tzm);
         cur = NextChildIndex(txm, 6, ty1, 8, tzm, 3);
       } break;
       case 3: {
-        intersected |= IntersectSubtree(aa, *node.child[3 ^ aa], tx0, tym, tzm,
-                                        txm, ty1, tz1, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[3 ^ aa], tx0, tym, tzm,
+                                        txm, ty1, tz1, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(txm, ty1, tz1);
         cur = NextChildIndex(txm, 7, ty1, 8, tz1, 8);
       } break;
       case 4: {
-        intersected |= IntersectSubtree(aa, *node.child[4 ^ aa], txm, ty0, tz0,
-                                        tx1, tym, tzm, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[4 ^ aa], txm, ty0, tz0,
+                                        tx1, tym, tzm, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(tx1, tym, tzm);
         cur = NextChildIndex(tx1, 8, tym, 6, tzm, 5);
       } break;
       case 5: {
-        intersected |= IntersectSubtree(aa, *node.child[5 ^ aa], txm, ty0, tzm,
-                                        tx1, tym, tz1, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[5 ^ aa], txm, ty0, tzm,
+                                        tx1, tym, tz1, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(tx1, tym, tz1);
         cur = NextChildIndex(tx1, 8, tym, 7, tz1, 8);
       } break;
       case 6: {
-        intersected |= IntersectSubtree(aa, *node.child[6 ^ aa], txm, tym, tz0,
-                                        tx1, ty1, tzm, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[6 ^ aa], txm, tym, tz0,
+                                        tx1, ty1, tzm, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(tx1, ty1, tzm);
         cur = NextChildIndex(tx1, 8, ty1, 8, tzm, 7);
       } break;
       case 7: {
-        intersected |= IntersectSubtree(aa, *node.child[7 ^ aa], txm, tym, tzm,
-                                        tx1, ty1, tz1, ray, t_min, record);
+        intersected |= IntersectSubtree(aa, child[7 ^ aa], txm, tym, tzm,
+                                        tx1, ty1, tz1, ray, t_min, record,
+                                        any_hit);
+        t_exit = MinOf(tx1, ty1, tz1);
         cur = 8;
       } break;
     }
+    // Children are visited front to back and the next one starts where this
+    // one ends, so a hit no farther than t_exit cannot be beaten. The first
+    // occluder settles an any-hit query.
+    if (intersected && (any_hit || record.time <= t_exit)) {
+      break;
+    }
   } while (cur < 8);
 
   return intersected;
 }
 
-bool Octree::Intersect(const Ray& ray, float t_min, HitRecord& record) {
+bool Octree::IntersectLeaf(const OctNode& node,
+                           const Ray& ray,
+                           float t_min,
+                           HitRecord& record) const {
+  if (use_simd_) {
+    return blocks_.Intersect(node.offset, node.triangle_count, ray, t_min,
+                             record);
+  }
+  // Brute force over things.
+  bool intersected = false;
+  for (uint32_t i = node.offset; i < node.offset + node.triangle_count; i++) {
+    bool result =
+        mesh_->IntersectTriangle(triangle_indices_[i], ray, t_min, record);
+    intersected |= result;
+  }
+  return intersected;
+}
+
+bool Octree::OccludedLeaf(const OctNode& node,
+                          const Ray& ray,
+                          float t_min,
+                          float t_max) const {
+  if (use_simd_) {
+    return blocks_.Occluded(node.offset, node.triangle_count, ray, t_min,
+                            t_max);
+  }
+  for (uint32_t i = node.offset; i < node.offset + node.triangle_count; i++) {
+    if (mesh_->OccludedByTriangle(triangle_indices_[i], ray, t_min, t_max)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t Octree::IntersectPacket(const RayPacket& packet,
+                                 uint64_t active,
+                                 float t_min,
+                                 HitRecord* records) const {
+  if (active == 0) {
+    return 0;
+  }
+  // Children are visited in the order given by the octant of the first
+  // ray, which is near to far for a coherent packet.
+  glm::vec3 direction = packet.GetRay(LowestBit(active)).GetDirection();
+  uint8_t aa = 0;
+  for (int dim = 0; dim < 3; dim++) {
+    if (direction[dim] < 0) {
+      aa |= (1 << (2 - dim));
+    }
+  }
+
+  // Each entry carries the rays that reached its parent.
+  struct StackEntry {
+    uint32_t node_index;
+    uint64_t mask;
+    AABB bbox;
+  };
+  // Each level leaves at most seven siblings on the stack.
+  std::vector<StackEntry> stack;
+  stack.reserve(8 * (max_level_ + 2));
+  stack.push_back({0, active, bbox_});
+  uint64_t hits = 0;
+  while (!stack.empty()) {
+    StackEntry entry = stack.back();
+    stack.pop_back();
+    RenderCounters::Local().node_visits++;
+    uint64_t mask =
+        packet.IntersectBox(entry.bbox, entry.mask, t_min, records);
+    if (mask == 0) {
+      continue;
+    }
+    const OctNode& node = nodes_[entry.node_index];
+    if (node.IsTerminal()) {
+      for (uint64_t rest = mask; rest != 0; rest &= rest - 1) {
+        size_t i = LowestBit(rest);
+        if (IntersectLeaf(node, packet.GetRay(i), t_min, records[i])) {
+          hits |= uint64_t(1) << i;
+        }
+      }
+      continue;
+    }
+    AABB child_bbox[8];
+    ComputeChildBoxes(entry.bbox, child_bbox);
+    for (int k = 7; k >= 0; k--) {
+      uint32_t child = k ^ aa;
+      stack.push_back({node.offset + child, mask, child_bbox[child]});
+    }
+  }
+  return hits;
+}
+
+bool Octree::Intersect(const Ray& ray,
+                       float t_min,
+                       HitRecord& record) const {
+  return Traverse(ray, t_min, record, false);
+}
+
+bool Octree::Occluded(const Ray& ray, float t_min, float t_max) const {
+  HitRecord record;
+  record.time = t_max;
+  return Traverse(ray, t_min, record, true);
+}
+
+bool Octree::Traverse(const Ray& ray,
+                      float t_min,
+                      HitRecord& record,
+                      bool any_hit) const {
   glm::vec3 ray_dir = ray.GetDirection();
   // TODO: does ray_dir need to be unit?
   glm::vec3 ray_origin = ray.GetOrigin();
@@ -283,9 +626,9 @@ bool Octree::Intersect(const Ray& ray, float t_min, HitRecord& record) {
   float tz0 = (bbox_.mn[2] - ray_origin[2]) * divz;
   float tz1 = (bbox_.mx[2] - ray_origin[2]) * divz;
 
-  if (std::max(std::max(tx0, ty0), tz0) <= std::min(std::min(tx1, ty1), tz1)) {
-    return IntersectSubtree(aa, *root_, tx0, ty0, tz0, tx1, ty1, tz1, ray,
-                            t_min, record);
+  if (MaxOf(tx0, ty0, tz0) <= MinOf(tx1, ty1, tz1)) {
+    return IntersectSubtree(aa, nodes_[0], tx0, ty0, tz0, tx1, ty1, tz1, ray,
+                            t_min, record, any_hit);
   } else {
     return false;
   }
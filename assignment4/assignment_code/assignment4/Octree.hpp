@@ -1,56 +1,101 @@
 #ifndef OCTREE_H_
 #define OCTREE_H_
 
-#include <memory>
+#include <cstdint>
+#include <vector>
 
 #include <glm/glm.hpp>
 
+#include "AABB.hpp"
 #include "HitRecord.hpp"
-#include "hittable/Triangle.hpp"
+#include "AcceleratorType.hpp"
+#include "MeshAccelerator.hpp"
+#include "TriangleBlocks.hpp"
 
 namespace GLOO {
-// Forward declarations.
-class Mesh;
-
-struct AABB {
-  AABB() {
-  }
-  AABB(const glm::vec3& _mn, const glm::vec3& _mx) : mn(_mn), mx(_mx) {
-  }
-  AABB(float mnx, float mny, float mnz, float mxx, float mxy, float mxz)
-      : mn(glm::vec3(mnx, mny, mnz)), mx(glm::vec3(mxx, mxy, mxz)) {
-  }
-  static AABB FromTriangle(const Triangle& triangle);
-  static AABB FromMesh(const Mesh& mesh);
-
-  void UnionWith(const AABB& other);
-  bool Overlap(const AABB& other) const;
-  bool Contain(const AABB& other) const;
-
-  glm::vec3 mn, mx;
-};
-
-class Octree {
+class Octree : public MeshAccelerator {
  public:
-  Octree(int max_level = 8) : max_level_(max_level) {
+  explicit Octree(const AcceleratorOptions& options = AcceleratorOptions(),
+                  int max_level = 8);
+  const char* GetName() const override {
+    return "octree";
   }
-  void Build(const Mesh& mesh);
-  bool Intersect(const Ray& ray, float t_min, HitRecord& record);
+  void Build(const Mesh& mesh) override;
+  void Save(BinaryWriter& writer) const override;
+  void Load(const Mesh& mesh, BinaryReader& reader) override;
+  bool Intersect(const Ray& ray,
+                 float t_min,
+                 HitRecord& record) const override;
+  uint64_t IntersectPacket(const RayPacket& packet,
+                           uint64_t active,
+                           float t_min,
+                           HitRecord* records) const override;
+  bool Occluded(const Ray& ray, float t_min, float t_max) const override;
+  const AABB& GetBounds() const override {
+    return bbox_;
+  }
+  AcceleratorStats GetStats() const override;
 
  private:
+  // The built tree is packed into nodes_ in depth-first order. The eight
+  // children of an interior node are stored contiguously, so a node only
+  // needs the index of its first child. Terminal nodes instead refer to a
+  // range of triangle_indices_, which holds the leaves' triangles back to
+  // back. With the SIMD kernel each leaf starts on a block boundary.
   struct OctNode {
+    static const uint32_t kInterior = 0xffffffff;
+
     bool IsTerminal() const {
-      return child[0] == nullptr;
+      return triangle_count != kInterior;
     }
 
-    std::unique_ptr<OctNode> child[8];
-    std::vector<const Triangle*> triangles;
+    // First child for interior nodes, first triangle index for terminals.
+    uint32_t offset;
+    uint32_t triangle_count;
+  };
+
+  // Marks a node of a BuildTree whose subtree is a deferred BuildJob; its
+  // offset is the job index.
+  static const uint32_t kDeferred = 0xfffffffe;
+
+  // A tree under construction. Its offsets are local to its own arrays and
+  // its leaves are not padded; EmitNode copies it into nodes_ in the final
+  // depth-first order.
+  struct BuildTree {
+    std::vector<OctNode> nodes;
+    std::vector<uint32_t> indices;
+  };
+  // Triangle lists of the nodes on the current recursion path, back to back.
+  // Each child appends its list at the end and drops it when its subtree is
+  // done, so lists are partitioned in place instead of copied per node.
+  // child_masks parallels triangles with the children each one overlaps.
+  struct BuildScratch {
+    std::vector<uint32_t> triangles;
+    std::vector<uint8_t> child_masks;
+  };
+  // A subtree below the top levels, built on a thread of its own.
+  struct BuildJob {
+    AABB bbox;
+    int level;
+    std::vector<uint32_t> triangles;
+    BuildTree tree;
   };
 
-  void BuildNode(OctNode& node,
+  // Builds the node over scratch.triangles[begin, end). When jobs is given,
+  // subtrees at kParallelLevel are deferred to it instead of built.
+  void BuildNode(BuildTree& tree,
+                 uint32_t node_index,
                  const AABB& bbox,
-                 const std::vector<const Triangle*>& triangles,
-                 int level);
+                 BuildScratch& scratch,
+                 size_t begin,
+                 size_t end,
+                 int level,
+                 std::vector<BuildJob>* jobs) const;
+  void RunJobs(std::vector<BuildJob>& jobs) const;
+  void EmitNode(const BuildTree& tree,
+                uint32_t tree_index,
+                uint32_t node_index,
+                const std::vector<BuildJob>& jobs);
 
   bool IntersectSubtree(uint8_t aa,
                         const OctNode& node,
@@ -62,11 +107,41 @@ class Octree {
                         float tz1,
                         const Ray& r,
                         float t_min,
-                        HitRecord& record);
+                        HitRecord& record,
+                        bool any_hit) const;
+  // Shared by Intersect and Occluded. An any-hit traversal treats
+  // record.time as t_max and returns at the first occluder.
+  bool Traverse(const Ray& ray,
+                float t_min,
+                HitRecord& record,
+                bool any_hit) const;
+  bool IntersectLeaf(const OctNode& node,
+                     const Ray& ray,
+                     float t_min,
+                     HitRecord& record) const;
+  bool OccludedLeaf(const OctNode& node,
+                    const Ray& ray,
+                    float t_min,
+                    float t_max) const;
+  // Throws unless the loaded nodes form a tree no deeper than a build makes
+  // it whose leaves refer to triangles of the mesh, so that a damaged cache
+  // entry is rejected rather than traversed.
+  void CheckLoaded() const;
+  void CollectStats(const OctNode& node,
+                    size_t depth,
+                    AcceleratorStats& stats) const;
 
   int max_level_;
+  size_t max_leaf_size_;
+  bool use_simd_;
+  size_t triangle_count_;
   AABB bbox_;
-  std::unique_ptr<OctNode> root_;
+  const Mesh* mesh_;
+  std::vector<OctNode> nodes_;
+  std::vector<uint32_t> triangle_indices_;
+  // Bounds of every triangle, only kept while building.
+  std::vector<AABB> triangle_bounds_;
+  TriangleBlocks blocks_;
 };
 }  // namespace GLOO
 
@@ -26,6 +26,10 @@ class PerspectiveCamera : public CameraBase {
   float GetTMin() const override {
     return 0.0f;
   }
+
+  float GetSpreadAngle(float spacing) const override {
+    return atanf(spacing * tanf(fov_radian_ / 2.0f));
+  }
 };
 }  // namespace GLOO
 
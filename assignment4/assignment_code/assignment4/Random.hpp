@@ -0,0 +1,46 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace GLOO {
+// Small splitmix64 generator. Each pixel seeds its own instance so the
+// sample sequence does not depend on which thread renders the pixel.
+class Random {
+ public:
+  Random(uint64_t seed) : state_(seed) {
+  }
+
+  static uint64_t ForPixel(unsigned int seed, size_t x, size_t y) {
+    uint64_t key = (static_cast<uint64_t>(y) << 32) ^ static_cast<uint64_t>(x);
+    return ForKey(seed, key);
+  }
+
+  // Seed for anything else identified by a 64-bit key.
+  static uint64_t ForKey(unsigned int seed, uint64_t key) {
+    return Mix(Mix(seed) ^ key);
+  }
+
+  uint64_t NextUint() {
+    state_ += 0x9e3779b97f4a7c15ull;
+    return Mix(state_);
+  }
+
+  // Returns a float in [0, 1).
+  float NextFloat() {
+    return static_cast<float>(NextUint() >> 40) * (1.0f / 16777216.0f);
+  }
+
+ private:
+  static uint64_t Mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t state_;
+};
+}  // namespace GLOO
+
+#endif
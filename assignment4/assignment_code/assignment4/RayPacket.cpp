@@ -0,0 +1,107 @@
+#include "RayPacket.hpp"
+
+#include <stdexcept>
+
+namespace GLOO {
+const size_t RayPacket::kMaxSize;
+
+size_t RayPacket::Add(const Ray& ray) {
+  if (size_ == kMaxSize) {
+    throw std::length_error("Ray packet is full!");
+  }
+  const glm::vec3& origin = ray.GetOrigin();
+  const glm::vec3& direction = ray.GetDirection();
+  for (int dim = 0; dim < 3; dim++) {
+    origin_[dim][size_] = origin[dim];
+    direction_[dim][size_] = direction[dim];
+    inv_direction_[dim][size_] = 1.0f / direction[dim];
+  }
+  return size_++;
+}
+
+bool RayPacket::IsCoherent(uint64_t active) const {
+  if (active == 0) {
+    return true;
+  }
+  size_t first = LowestBit(active);
+  for (size_t i = first + 1; i < size_; i++) {
+    if (!((active >> i) & 1)) {
+      continue;
+    }
+    for (int dim = 0; dim < 3; dim++) {
+      if ((direction_[dim][i] < 0.0f) != (direction_[dim][first] < 0.0f)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+uint64_t RayPacket::IntersectBox(const AABB& box,
+                                 uint64_t active,
+                                 float t_min,
+                                 const HitRecord* records) const {
+  uint64_t hits = 0;
+  // The interval only shrinks, so testing it once at the end is equivalent
+  // to the per-slab checks in AABB::Intersect.
+#if defined(GLOO_SIMD_AVX2) || defined(GLOO_SIMD_SSE)
+  using namespace simd;
+  const uint64_t lane_mask = (uint64_t(1) << kLaneWidth) - 1;
+  Lanes mn[3], mx[3];
+  for (int dim = 0; dim < 3; dim++) {
+    mn[dim] = Splat(box.mn[dim]);
+    mx[dim] = Splat(box.mx[dim]);
+  }
+  for (size_t first = 0; first < size_; first += kLaneWidth) {
+    if (((active >> first) & lane_mask) == 0) {
+      continue;
+    }
+    float t_max[kLaneWidth];
+    for (size_t lane = 0; lane < kLaneWidth; lane++) {
+      size_t i = first + lane;
+      t_max[lane] = i < size_ ? records[i].time : 0.0f;
+    }
+    Lanes t_near = Splat(t_min);
+    Lanes t_far = Load(t_max);
+    for (int dim = 0; dim < 3; dim++) {
+      Lanes origin = Load(&origin_[dim][first]);
+      Lanes inv_direction = Load(&inv_direction_[dim][first]);
+      Lanes t0 = Mul(Sub(mn[dim], origin), inv_direction);
+      Lanes t1 = Mul(Sub(mx[dim], origin), inv_direction);
+      // Same selections as the scalar code below, NaNs included.
+      Lanes lo = Min(t1, t0);
+      Lanes hi = Max(t0, t1);
+      t_near = Max(lo, t_near);
+      t_far = Min(hi, t_far);
+    }
+    hits |= static_cast<uint64_t>(MoveMask(NotGreater(t_near, t_far)))
+            << first;
+  }
+#else
+  for (uint64_t rest = active; rest != 0; rest &= rest - 1) {
+    size_t i = LowestBit(rest);
+    float t_near = t_min;
+    float t_far = records[i].time;
+    for (int dim = 0; dim < 3; dim++) {
+      float t0 = (box.mn[dim] - origin_[dim][i]) * inv_direction_[dim][i];
+      float t1 = (box.mx[dim] - origin_[dim][i]) * inv_direction_[dim][i];
+      float lo = t0 > t1 ? t1 : t0;
+      float hi = t0 > t1 ? t0 : t1;
+      t_near = lo > t_near ? lo : t_near;
+      t_far = hi < t_far ? hi : t_far;
+    }
+    hits |= static_cast<uint64_t>(!(t_near > t_far)) << i;
+  }
+#endif
+  return hits & active;
+}
+
+void RayPacket::Transform(const glm::mat4& transform, RayPacket& out) const {
+  out.size_ = 0;
+  for (size_t i = 0; i < size_; i++) {
+    Ray ray = GetRay(i);
+    out.Add(Ray(glm::vec3(transform * glm::vec4(ray.GetOrigin(), 1.0f)),
+                glm::vec3(transform * glm::vec4(ray.GetDirection(), 0.0f))));
+  }
+}
+}  // namespace GLOO
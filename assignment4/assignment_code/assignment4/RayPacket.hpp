@@ -0,0 +1,84 @@
+#ifndef RAY_PACKET_H_
+#define RAY_PACKET_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "AABB.hpp"
+#include "Ray.hpp"
+#include "HitRecord.hpp"
+#include "SimdLanes.hpp"
+
+namespace GLOO {
+// Up to kMaxSize rays that are traced through the acceleration structures
+// together, so every node box is fetched once for the whole bundle. Rays are
+// kept in structure-of-arrays form. A 64-bit mask selects the active rays:
+// bit i stands for the i-th ray added.
+class RayPacket {
+ public:
+  static const size_t kMaxSize = 64;
+
+  // The arrays are zeroed so that SIMD code may read whole lanes past the
+  // last ray.
+  RayPacket()
+      : size_(0), origin_(), direction_(), inv_direction_() {
+  }
+
+  void Clear() {
+    size_ = 0;
+  }
+  // Appends a ray and returns its slot.
+  size_t Add(const Ray& ray);
+
+  size_t GetSize() const {
+    return size_;
+  }
+  uint64_t GetFullMask() const {
+    return size_ == kMaxSize ? ~uint64_t(0) : (uint64_t(1) << size_) - 1;
+  }
+  Ray GetRay(size_t i) const {
+    return Ray(glm::vec3(origin_[0][i], origin_[1][i], origin_[2][i]),
+               glm::vec3(direction_[0][i], direction_[1][i], direction_[2][i]));
+  }
+
+  // True when the active rays all point into the same octant. Shared
+  // traversal only pays off for such packets; others should be traced one
+  // ray at a time.
+  bool IsCoherent(uint64_t active) const;
+
+  // Returns the active rays whose interval [t_min, records[i].time] overlaps
+  // the box. Gives the same answer as AABB::Intersect for each ray.
+  uint64_t IntersectBox(const AABB& box,
+                        uint64_t active,
+                        float t_min,
+                        const HitRecord* records) const;
+
+  // Copy of the packet with every ray moved into another space. Directions
+  // are not renormalized, so hit times stay comparable.
+  void Transform(const glm::mat4& transform, RayPacket& out) const;
+
+ private:
+  size_t size_;
+  float origin_[3][kMaxSize];
+  float direction_[3][kMaxSize];
+  float inv_direction_[3][kMaxSize];
+};
+
+// Index of the lowest set bit; mask must not be zero.
+inline size_t LowestBit(uint64_t mask) {
+#if defined(__GNUC__)
+  return static_cast<size_t>(__builtin_ctzll(mask));
+#else
+  size_t i = 0;
+  while (!(mask & 1)) {
+    mask >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+}  // namespace GLOO
+
+#endif
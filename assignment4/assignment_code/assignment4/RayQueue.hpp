@@ -0,0 +1,38 @@
+#ifndef RAY_QUEUE_H_
+#define RAY_QUEUE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Ray.hpp"
+#include "HitRecord.hpp"
+#include "SceneBVH.hpp"
+
+namespace GLOO {
+// The rays of one wave of the wavefront renderer, each with the index of
+// the path it extends and, once the wave has been intersected, its closest
+// hit. Kept as parallel arrays so that every stage streams through them.
+struct RayQueue {
+  std::vector<Ray> rays;
+  std::vector<uint32_t> paths;
+  std::vector<HitRecord> records;
+  // Null where the ray missed.
+  std::vector<const TracingInstance*> hits;
+
+  size_t GetSize() const {
+    return rays.size();
+  }
+  void Clear() {
+    rays.clear();
+    paths.clear();
+    records.clear();
+    hits.clear();
+  }
+  void Push(const Ray& ray, uint32_t path) {
+    rays.push_back(ray);
+    paths.push_back(path);
+  }
+};
+}  // namespace GLOO
+
+#endif
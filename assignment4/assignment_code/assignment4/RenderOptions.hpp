@@ -0,0 +1,69 @@
+#ifndef RENDER_OPTIONS_H_
+#define RENDER_OPTIONS_H_
+
+#include <cstddef>
+#include <string>
+
+#include <glm/glm.hpp>
+
+namespace GLOO {
+struct RenderOptions {
+  // Number of worker threads. 0 means one per hardware thread.
+  size_t threads = 0;
+  // Size in pixels of the tiles handed out to the worker threads.
+  glm::ivec2 tile_size = glm::ivec2(32, 32);
+  // Base seed of the per-pixel sample generators. A given seed produces the
+  // same image regardless of the thread count and tile size.
+  unsigned int seed = 0;
+  // Side length of the square pixel blocks whose primary and shadow rays are
+  // traced as packets. 0 traces every ray on its own. At most 8, so that a
+  // packet fits in RayPacket::kMaxSize rays.
+  size_t packet_size = 0;
+  // Adaptive sampling, enabled when adaptive_max_samples is not 0. Every
+  // pixel takes adaptive_min_samples samples (at least 2), then keeps
+  // sampling up to adaptive_max_samples while the standard error of its mean
+  // color is above adaptive_threshold in any channel. Replaces the fixed
+  // sample count and traces rays one at a time.
+  size_t adaptive_min_samples = 0;
+  size_t adaptive_max_samples = 0;
+  float adaptive_threshold = 0.0f;
+  // Times scene traversal apart from shading in the render statistics, at
+  // the cost of two clock reads per ray query.
+  bool profile = false;
+  // If not empty, an image of the samples spent per pixel is saved here,
+  // from black (none) through red and yellow to white (the most).
+  std::string heatmap_file;
+  // Write the image a row of tiles at a time, top down, as the rows are
+  // finished, instead of keeping all of it in memory until the end. Tiles
+  // are then handed out in row order, and no heatmap can be saved.
+  bool stream_output = false;
+  // Encode 8-bit output with the sRGB transfer curve instead of clamping
+  // linear values. Float output is always linear.
+  bool srgb_output = false;
+  // Filter cube map backgrounds over the footprint of a camera sample, from
+  // the mip level whose texels match it, instead of reading the finest one.
+  bool filter_background = false;
+  // Light culling, enabled when light_threshold is not 0: a point light is
+  // skipped at hit points where its intensity is below the threshold in
+  // every channel, as found through a LightBVH over the spheres where it is
+  // not. Slightly darkens the image, by at most the threshold per light.
+  float light_threshold = 0.0f;
+  // Stochastic light selection, enabled when light_samples is not 0: where
+  // more point lights than that reach a hit point, only light_samples of
+  // them are shaded, picked with probability proportional to their
+  // unshadowed intensity and weighted so that the expected color is
+  // unchanged. Other lights are always shaded.
+  size_t light_samples = 0;
+  // Trace each tile breadth first, a wave of rays at a time, instead of one
+  // path at a time. The image is the same; adaptive sampling and packets
+  // are not available with it.
+  bool wavefront = false;
+  // Refitting, enabled when refit_threshold is not 0: Render keeps the scene
+  // BVH of its last call for the same scene and only recomputes its bounds
+  // for the current transforms, unless that makes its SAH cost more than
+  // refit_threshold times that of its last build. For animations.
+  float refit_threshold = 0.0f;
+};
+}  // namespace GLOO
+
+#endif
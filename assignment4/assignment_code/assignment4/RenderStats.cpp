@@ -0,0 +1,92 @@
+#include "RenderStats.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace GLOO {
+thread_local RenderCounters RenderCounters::local_;
+
+void RenderCounters::Add(const RenderCounters& other) {
+  primary_rays += other.primary_rays;
+  shadow_rays += other.shadow_rays;
+  bounce_rays += other.bounce_rays;
+  node_visits += other.node_visits;
+  triangle_tests += other.triangle_tests;
+  triangle_hits += other.triangle_hits;
+  shaded_hits += other.shaded_hits;
+  shaded_lights += other.shaded_lights;
+  traversal_ns += other.traversal_ns;
+}
+
+double RenderStats::GetWorkerMs() const {
+  double ms = 0.0;
+  for (const TileStats& tile : tiles) {
+    ms += tile.ms;
+  }
+  return ms;
+}
+
+namespace {
+void WriteCounters(std::ostream& os,
+                   const RenderCounters& counters,
+                   bool profiled) {
+  os << "{\"primary_rays\": " << counters.primary_rays
+     << ", \"shadow_rays\": " << counters.shadow_rays
+     << ", \"bounce_rays\": " << counters.bounce_rays
+     << ", \"node_visits\": " << counters.node_visits
+     << ", \"triangle_tests\": " << counters.triangle_tests
+     << ", \"triangle_hits\": " << counters.triangle_hits
+     << ", \"shaded_hits\": " << counters.shaded_hits
+     << ", \"shaded_lights\": " << counters.shaded_lights;
+  if (profiled) {
+    os << ", \"traversal_ms\": " << counters.traversal_ns * 1e-6;
+  }
+  os << "}";
+}
+}  // namespace
+
+void RenderStats::WriteJson(const std::string& filename) const {
+  std::ofstream os(filename);
+  if (!os) {
+    throw std::runtime_error("Unable to write " + filename);
+  }
+  double worker_ms = GetWorkerMs();
+  double traversal_ms = totals.traversal_ns * 1e-6;
+  std::ostringstream traversal, shading;
+  if (profiled) {
+    traversal << traversal_ms;
+    shading << worker_ms - traversal_ms;
+  } else {
+    traversal << "null";
+    shading << "null";
+  }
+  os << "{\n";
+  os << "  \"image\": {\"width\": " << width << ", \"height\": " << height
+     << ", \"samples\": " << samples << "},\n";
+  os << "  \"threads\": " << per_worker.size() << ",\n";
+  os << "  \"scene_refit\": " << (scene_refit ? "true" : "false") << ",\n";
+  os << "  \"times_ms\": {\"mesh_build\": " << mesh_build_ms
+     << ", \"mesh_load\": " << mesh_load_ms
+     << ", \"scene_build\": " << scene_build_ms
+     << ", \"render\": " << render_ms << ", \"workers\": " << worker_ms
+     << ", \"traversal\": " << traversal.str()
+     << ", \"shading\": " << shading.str() << "},\n";
+  os << "  \"counters\": ";
+  WriteCounters(os, totals, profiled);
+  os << ",\n  \"per_thread\": [";
+  for (size_t i = 0; i < per_worker.size(); i++) {
+    os << (i == 0 ? "\n    " : ",\n    ");
+    WriteCounters(os, per_worker[i], profiled);
+  }
+  os << "\n  ],\n  \"tiles\": [";
+  for (size_t i = 0; i < tiles.size(); i++) {
+    const TileStats& stats = tiles[i];
+    os << (i == 0 ? "\n    " : ",\n    ") << "{\"x0\": " << stats.tile.x0
+       << ", \"y0\": " << stats.tile.y0 << ", \"x1\": " << stats.tile.x1
+       << ", \"y1\": " << stats.tile.y1 << ", \"worker\": " << stats.worker
+       << ", \"ms\": " << stats.ms << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+}  // namespace GLOO
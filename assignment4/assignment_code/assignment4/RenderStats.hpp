@@ -0,0 +1,125 @@
+#ifndef RENDER_STATS_H_
+#define RENDER_STATS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TileScheduler.hpp"
+
+namespace GLOO {
+// Milliseconds of steady_clock time since start.
+inline double MsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Event counters of one thread. The hot paths bump the calling thread's
+// instance, returned by RenderCounters::Local(), so no synchronization is
+// needed; Tracer::Render collects the instances when its workers finish.
+struct RenderCounters {
+  uint64_t primary_rays;
+  uint64_t shadow_rays;
+  uint64_t bounce_rays;
+  // Nodes of mesh acceleration structures (octree or BVH) visited.
+  uint64_t node_visits;
+  // Mesh triangles tested against a ray, and the tests that hit.
+  uint64_t triangle_tests;
+  uint64_t triangle_hits;
+  // Hit points shaded, and the lights shaded at them, when lights are culled
+  // or sampled.
+  uint64_t shaded_hits;
+  uint64_t shaded_lights;
+  // Time spent in scene traversal: closest-hit and shadow queries. Only
+  // measured when profiling.
+  uint64_t traversal_ns;
+
+  static RenderCounters& Local() {
+    return local_;
+  }
+
+  void Clear() {
+    *this = RenderCounters();
+  }
+  void Add(const RenderCounters& other);
+
+ private:
+  static thread_local RenderCounters local_;
+};
+
+// Adds the lifetime of the scope to the calling thread's traversal time.
+// Reading the clock twice per query is not free, so the timer only runs
+// when enabled.
+class TraversalTimer {
+ public:
+  explicit TraversalTimer(bool enabled) : enabled_(enabled) {
+    if (enabled_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~TraversalTimer() {
+    if (!enabled_) {
+      return;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    RenderCounters::Local().traversal_ns += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+            .count());
+  }
+
+ private:
+  bool enabled_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+struct TileStats {
+  Tile tile;
+  size_t worker;
+  double ms;
+};
+
+// Statistics of one Tracer::Render call.
+struct RenderStats {
+  RenderStats()
+      : width(0),
+        height(0),
+        samples(0),
+        profiled(false),
+        mesh_build_ms(0.0),
+        mesh_load_ms(0.0),
+        scene_build_ms(0.0),
+        scene_refit(false),
+        render_ms(0.0),
+        totals() {
+  }
+
+  size_t width;
+  size_t height;
+  size_t samples;
+  // Whether traversal was timed.
+  bool profiled;
+  // Acceleration structure builds of the meshes (done while parsing), loads
+  // of those restored from the mesh cache instead, the build of the scene
+  // BVH with the compiled scene tables, and wall time of the tile rendering.
+  double mesh_build_ms;
+  double mesh_load_ms;
+  double scene_build_ms;
+  // Whether the scene BVH was refit rather than built.
+  bool scene_refit;
+  double render_ms;
+  RenderCounters totals;
+  std::vector<RenderCounters> per_worker;
+  std::vector<TileStats> tiles;
+
+  // Summed tile times of all workers.
+  double GetWorkerMs() const;
+  // Writes the statistics as a JSON object. Shading time is reported as the
+  // worker time not spent in traversal; both are null unless profiled.
+  void WriteJson(const std::string& filename) const;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,414 @@
+#include "SceneBVH.hpp"
+
+#include <algorithm>
+
+#include "gloo/SceneNode.hpp"
+#include "gloo/Transform.hpp"
+
+namespace {
+// Leaves hold at most this many instances.
+static const size_t kMaxLeafSize = 2;
+}  // namespace
+
+namespace GLOO {
+void SceneBVH::Build(const std::vector<TracingComponent*>& components) {
+  instances_.clear();
+  unbounded_.clear();
+  nodes_.clear();
+
+  for (size_t i = 0; i < components.size(); i++) {
+    TracingComponent* component = components[i];
+    TracingInstance instance;
+    instance.component = component;
+    instance.hittable = &component->GetHittable();
+    instance.object = static_cast<uint32_t>(i);
+    if (ResolveInstance(instance)) {
+      instances_.push_back(instance);
+    } else {
+      unbounded_.push_back(instance);
+    }
+  }
+
+  if (!instances_.empty()) {
+    nodes_.reserve(2 * instances_.size());
+    BuildNode(0, instances_.size());
+  }
+  build_cost_ = GetSahCost();
+}
+
+bool SceneBVH::Refit(const std::vector<TracingComponent*>& components,
+                     float max_cost_ratio) {
+  if (components.size() != instances_.size() + unbounded_.size()) {
+    return false;
+  }
+  for (TracingInstance& instance : unbounded_) {
+    if (components[instance.object] != instance.component ||
+        ResolveInstance(instance)) {
+      return false;
+    }
+  }
+  for (TracingInstance& instance : instances_) {
+    if (components[instance.object] != instance.component ||
+        !ResolveInstance(instance)) {
+      return false;
+    }
+  }
+  // Children come after their parent, so a backward sweep sees them first.
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    Node& node = nodes_[i];
+    if (node.count > 0) {
+      node.bbox = AABB::Empty();
+      for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+        node.bbox.UnionWith(instances_[k].world_bounds);
+      }
+    } else {
+      node.bbox = nodes_[i + 1].bbox;
+      node.bbox.UnionWith(nodes_[node.offset].bbox);
+    }
+  }
+  return GetSahCost() <= max_cost_ratio * build_cost_;
+}
+
+float SceneBVH::GetSahCost() const {
+  if (nodes_.empty()) {
+    return 0.0f;
+  }
+  float root_area = nodes_[0].bbox.GetSurfaceArea();
+  if (!(root_area > 0.0f)) {
+    return 0.0f;
+  }
+  float cost = 0.0f;
+  for (const Node& node : nodes_) {
+    cost += node.bbox.GetSurfaceArea() *
+            (node.count > 0 ? float(node.count) : 1.0f);
+  }
+  return cost / root_area;
+}
+
+bool SceneBVH::ResolveInstance(TracingInstance& instance) {
+  // Walk the parent chain once here instead of once per ray.
+  glm::mat4 local_to_world = instance.component->GetNodePtr()
+                                 ->GetTransform()
+                                 .GetLocalToWorldMatrix();
+  instance.world_to_local = glm::inverse(local_to_world);
+  instance.normal_matrix =
+      glm::transpose(glm::inverse(glm::mat3(local_to_world)));
+
+  AABB local_bounds;
+  if (!instance.hittable->GetBounds(local_bounds)) {
+    return false;
+  }
+  instance.world_bounds = local_bounds.Transformed(local_to_world);
+  return true;
+}
+
+uint32_t SceneBVH::BuildNode(size_t begin, size_t end) {
+  uint32_t index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+
+  AABB bbox = AABB::Empty();
+  AABB centroid_bbox = AABB::Empty();
+  for (size_t i = begin; i < end; i++) {
+    bbox.UnionWith(instances_[i].world_bounds);
+    centroid_bbox.UnionWith(instances_[i].world_bounds.GetCenter());
+  }
+  nodes_[index].bbox = bbox;
+
+  if (end - begin <= kMaxLeafSize) {
+    nodes_[index].offset = static_cast<uint32_t>(begin);
+    nodes_[index].count = static_cast<uint32_t>(end - begin);
+    return index;
+  }
+
+  // Median split along the axis with the widest spread of centroids.
+  glm::vec3 extent = centroid_bbox.mx - centroid_bbox.mn;
+  int axis = 0;
+  if (extent[1] > extent[axis])
+    axis = 1;
+  if (extent[2] > extent[axis])
+    axis = 2;
+  size_t mid = (begin + end) / 2;
+  std::nth_element(instances_.begin() + begin, instances_.begin() + mid,
+                   instances_.begin() + end,
+                   [axis](const TracingInstance& a, const TracingInstance& b) {
+                     return a.world_bounds.GetCenter()[axis] <
+                            b.world_bounds.GetCenter()[axis];
+                   });
+
+  BuildNode(begin, mid);
+  uint32_t right = BuildNode(mid, end);
+  nodes_[index].offset = right;
+  nodes_[index].count = 0;
+  return index;
+}
+
+const TracingInstance* SceneBVH::Intersect(const Ray& ray,
+                                           float t_min,
+                                           HitRecord& record) const {
+  const TracingInstance* hit_instance = nullptr;
+  for (auto& instance : unbounded_) {
+    if (IntersectInstance(instance, ray, t_min, record)) {
+      hit_instance = &instance;
+    }
+  }
+  if (nodes_.empty()) {
+    return hit_instance;
+  }
+
+  const glm::vec3& origin = ray.GetOrigin();
+  glm::vec3 inv_direction = glm::vec3(1.0f) / ray.GetDirection();
+
+  uint32_t stack[64];
+  size_t stack_size = 0;
+  float t_entry;
+  if (nodes_[0].bbox.Intersect(origin, inv_direction, t_min, record.time,
+                               t_entry)) {
+    stack[stack_size++] = 0;
+  }
+  while (stack_size > 0) {
+    const Node& node = nodes_[stack[--stack_size]];
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        if (IntersectInstance(instances_[i], ray, t_min, record)) {
+          hit_instance = &instances_[i];
+        }
+      }
+      continue;
+    }
+    // Visit the nearer child first; record.time keeps shrinking the interval.
+    uint32_t left = static_cast<uint32_t>(&node - nodes_.data()) + 1;
+    uint32_t right = node.offset;
+    float t_left, t_right;
+    bool hit_left = nodes_[left].bbox.Intersect(origin, inv_direction, t_min,
+                                                record.time, t_left);
+    bool hit_right = nodes_[right].bbox.Intersect(origin, inv_direction, t_min,
+                                                  record.time, t_right);
+    if (hit_left && hit_right) {
+      if (t_left < t_right) {
+        stack[stack_size++] = right;
+        stack[stack_size++] = left;
+      } else {
+        stack[stack_size++] = left;
+        stack[stack_size++] = right;
+      }
+    } else if (hit_left) {
+      stack[stack_size++] = left;
+    } else if (hit_right) {
+      stack[stack_size++] = right;
+    }
+  }
+  return hit_instance;
+}
+
+uint64_t SceneBVH::IntersectPacket(
+    const RayPacket& packet,
+    uint64_t active,
+    float t_min,
+    HitRecord* records,
+    const TracingInstance** hit_instances) const {
+  uint64_t hits = 0;
+  for (auto& instance : unbounded_) {
+    hits |= IntersectInstancePacket(instance, packet, active, t_min, records,
+                                    hit_instances);
+  }
+  if (nodes_.empty()) {
+    return hits;
+  }
+
+  // Each entry carries the rays that reached its parent.
+  struct StackEntry {
+    uint32_t node_index;
+    uint64_t mask;
+  };
+  StackEntry stack[64];
+  size_t stack_size = 0;
+  stack[stack_size++] = {0, active};
+  while (stack_size > 0) {
+    StackEntry entry = stack[--stack_size];
+    uint32_t node_index = entry.node_index;
+    const Node& node = nodes_[node_index];
+    uint64_t mask =
+        packet.IntersectBox(node.bbox, entry.mask, t_min, records);
+    if (mask == 0) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        hits |= IntersectInstancePacket(instances_[i], packet, mask, t_min,
+                                        records, hit_instances);
+      }
+      continue;
+    }
+    // The first ray that reaches this node decides which child is nearer.
+    uint32_t left = node_index + 1;
+    uint32_t right = node.offset;
+    Ray ray = packet.GetRay(LowestBit(mask));
+    glm::vec3 inv_direction = glm::vec3(1.0f) / ray.GetDirection();
+    float t_left, t_right;
+    bool hit_left = nodes_[left].bbox.Intersect(
+        ray.GetOrigin(), inv_direction, t_min,
+        std::numeric_limits<float>::max(), t_left);
+    bool hit_right = nodes_[right].bbox.Intersect(
+        ray.GetOrigin(), inv_direction, t_min,
+        std::numeric_limits<float>::max(), t_right);
+    if (hit_left && (!hit_right || t_left < t_right)) {
+      stack[stack_size++] = {right, mask};
+      stack[stack_size++] = {left, mask};
+    } else {
+      stack[stack_size++] = {left, mask};
+      stack[stack_size++] = {right, mask};
+    }
+  }
+  return hits;
+}
+
+uint64_t SceneBVH::IntersectInstancePacket(
+    const TracingInstance& instance,
+    const RayPacket& packet,
+    uint64_t active,
+    float t_min,
+    HitRecord* records,
+    const TracingInstance** hit_instances) const {
+  RayPacket local_packet;
+  packet.Transform(instance.world_to_local, local_packet);
+  HitRecord local_records[RayPacket::kMaxSize];
+  for (size_t i = 0; i < packet.GetSize(); i++) {
+    local_records[i].time = records[i].time;
+  }
+  uint64_t local_hits = instance.hittable->IntersectPacket(
+      local_packet, active, t_min, local_records);
+
+  uint64_t hits = 0;
+  for (size_t i = 0; i < packet.GetSize(); i++) {
+    if ((local_hits >> i) & 1) {
+      records[i].time = local_records[i].time;
+      records[i].normal =
+          glm::normalize(instance.normal_matrix * local_records[i].normal);
+      hit_instances[i] = &instance;
+      hits |= uint64_t(1) << i;
+    }
+  }
+  return hits;
+}
+
+bool SceneBVH::Occluded(const Ray& ray, float t_min, float t_max) const {
+  for (auto& instance : unbounded_) {
+    if (OccludedByInstance(instance, ray, t_min, t_max)) {
+      return true;
+    }
+  }
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  const glm::vec3& origin = ray.GetOrigin();
+  glm::vec3 inv_direction = glm::vec3(1.0f) / ray.GetDirection();
+
+  uint32_t stack[64];
+  size_t stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    uint32_t node_index = stack[--stack_size];
+    const Node& node = nodes_[node_index];
+    float t_entry;
+    if (!node.bbox.Intersect(origin, inv_direction, t_min, t_max, t_entry)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        if (OccludedByInstance(instances_[i], ray, t_min, t_max)) {
+          return true;
+        }
+      }
+      continue;
+    }
+    stack[stack_size++] = node.offset;
+    stack[stack_size++] = node_index + 1;
+  }
+  return false;
+}
+
+uint64_t SceneBVH::OccludedPacket(const RayPacket& packet,
+                                  uint64_t active,
+                                  float t_min,
+                                  const float* t_max) const {
+  uint64_t occluded = 0;
+  RayPacket local_packet;
+  for (auto& instance : unbounded_) {
+    packet.Transform(instance.world_to_local, local_packet);
+    occluded |= instance.hittable->OccludedPacket(
+        local_packet, active & ~occluded, t_min, t_max);
+  }
+  if (nodes_.empty()) {
+    return occluded;
+  }
+
+  // IntersectBox reads each ray's interval end from a record.
+  HitRecord limits[RayPacket::kMaxSize];
+  for (size_t i = 0; i < packet.GetSize(); i++) {
+    limits[i].time = t_max[i];
+  }
+
+  struct StackEntry {
+    uint32_t node_index;
+    uint64_t mask;
+  };
+  StackEntry stack[64];
+  size_t stack_size = 0;
+  stack[stack_size++] = {0, active};
+  while (stack_size > 0) {
+    StackEntry entry = stack[--stack_size];
+    const Node& node = nodes_[entry.node_index];
+    // Rays already known to be occluded drop out.
+    uint64_t mask =
+        packet.IntersectBox(node.bbox, entry.mask & ~occluded, t_min, limits);
+    if (mask == 0) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        const TracingInstance& instance = instances_[i];
+        packet.Transform(instance.world_to_local, local_packet);
+        occluded |= instance.hittable->OccludedPacket(
+            local_packet, mask & ~occluded, t_min, t_max);
+      }
+      continue;
+    }
+    stack[stack_size++] = {node.offset, mask};
+    stack[stack_size++] = {entry.node_index + 1, mask};
+  }
+  return occluded;
+}
+
+bool SceneBVH::OccludedByInstance(const TracingInstance& instance,
+                                  const Ray& ray,
+                                  float t_min,
+                                  float t_max) const {
+  const glm::mat4& world_to_local = instance.world_to_local;
+  Ray local_ray(
+      glm::vec3(world_to_local * glm::vec4(ray.GetOrigin(), 1.0f)),
+      glm::vec3(world_to_local * glm::vec4(ray.GetDirection(), 0.0f)));
+  // Local t equals world t because the direction is not renormalized.
+  return instance.hittable->Occluded(local_ray, t_min, t_max);
+}
+
+bool SceneBVH::IntersectInstance(const TracingInstance& instance,
+                                 const Ray& ray,
+                                 float t_min,
+                                 HitRecord& record) const {
+  const glm::mat4& world_to_local = instance.world_to_local;
+  Ray local_ray(
+      glm::vec3(world_to_local * glm::vec4(ray.GetOrigin(), 1.0f)),
+      glm::vec3(world_to_local * glm::vec4(ray.GetDirection(), 0.0f)));
+  // The local direction is not renormalized, so t is the same in both spaces
+  // and the interval carries over unchanged.
+  HitRecord local_record;
+  local_record.time = record.time;
+  if (instance.hittable->Intersect(local_ray, t_min, local_record)) {
+    record.time = local_record.time;
+    record.normal = glm::normalize(instance.normal_matrix * local_record.normal);
+    return true;
+  }
+  return false;
+}
+}  // namespace GLOO
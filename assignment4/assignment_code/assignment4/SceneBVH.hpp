@@ -0,0 +1,104 @@
+#ifndef SCENE_BVH_H_
+#define SCENE_BVH_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AABB.hpp"
+#include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "HitRecord.hpp"
+#include "TracingComponent.hpp"
+
+namespace GLOO {
+// A TracingComponent with its transforms resolved once per render.
+struct TracingInstance {
+  const TracingComponent* component;
+  const HittableBase* hittable;
+  // Index of the component in the list passed to SceneBVH::Build.
+  uint32_t object;
+  glm::mat4 world_to_local;
+  // Inverse transpose of the upper 3x3 of local_to_world.
+  glm::mat3 normal_matrix;
+  AABB world_bounds;
+};
+
+// Top-level BVH over the world-space bounds of the scene's objects, so a ray
+// only visits the objects it can actually hit. Unbounded objects (planes)
+// are kept in a separate list that every ray tests.
+class SceneBVH {
+ public:
+  void Build(const std::vector<TracingComponent*>& components);
+  // Takes the current transforms and bounds of the objects of the last
+  // build, which must be the same components, and recomputes the node
+  // bounds bottom-up. Returns false if the BVH must be built again instead:
+  // when the objects differ, or when its SAH cost rose above max_cost_ratio
+  // times that of the last build.
+  bool Refit(const std::vector<TracingComponent*>& components,
+             float max_cost_ratio);
+  // Expected cost of a ray that hits the root, in object tests: every node
+  // weighted by its surface area relative to the root's.
+  float GetSahCost() const;
+
+  // Finds the closest hit in world space. On a hit, record.normal is the
+  // normalized world-space normal and the hit instance is returned.
+  const TracingInstance* Intersect(const Ray& ray,
+                                   float t_min,
+                                   HitRecord& record) const;
+  bool OccludedByInstance(const TracingInstance& instance,
+                          const Ray& ray,
+                          float t_min,
+                          float t_max) const;
+  uint64_t IntersectInstancePacket(const TracingInstance& instance,
+                                   const RayPacket& packet,
+                                   uint64_t active,
+                                   float t_min,
+                                   HitRecord* records,
+                                   const TracingInstance** hit_instances) const;
+  // Packet version of Intersect. records[i] and hit_instances[i] belong to
+  // the i-th ray and are only updated for the active rays that hit
+  // something closer than records[i].time. Returns those rays.
+  uint64_t IntersectPacket(const RayPacket& packet,
+                           uint64_t active,
+                           float t_min,
+                           HitRecord* records,
+                           const TracingInstance** hit_instances) const;
+  // Whether anything is hit with t in [t_min, t_max). Stops at the first
+  // occluder.
+  bool Occluded(const Ray& ray, float t_min, float t_max) const;
+  // Packet version of Occluded; returns the occluded rays among active.
+  uint64_t OccludedPacket(const RayPacket& packet,
+                          uint64_t active,
+                          float t_min,
+                          const float* t_max) const;
+
+ private:
+  // Nodes are stored in depth-first order: an interior node's left child
+  // directly follows it and offset points at the right child. A leaf covers
+  // instances_[offset, offset + count).
+  struct Node {
+    AABB bbox;
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  // Sets the transforms of instance from its component's node, and its
+  // world_bounds if the object is bounded. Returns whether it is.
+  static bool ResolveInstance(TracingInstance& instance);
+  uint32_t BuildNode(size_t begin, size_t end);
+  bool IntersectInstance(const TracingInstance& instance,
+                         const Ray& ray,
+                         float t_min,
+                         HitRecord& record) const;
+
+  std::vector<TracingInstance> instances_;
+  std::vector<TracingInstance> unbounded_;
+  std::vector<Node> nodes_;
+  // GetSahCost right after the last build.
+  float build_cost_ = 0.0f;
+};
+}  // namespace GLOO
+
+#endif
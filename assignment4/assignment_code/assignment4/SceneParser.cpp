@@ -13,6 +13,7 @@
 #include "gloo/lights/DirectionalLight.hpp"
 #include "gloo/lights/AmbientLight.hpp"
 #include "gloo/parsers/ObjParser.hpp"
+#include "gloo/parsers/BinaryMeshFile.hpp"
 
 #include "helpers.hpp"
 
@@ -23,7 +24,46 @@
 #include "hittable/Mesh.hpp"
 
 namespace GLOO {
-SceneParser::SceneParser() {
+namespace {
+// Keeps a mapped mesh file, and normals computed for it, alive for a mesh.
+struct BinaryMeshData {
+  BinaryMeshFile file;
+  std::unique_ptr<NormalArray> normals;
+};
+
+// Creates a mesh that refers to the arrays in the mapped file.
+std::shared_ptr<Mesh> LoadBinaryMesh(const std::string& file_path,
+                                     const AcceleratorOptions& accelerator) {
+  auto data = std::make_shared<BinaryMeshData>();
+  if (!data->file.Open(file_path) || data->file.GetPositions() == nullptr ||
+      data->file.GetIndices() == nullptr) {
+    throw std::runtime_error("Failed at loading " + file_path);
+  }
+  Mesh::PositionView positions(data->file.GetPositions(),
+                               data->file.GetPositionCount());
+  Mesh::IndexView indices(data->file.GetIndices(),
+                          data->file.GetIndexCount());
+  Mesh::NormalView normals(data->file.GetNormals(),
+                           data->file.GetNormalCount());
+  if (data->file.GetNormals() == nullptr) {
+    data->normals =
+        CalculateNormals(PositionArray(positions.begin(), positions.end()),
+                         IndexArray(indices.begin(), indices.end()));
+    normals = *data->normals;
+  }
+  return std::make_shared<Mesh>(positions, normals, indices, data,
+                                accelerator);
+}
+}  // namespace
+
+SceneParser::SceneParser()
+    : override_accelerator_(false),
+      accelerator_override_(AcceleratorType::Octree),
+      mesh_instance_count_(0) {
+}
+
+void SceneParser::SetMeshCacheDirectory(const std::string& directory) {
+  mesh_cache_ = make_unique<MeshCache>(directory);
 }
 
 std::unique_ptr<Scene> SceneParser::ParseScene(const std::string& filename) {
@@ -137,6 +177,8 @@ std::shared_ptr<Material> SceneParser::ParseMaterial() {
 
 std::unique_ptr<SceneNode> SceneParser::ParseSceneNode() {
   auto node = make_unique<SceneNode>();
+  bool animated = false;
+  glm::mat4 motion_step(1.0f);
   std::string token;
   fs_ >> token;
   Assert(token, "{");
@@ -146,6 +188,10 @@ std::unique_ptr<SceneNode> SceneParser::ParseSceneNode() {
       node->AddChild(ParseSceneNode());
     } else if (token == "Transform") {
       ParseTransform(node->GetTransform());
+    } else if (token == "Animation") {
+      // Applied once more every frame, on top of the Transform.
+      animated = true;
+      motion_step = ParseMatrix();
     } else if (token.find("Component") != std::string::npos) {
       size_t begin = token.find("<") + 1;
       size_t end = token.find(">");
@@ -157,11 +203,18 @@ std::unique_ptr<SceneNode> SceneParser::ParseSceneNode() {
       throw std::runtime_error("Bad node token: " + token + "!");
     }
   }
+  if (animated) {
+    animation_.AddNodeMotion(*node, motion_step);
+  }
 
   return node;
 }
 
 void SceneParser::ParseTransform(Transform& transform) {
+  transform.SetMatrix4x4(ParseMatrix());
+}
+
+glm::mat4 SceneParser::ParseMatrix() {
   std::string token;
   fs_ >> token;
   Assert(token, "{");
@@ -186,7 +239,7 @@ void SceneParser::ParseTransform(Transform& transform) {
       throw std::runtime_error("Bad transform token: " + token + "!");
     }
   }
-  transform.SetMatrix4x4(T);
+  return T;
 }
 
 void SceneParser::ParseComponent(const std::string& type, SceneNode& node) {
@@ -331,19 +384,39 @@ void SceneParser::ParseTracingComponent(SceneNode& node) {
     fs_ >> token;
     Assert(token, "obj_file");
     fs_ >> filename;
-    fs_ >> token;
-    Assert(token, "}");
-    bool success;
-    auto data = ObjParser::Parse(base_path_ + filename, success);
-    if (!success || data.positions == nullptr || data.indices == nullptr) {
-      throw std::runtime_error("Failed at parsing " + filename);
+    AcceleratorOptions accelerator = accelerator_options_;
+    accelerator.type = AcceleratorType::Octree;
+    std::string frames;
+    while (true) {
+      fs_ >> token;
+      if (token == "accelerator") {
+        std::string name;
+        fs_ >> name;
+        accelerator.type = ParseAcceleratorType(name);
+      } else if (token == "frames") {
+        fs_ >> frames;
+      } else if (token == "}") {
+        break;
+      } else {
+        throw std::runtime_error("Bad mesh token: " + token + "!");
+      }
     }
-    if (data.normals == nullptr) {
-      data.normals = CalculateNormals(*data.positions, *data.indices);
+    if (override_accelerator_) {
+      accelerator.type = accelerator_override_;
+    }
+    // Objects referring to the same file share one mesh and its
+    // acceleration structure, and differ only in their transforms.
+    MeshKey mesh_key{base_path_ + filename, accelerator, frames};
+    auto found = meshes_.find(mesh_key);
+    if (found == meshes_.end()) {
+      auto mesh = LoadMesh(mesh_key.path, accelerator);
+      if (frames.size()) {
+        animation_.AddMeshSequence(mesh, base_path_ + frames);
+      }
+      found = meshes_.emplace(mesh_key, std::move(mesh)).first;
     }
-    object = std::make_shared<Mesh>(std::move(data.positions),
-                                    std::move(data.normals),
-                                    std::move(data.indices));
+    mesh_instance_count_++;
+    object = found->second;
   } else {
     throw std::runtime_error("Bad object type: " + type + "!");
   }
@@ -351,6 +424,39 @@ void SceneParser::ParseTracingComponent(SceneNode& node) {
   node.CreateComponent<TracingComponent>(std::move(object));
 }
 
+std::shared_ptr<Mesh> SceneParser::LoadMesh(
+    const std::string& obj_path,
+    const AcceleratorOptions& accelerator) {
+  MeshCache::Key key;
+  std::shared_ptr<Mesh> mesh;
+  if (mesh_cache_) {
+    key = mesh_cache_->GetKey(obj_path, accelerator);
+    mesh = mesh_cache_->Find(key);
+  }
+  if (mesh == nullptr && BinaryMeshFile::IsBinaryMeshPath(obj_path)) {
+    mesh = LoadBinaryMesh(obj_path, accelerator);
+    if (mesh_cache_) {
+      mesh_cache_->Store(key, *mesh);
+    }
+  } else if (mesh == nullptr) {
+    bool success;
+    auto data = ObjParser::Parse(obj_path, success);
+    if (!success || data.positions == nullptr || data.indices == nullptr) {
+      throw std::runtime_error("Failed at parsing " + obj_path);
+    }
+    if (data.normals == nullptr) {
+      data.normals = CalculateNormals(*data.positions, *data.indices);
+    }
+    mesh = std::make_shared<Mesh>(std::move(data.positions),
+                                  std::move(data.normals),
+                                  std::move(data.indices), accelerator);
+    if (mesh_cache_) {
+      mesh_cache_->Store(key, *mesh);
+    }
+  }
+  return mesh;
+}
+
 glm::vec3 SceneParser::ReadVec3() {
   float r, g, b;
   if (!(fs_ >> r >> g >> b)) {
@@ -2,6 +2,8 @@
 #define SCENE_PARSER_H_
 
 #include <fstream>
+#include <map>
+#include <tuple>
 
 #include "gloo/Scene.hpp"
 #include "gloo/Material.hpp"
@@ -9,6 +11,10 @@
 
 #include "CubeMap.hpp"
 #include "CameraSpec.hpp"
+#include "AcceleratorType.hpp"
+#include "MeshCache.hpp"
+#include "Animation.hpp"
+#include "hittable/Mesh.hpp"
 
 namespace GLOO {
 
@@ -25,20 +31,69 @@ class SceneParser {
   const CameraSpec& GetCameraSpec() const {
     return camera_spec_;
   }
+  // Forces every mesh to use the given acceleration structure, ignoring the
+  // per-object "accelerator" setting of the scene file.
+  void SetAcceleratorOverride(AcceleratorType type) {
+    override_accelerator_ = true;
+    accelerator_override_ = type;
+  }
+  // Leaf size and kernel settings for every mesh. The type is still taken
+  // from the scene file or the override.
+  void SetAcceleratorOptions(const AcceleratorOptions& options) {
+    accelerator_options_ = options;
+  }
+  // Loads meshes from, and stores them in, a persistent cache in directory.
+  void SetMeshCacheDirectory(const std::string& directory);
+  // Null unless a cache directory was set.
+  const MeshCache* GetMeshCache() const {
+    return mesh_cache_.get();
+  }
+  // Number of distinct meshes loaded, and of objects referring to them.
+  size_t GetMeshCount() const {
+    return meshes_.size();
+  }
+  size_t GetMeshInstanceCount() const {
+    return mesh_instance_count_;
+  }
+  // Node motions ("Animation" blocks) and mesh vertex sequences ("frames")
+  // of the scene file.
+  Animation& GetAnimation() {
+    return animation_;
+  }
 
  private:
+  // Identifies a loaded mesh: the same file with different accelerator
+  // settings, or with different vertex sequences, needs its own mesh.
+  struct MeshKey {
+    std::string path;
+    AcceleratorOptions accelerator;
+    std::string frames;
+
+    bool operator<(const MeshKey& other) const {
+      return std::tie(path, accelerator.type, accelerator.max_leaf_size,
+                      accelerator.simd, frames) <
+             std::tie(other.path, other.accelerator.type,
+                      other.accelerator.max_leaf_size,
+                      other.accelerator.simd, other.frames);
+    }
+  };
+
   void ParseBackground();
   void ParseMaterials();
 
   std::shared_ptr<Material> ParseMaterial();
   std::unique_ptr<SceneNode> ParseSceneNode();
   void ParseTransform(Transform& transform);
+  // A block of translate, rotate and scale steps, applied in order.
+  glm::mat4 ParseMatrix();
   void ParseComponent(const std::string& type, SceneNode& node);
   void ParseCamera();
   void ParseLightComponent(SceneNode& node);
   void ParseMaterialComponent(SceneNode& node);
   void ParseTracingComponent(SceneNode& node);
   void Assert(const std::string& token, const std::string& expected);
+  std::shared_ptr<Mesh> LoadMesh(const std::string& obj_path,
+                                 const AcceleratorOptions& accelerator);
 
   float ReadFloat();
   int ReadInt();
@@ -54,6 +109,14 @@ class SceneParser {
 
   CameraSpec camera_spec_;
 
+  bool override_accelerator_;
+  AcceleratorType accelerator_override_;
+  AcceleratorOptions accelerator_options_;
+  std::unique_ptr<MeshCache> mesh_cache_;
+  std::map<MeshKey, std::shared_ptr<Mesh>> meshes_;
+  size_t mesh_instance_count_;
+  Animation animation_;
+
   std::fstream fs_;
   std::string base_path_;
 };
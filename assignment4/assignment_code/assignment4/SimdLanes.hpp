@@ -0,0 +1,124 @@
+#ifndef SIMD_LANES_H_
+#define SIMD_LANES_H_
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#define GLOO_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define GLOO_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+namespace GLOO {
+// Thin wrappers over the widest float vector compiled in (AVX2 or SSE), so
+// SIMD kernels read the same for every width. The "not" comparisons are
+// true for NaN, like negated comparisons in scalar code.
+namespace simd {
+#if defined(GLOO_SIMD_AVX2)
+const size_t kLaneWidth = 8;
+typedef __m256 Lanes;
+inline Lanes Load(const float* p) {
+  return _mm256_loadu_ps(p);
+}
+inline Lanes Splat(float x) {
+  return _mm256_set1_ps(x);
+}
+inline void Store(float* p, Lanes a) {
+  _mm256_storeu_ps(p, a);
+}
+inline Lanes Add(Lanes a, Lanes b) {
+  return _mm256_add_ps(a, b);
+}
+inline Lanes Sub(Lanes a, Lanes b) {
+  return _mm256_sub_ps(a, b);
+}
+inline Lanes Mul(Lanes a, Lanes b) {
+  return _mm256_mul_ps(a, b);
+}
+inline Lanes Div(Lanes a, Lanes b) {
+  return _mm256_div_ps(a, b);
+}
+inline Lanes And(Lanes a, Lanes b) {
+  return _mm256_and_ps(a, b);
+}
+// Min(a, b) is a < b ? a : b and Max(a, b) is a > b ? a : b, lane by lane;
+// either returns b when a comparison involves NaN.
+inline Lanes Min(Lanes a, Lanes b) {
+  return _mm256_min_ps(a, b);
+}
+inline Lanes Max(Lanes a, Lanes b) {
+  return _mm256_max_ps(a, b);
+}
+inline Lanes NotLess(Lanes a, Lanes b) {
+  return _mm256_cmp_ps(a, b, _CMP_NLT_UQ);
+}
+inline Lanes NotGreater(Lanes a, Lanes b) {
+  return _mm256_cmp_ps(a, b, _CMP_NGT_UQ);
+}
+inline Lanes GreaterEqual(Lanes a, Lanes b) {
+  return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+inline Lanes Less(Lanes a, Lanes b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+inline unsigned int MoveMask(Lanes a) {
+  return static_cast<unsigned int>(_mm256_movemask_ps(a));
+}
+#elif defined(GLOO_SIMD_SSE)
+const size_t kLaneWidth = 4;
+typedef __m128 Lanes;
+inline Lanes Load(const float* p) {
+  return _mm_loadu_ps(p);
+}
+inline Lanes Splat(float x) {
+  return _mm_set1_ps(x);
+}
+inline void Store(float* p, Lanes a) {
+  _mm_storeu_ps(p, a);
+}
+inline Lanes Add(Lanes a, Lanes b) {
+  return _mm_add_ps(a, b);
+}
+inline Lanes Sub(Lanes a, Lanes b) {
+  return _mm_sub_ps(a, b);
+}
+inline Lanes Mul(Lanes a, Lanes b) {
+  return _mm_mul_ps(a, b);
+}
+inline Lanes Div(Lanes a, Lanes b) {
+  return _mm_div_ps(a, b);
+}
+inline Lanes And(Lanes a, Lanes b) {
+  return _mm_and_ps(a, b);
+}
+inline Lanes Min(Lanes a, Lanes b) {
+  return _mm_min_ps(a, b);
+}
+inline Lanes Max(Lanes a, Lanes b) {
+  return _mm_max_ps(a, b);
+}
+inline Lanes NotLess(Lanes a, Lanes b) {
+  return _mm_cmpnlt_ps(a, b);
+}
+inline Lanes NotGreater(Lanes a, Lanes b) {
+  return _mm_cmpngt_ps(a, b);
+}
+inline Lanes GreaterEqual(Lanes a, Lanes b) {
+  return _mm_cmpge_ps(a, b);
+}
+inline Lanes Less(Lanes a, Lanes b) {
+  return _mm_cmplt_ps(a, b);
+}
+inline unsigned int MoveMask(Lanes a) {
+  return static_cast<unsigned int>(_mm_movemask_ps(a));
+}
+#else
+// Without SIMD support callers fall back to scalar loops over this width.
+const size_t kLaneWidth = 4;
+#endif
+}  // namespace simd
+}  // namespace GLOO
+
+#endif
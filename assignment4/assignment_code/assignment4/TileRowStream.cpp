@@ -0,0 +1,105 @@
+#include "TileRowStream.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "gloo/utils.hpp"
+
+namespace GLOO {
+TileRowStream::Row::Row(size_t width,
+                        size_t y0,
+                        size_t height,
+                        bool keep_sample_counts)
+    : y0(y0),
+      image(width, height),
+      sample_counts(keep_sample_counts ? width * height : 0),
+      tiles_left(0) {
+}
+
+TileRowStream::TileRowStream(ImageRowWriter& writer,
+                             const glm::ivec2& image_size,
+                             const glm::ivec2& tile_size,
+                             size_t max_rows_in_flight,
+                             bool keep_sample_counts)
+    : writer_(writer),
+      image_size_(image_size),
+      tile_size_(tile_size),
+      row_count_((image_size.y + tile_size.y - 1) / tile_size.y),
+      tiles_per_row_((image_size.x + tile_size.x - 1) / tile_size.x),
+      max_rows_in_flight_(std::max<size_t>(1, max_rows_in_flight)),
+      keep_sample_counts_(keep_sample_counts),
+      next_row_(0),
+      writing_(false),
+      aborted_(false),
+      total_samples_(0) {
+}
+
+size_t TileRowStream::GetRowIndex(const Tile& tile) const {
+  return row_count_ - 1 - tile.y0 / tile_size_.y;
+}
+
+TileRowStream::Row& TileRowStream::Acquire(const Tile& tile) {
+  size_t index = GetRowIndex(tile);
+  std::unique_lock<std::mutex> lock(mutex_);
+  row_written_.wait(lock, [&]() {
+    return aborted_ || index < next_row_ + max_rows_in_flight_;
+  });
+  if (aborted_) {
+    throw std::runtime_error("Streaming output was aborted!");
+  }
+  std::unique_ptr<Row>& row = rows_[index];
+  if (row == nullptr) {
+    size_t y0 = tile.y0;
+    size_t y1 = std::min<size_t>(y0 + tile_size_.y, image_size_.y);
+    row = make_unique<Row>(image_size_.x, y0, y1 - y0, keep_sample_counts_);
+    row->tiles_left = tiles_per_row_;
+  }
+  return *row;
+}
+
+void TileRowStream::Release(const Tile& tile) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  rows_[GetRowIndex(tile)]->tiles_left--;
+  if (writing_) {
+    // The writing worker checks for complete rows after each write.
+    return;
+  }
+  writing_ = true;
+  // Clears writing_ however the loop is left, so that a failed write does
+  // not keep every later Release from writing.
+  struct WritingReset {
+    TileRowStream& stream;
+    std::unique_lock<std::mutex>& lock;
+    ~WritingReset() {
+      if (!lock.owns_lock()) {
+        lock.lock();
+      }
+      stream.writing_ = false;
+    }
+  } writing_reset = {*this, lock};
+  while (true) {
+    auto next = rows_.find(next_row_);
+    if (next == rows_.end() || next->second->tiles_left > 0) {
+      break;
+    }
+    std::unique_ptr<Row> row = std::move(next->second);
+    rows_.erase(next);
+    lock.unlock();
+    writer_.WriteRows(row->image);
+    size_t samples = 0;
+    for (size_t count : row->sample_counts) {
+      samples += count;
+    }
+    lock.lock();
+    total_samples_ += samples;
+    next_row_++;
+    row_written_.notify_all();
+  }
+}
+
+void TileRowStream::Abort() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  aborted_ = true;
+  row_written_.notify_all();
+}
+}  // namespace GLOO
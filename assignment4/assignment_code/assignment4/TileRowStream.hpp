@@ -0,0 +1,77 @@
+#ifndef TILE_ROW_STREAM_H_
+#define TILE_ROW_STREAM_H_
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "gloo/Image.hpp"
+
+#include "ImageRowWriter.hpp"
+#include "TileScheduler.hpp"
+
+namespace GLOO {
+// Buffers the rows of tiles being rendered and hands each one to an
+// ImageRowWriter as soon as it and every row above it are done, so memory
+// is bounded by the rows in flight rather than by the image. Meant for
+// tiles handed out in TileScheduler's top_down_rows order. A worker about
+// to start a tile more than max_rows_in_flight rows ahead of the next row
+// to write waits until that row is written.
+class TileRowStream {
+ public:
+  // Pixel rows [y0, y0 + image.GetHeight()) of the image, and if sample
+  // counts are kept, the samples taken per pixel in the same layout.
+  struct Row {
+    Row(size_t width, size_t y0, size_t height, bool keep_sample_counts);
+
+    size_t y0;
+    Image image;
+    std::vector<size_t> sample_counts;
+    size_t tiles_left;
+  };
+
+  TileRowStream(ImageRowWriter& writer,
+                const glm::ivec2& image_size,
+                const glm::ivec2& tile_size,
+                size_t max_rows_in_flight,
+                bool keep_sample_counts);
+
+  // Returns the row that the tile belongs to, waiting while it is too far
+  // ahead. Throws if the stream was aborted.
+  Row& Acquire(const Tile& tile);
+  // Marks the tile as rendered and writes out the rows that are complete.
+  void Release(const Tile& tile);
+  // Wakes up waiting workers, which then throw, after another one failed.
+  void Abort();
+
+  // Samples taken in the rows written so far.
+  size_t GetTotalSamples() const {
+    return total_samples_;
+  }
+
+ private:
+  // Rows are numbered in the order they are written, from the top down.
+  size_t GetRowIndex(const Tile& tile) const;
+
+  ImageRowWriter& writer_;
+  glm::ivec2 image_size_;
+  glm::ivec2 tile_size_;
+  size_t row_count_;
+  size_t tiles_per_row_;
+  size_t max_rows_in_flight_;
+  bool keep_sample_counts_;
+
+  std::mutex mutex_;
+  std::condition_variable row_written_;
+  std::map<size_t, std::unique_ptr<Row>> rows_;
+  size_t next_row_;
+  // Whether a worker is writing rows; the others leave it to that one.
+  bool writing_;
+  bool aborted_;
+  size_t total_samples_;
+};
+}  // namespace GLOO
+
+#endif
@@ -0,0 +1,88 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "gloo/utils.hpp"
+
+namespace GLOO {
+TileScheduler::TileScheduler(const glm::ivec2& image_size,
+                             const glm::ivec2& tile_size,
+                             size_t num_workers,
+                             bool top_down_rows)
+    : tile_count_(0), top_down_rows_(top_down_rows) {
+  if (tile_size.x <= 0 || tile_size.y <= 0 || num_workers == 0) {
+    throw std::invalid_argument("Bad tile size or worker count!");
+  }
+
+  std::vector<Tile> tiles;
+  for (int y = 0; y < image_size.y; y += tile_size.y) {
+    for (int x = 0; x < image_size.x; x += tile_size.x) {
+      Tile tile;
+      tile.x0 = x;
+      tile.y0 = y;
+      tile.x1 = std::min(x + tile_size.x, image_size.x);
+      tile.y1 = std::min(y + tile_size.y, image_size.y);
+      tiles.push_back(tile);
+    }
+  }
+  tile_count_ = tiles.size();
+
+  if (top_down_rows_) {
+    // Tiles are in rows from the bottom up; reverse the rows only.
+    size_t row_size = (image_size.x + tile_size.x - 1) / tile_size.x;
+    queues_.push_back(make_unique<WorkQueue>());
+    for (size_t end = tile_count_; end > 0; end -= row_size) {
+      queues_[0]->tiles.insert(queues_[0]->tiles.end(),
+                               tiles.begin() + (end - row_size),
+                               tiles.begin() + end);
+    }
+    return;
+  }
+
+  // Give each worker a contiguous, spatially coherent run of tiles.
+  for (size_t i = 0; i < num_workers; i++) {
+    queues_.push_back(make_unique<WorkQueue>());
+    size_t begin = tile_count_ * i / num_workers;
+    size_t end = tile_count_ * (i + 1) / num_workers;
+    queues_[i]->tiles.assign(tiles.begin() + begin, tiles.begin() + end);
+  }
+}
+
+bool TileScheduler::Next(size_t worker, Tile& tile) {
+  if (top_down_rows_) {
+    return PopFront(*queues_[0], tile);
+  }
+  if (PopFront(*queues_[worker], tile)) {
+    return true;
+  }
+  // Steal from the back so the victim keeps its coherent front.
+  for (size_t i = 1; i < queues_.size(); i++) {
+    size_t victim = (worker + i) % queues_.size();
+    if (PopBack(*queues_[victim], tile)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TileScheduler::PopFront(WorkQueue& queue, Tile& tile) {
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tiles.empty()) {
+    return false;
+  }
+  tile = queue.tiles.front();
+  queue.tiles.pop_front();
+  return true;
+}
+
+bool TileScheduler::PopBack(WorkQueue& queue, Tile& tile) {
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tiles.empty()) {
+    return false;
+  }
+  tile = queue.tiles.back();
+  queue.tiles.pop_back();
+  return true;
+}
+}  // namespace GLOO
@@ -0,0 +1,55 @@
+#ifndef TILE_SCHEDULER_H_
+#define TILE_SCHEDULER_H_
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace GLOO {
+// Half-open pixel rectangle [x0, x1) x [y0, y1).
+struct Tile {
+  size_t x0, y0;
+  size_t x1, y1;
+};
+
+// Cuts the image into tiles and hands them out to worker threads. Every
+// worker starts with a contiguous run of tiles in its own queue; once the
+// queue runs dry it steals from the back of the other workers' queues, so a
+// worker stuck on expensive tiles does not hold up the frame.
+//
+// With top_down_rows, all workers instead take tiles from one queue in
+// order, row of tiles by row of tiles from the top of the image (largest y)
+// down, so that rows finish roughly in the order they are written out.
+class TileScheduler {
+ public:
+  TileScheduler(const glm::ivec2& image_size,
+                const glm::ivec2& tile_size,
+                size_t num_workers,
+                bool top_down_rows = false);
+
+  // Returns false once every tile has been handed out.
+  bool Next(size_t worker, Tile& tile);
+
+  size_t GetTileCount() const {
+    return tile_count_;
+  }
+
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Tile> tiles;
+  };
+
+  bool PopFront(WorkQueue& queue, Tile& tile);
+  bool PopBack(WorkQueue& queue, Tile& tile);
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  size_t tile_count_;
+  bool top_down_rows_;
+};
+}  // namespace GLOO
+
+#endif
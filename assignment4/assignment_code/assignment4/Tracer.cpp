@@ -3,177 +3,959 @@
 #include <glm/gtx/string_cast.hpp>
 #include <stdexcept>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <set>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "gloo/Transform.hpp"
-#include "gloo/components/MaterialComponent.hpp"
 #include "gloo/lights/AmbientLight.hpp"
+#include "gloo/utils.hpp"
 
-#include "gloo/Image.hpp"
-#include "Illuminator.hpp"
+#include "ImageRowWriter.hpp"
+#include "TileRowStream.hpp"
+#include "hittable/Mesh.hpp"
+
+namespace {
+// Point lights closer than this (squared) to a hit point are weighted as if
+// they were this far, so that light sampling weights stay finite.
+const float kMinLightDistance2 = 1e-4f;
+}  // namespace
 
 namespace GLOO {
-void Tracer::Render(const Scene& scene, const std::string& output_file) {
+std::string Tracer::GetStatsFileName(const std::string& output_file) {
+  size_t slash = output_file.find_last_of("/\\");
+  size_t dot = output_file.find_last_of('.');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    dot = output_file.size();
+  }
+  return output_file.substr(0, dot) + ".stats.json";
+}
+
+void Tracer::SaveImage(const Image& image,
+                       const std::string& output_file,
+                       bool srgb) {
+  if (HasExtension(output_file, ".pfm")) {
+    image.SavePFM(output_file);
+  } else if (HasExtension(output_file, ".ppm")) {
+    std::unique_ptr<ImageRowWriter> writer = ImageRowWriter::Create(
+        output_file, image.GetWidth(), image.GetHeight(), srgb);
+    writer->WriteRows(image);
+    writer->Finish();
+  } else {
+    image.SavePNG(output_file, srgb);
+  }
+}
+
+void Tracer::Prepare(const Scene& scene) {
+  bool same_scene = scene_ptr_ == &scene;
   scene_ptr_ = &scene;
+  stats_ = RenderStats();
+  stats_.width = image_size_.x;
+  stats_.height = image_size_.y;
+  stats_.samples = samples_;
+  stats_.profiled = options_.profile;
 
   auto& root = scene_ptr_->GetRootNode();
   tracing_components_ = root.GetComponentPtrsInChildren<TracingComponent>();
-  light_components_ = root.GetComponentPtrsInChildren<LightComponent>();
+  auto light_components = root.GetComponentPtrsInChildren<LightComponent>();
+  auto build_start = std::chrono::steady_clock::now();
+  // Shading only reads these tables, never the scene graph.
+  compiled_scene_.Compile(tracing_components_, light_components);
+  stats_.scene_refit =
+      options_.refit_threshold > 0.0f && same_scene &&
+      scene_bvh_.Refit(tracing_components_, options_.refit_threshold);
+  if (!stats_.scene_refit) {
+    scene_bvh_.Build(tracing_components_);
+  }
+  if (UsesLightBVH()) {
+    light_bvh_.Build(compiled_scene_.GetLights(), options_.light_threshold);
+  }
+  stats_.scene_build_ms = MsSince(build_start);
+  // Meshes built their acceleration structures when they were created.
+  std::set<const Mesh*> meshes;
+  for (TracingComponent* component : tracing_components_) {
+    auto mesh = dynamic_cast<const Mesh*>(&component->GetHittable());
+    if (mesh != nullptr && meshes.insert(mesh).second) {
+      stats_.mesh_build_ms += mesh->GetAcceleratorStats().build_ms;
+      stats_.mesh_load_ms += mesh->GetAcceleratorStats().load_ms;
+    }
+  }
 
+  if (options_.packet_size * options_.packet_size > RayPacket::kMaxSize) {
+    throw std::invalid_argument("Packet size must be at most 8!");
+  }
+  bool adaptive = options_.adaptive_max_samples > 0;
+  if (adaptive) {
+    if (options_.adaptive_min_samples < 2 ||
+        options_.adaptive_min_samples > options_.adaptive_max_samples) {
+      throw std::invalid_argument(
+          "Adaptive sampling needs 2 <= min samples <= max samples!");
+    }
+    if (options_.packet_size > 0) {
+      throw std::invalid_argument(
+          "Adaptive sampling cannot be combined with packets!");
+    }
+  }
+  // Cube map lookups are filtered over the footprint of a camera sample,
+  // which reflected rays keep as well. An image one pixel wide or high has
+  // no pixel spacing to derive it from and is left unfiltered.
+  background_footprint_ = 0.0f;
+  if (options_.filter_background &&
+      std::min(image_size_.x, image_size_.y) > 1) {
+    size_t pixel_samples = std::max<size_t>(
+        1, adaptive ? options_.adaptive_min_samples : samples_);
+    float spacing = 2.0f / (std::min(image_size_.x, image_size_.y) - 1);
+    background_footprint_ = camera_->GetSpreadAngle(spacing) /
+                            std::sqrt(float(pixel_samples));
+  }
+  if (options_.wavefront && (adaptive || options_.packet_size > 0)) {
+    throw std::invalid_argument(
+        "The wavefront renderer cannot be combined with adaptive sampling "
+        "or packets!");
+  }
+}
 
-  Image image(image_size_.x, image_size_.y);
-  int total_pixels = image_size_.x * image_size_.y;
-  int current_pixel = 0,progress = 0;
+void Tracer::Render(const Scene& scene, const std::string& output_file) {
+  Prepare(scene);
+  size_t num_threads = options_.threads;
+  bool adaptive = options_.adaptive_max_samples > 0;
+  bool streaming = options_.stream_output && output_file.size();
+  if (streaming && options_.heatmap_file.size()) {
+    throw std::invalid_argument(
+        "Heatmaps cannot be combined with streaming output!");
+  }
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // Without streaming, the whole image and its sample counts are kept.
+  std::unique_ptr<Image> image;
+  std::vector<size_t> sample_counts;
+  std::unique_ptr<ImageRowWriter> row_writer;
+  std::unique_ptr<TileRowStream> row_stream;
+  if (streaming) {
+    row_writer = ImageRowWriter::Create(output_file, image_size_.x,
+                                        image_size_.y, options_.srgb_output);
+    // Enough rows for every worker to be busy while one row holds up the
+    // rest.
+    size_t tiles_per_row = (image_size_.x + options_.tile_size.x - 1) /
+                           std::max(1, options_.tile_size.x);
+    size_t max_rows = 2 + num_threads / std::max<size_t>(1, tiles_per_row);
+    row_stream = make_unique<TileRowStream>(
+        *row_writer, image_size_, options_.tile_size, max_rows, adaptive);
+  } else {
+    image = make_unique<Image>(image_size_.x, image_size_.y);
+    sample_counts.resize(adaptive ? image_size_.x * image_size_.y : 0);
+  }
+  TileScheduler scheduler(image_size_, options_.tile_size, num_threads,
+                          streaming);
+  size_t total_pixels = image_size_.x * image_size_.y;
 
-  auto randf = []() {
-    return static_cast<float>(rand()) / RAND_MAX - 0.5f; // in [-0.5,0.5)
-  };
+  std::mutex progress_mutex;
+  size_t current_pixel = 0;
+  int progress = 0;
+  std::exception_ptr error;
+  stats_.per_worker.resize(num_threads);
 
-  auto sample_color = [&](size_t x, size_t y,bool randomize = true) {
-    float u = x / (image_size_.x - 1);
-    float v = y / (image_size_.y - 1);
-    if (randomize) {
-      u = (x + randf()) / (image_size_.x - 1);
-      v = (y + randf()) / (image_size_.y - 1);
-    }
-    //make range to [-1,1]
-    u = 2.0f * u - 1.0f;
-    v = 2.0f * v - 1.0f;
-    Ray ray = camera_->GenerateRay(glm::vec2(u, v));
-    HitRecord record;
-    record.time = std::numeric_limits<float>::max();
-    return TraceRay(ray, max_bounces_, record);
+  auto worker = [&](size_t worker_id) {
+    RenderCounters& counters = RenderCounters::Local();
+    counters.Clear();
+    try {
+      Tile tile;
+      while (scheduler.Next(worker_id, tile)) {
+        auto tile_start = std::chrono::steady_clock::now();
+        if (streaming) {
+          TileRowStream::Row& row = row_stream->Acquire(tile);
+          RenderTile(tile, row.image, row.y0,
+                     adaptive ? row.sample_counts.data() : nullptr);
+          row_stream->Release(tile);
+        } else {
+          RenderTile(tile, *image, 0,
+                     adaptive ? sample_counts.data() : nullptr);
+        }
+        double tile_ms = MsSince(tile_start);
+
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        stats_.tiles.push_back({tile, worker_id, tile_ms});
+        current_pixel += (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+        float fprogress = 100.0f * current_pixel / total_pixels;
+        if (fprogress > progress + 1) {
+          progress = fprogress;
+          std::cout << "Rendered: " << progress << "%" << std::endl;
+        }
+      }
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      if (row_stream) {
+        row_stream->Abort();
+      }
+    }
+    stats_.per_worker[worker_id] = counters;
   };
-  for (size_t y = 0; y < image_size_.y; y++) {
-    for (size_t x = 0; x < image_size_.x; x++) {
+
+  auto render_start = std::chrono::steady_clock::now();
+
+  if (num_threads == 1) {
+    worker(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back(worker, i);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  stats_.render_ms = MsSince(render_start);
+  for (const RenderCounters& counters : stats_.per_worker) {
+    stats_.totals.Add(counters);
+  }
+  const RenderCounters& totals = stats_.totals;
+  uint64_t total_rays =
+      totals.primary_rays + totals.shadow_rays + totals.bounce_rays;
+  std::cout << "Traced " << total_rays << " rays (" << totals.primary_rays
+            << " primary, " << totals.shadow_rays << " shadow, "
+            << totals.bounce_rays << " bounce) in " << stats_.render_ms
+            << " ms, " << total_rays / (stats_.render_ms * 1e3)
+            << " Mrays/s" << std::endl;
+  if (UsesLightBVH() && totals.shaded_hits > 0) {
+    std::cout << "Shaded " << double(totals.shaded_lights) / totals.shaded_hits
+              << " of " << light_bvh_.GetLightCount()
+              << " lights per hit point" << std::endl;
+  }
+
+  if (streaming) {
+    row_writer->Finish();
+  } else if (output_file.size()) {
+    SaveImage(*image, output_file, options_.srgb_output);
+  }
+  if (output_file.size()) {
+    stats_.WriteJson(GetStatsFileName(output_file));
+  }
+
+  if (adaptive) {
+    size_t total_samples = streaming ? row_stream->GetTotalSamples() : 0;
+    for (size_t count : sample_counts) {
+      total_samples += count;
+    }
+    std::cout << "Average samples per pixel: "
+              << float(total_samples) / total_pixels << std::endl;
+    if (options_.heatmap_file.size()) {
+      SaveHeatmap(sample_counts);
+    }
+  }
+}
+
+void Tracer::SaveHeatmap(const std::vector<size_t>& sample_counts) const {
+  Image heatmap(image_size_.x, image_size_.y);
+  float max_samples = float(options_.adaptive_max_samples);
+  for (size_t y = 0; y < size_t(image_size_.y); y++) {
+    for (size_t x = 0; x < size_t(image_size_.x); x++) {
+      float t = sample_counts[y * image_size_.x + x] / max_samples;
+      // Black -> red -> yellow -> white as t goes from 0 to 1.
+      glm::vec3 color(3.0f * t, 3.0f * t - 1.0f, 3.0f * t - 2.0f);
+      heatmap.SetPixel(x, y, glm::clamp(color, 0.0f, 1.0f));
+    }
+  }
+  heatmap.SavePNG(options_.heatmap_file);
+}
+
+void Tracer::RenderTile(const Tile& tile,
+                        Image& image,
+                        size_t image_y0,
+                        size_t* sample_counts) const {
+  if (sample_counts != nullptr) {
+    for (size_t y = tile.y0; y < tile.y1; y++) {
+      for (size_t x = tile.x0; x < tile.x1; x++) {
+        glm::vec3 color = SamplePixelAdaptive(
+            x, y, sample_counts[(y - image_y0) * image_size_.x + x]);
+        image.SetPixel(x, y - image_y0, color);
+      }
+    }
+    return;
+  }
+  if (options_.wavefront) {
+    RenderTileWavefront(tile, image, image_y0);
+    return;
+  }
+  if (options_.packet_size > 0) {
+    RenderTilePackets(tile, image, image_y0);
+    return;
+  }
+  for (size_t y = tile.y0; y < tile.y1; y++) {
+    for (size_t x = tile.x0; x < tile.x1; x++) {
+      // Seeding per pixel keeps the image independent of the tile schedule.
+      Random rng(Random::ForPixel(options_.seed, x, y));
+      glm::vec3 color(0.0f);
+      for (size_t s = 0; s < samples_; s++) {
+        color += SamplePixel(x, y, rng);
+      }
+      color /= samples_;
+      // Set the pixel color in the image
+      image.SetPixel(x, y - image_y0, color);
+    }
+  }
+}
+
+void Tracer::RenderTilePackets(const Tile& tile,
+                               Image& image,
+                               size_t image_y0) const {
+  size_t block = options_.packet_size;
+  for (size_t y0 = tile.y0; y0 < tile.y1; y0 += block) {
+    for (size_t x0 = tile.x0; x0 < tile.x1; x0 += block) {
+      size_t x1 = std::min(x0 + block, tile.x1);
+      size_t y1 = std::min(y0 + block, tile.y1);
+      // Every pixel keeps its own generator, so it sees the same samples as
+      // in RenderTile.
+      std::vector<Random> rngs;
+      for (size_t y = y0; y < y1; y++) {
+        for (size_t x = x0; x < x1; x++) {
+          rngs.emplace_back(Random::ForPixel(options_.seed, x, y));
+        }
+      }
+      glm::vec3 colors[RayPacket::kMaxSize];
+      std::fill(colors, colors + rngs.size(), glm::vec3(0.0f));
+      RayPacket packet;
+      glm::vec3 sample_colors[RayPacket::kMaxSize];
+      for (size_t s = 0; s < samples_; s++) {
+        packet.Clear();
+        size_t i = 0;
+        for (size_t y = y0; y < y1; y++) {
+          for (size_t x = x0; x < x1; x++) {
+            packet.Add(GenerateSampleRay(x, y, rngs[i++]));
+          }
+        }
+        TracePacket(packet, sample_colors);
+        for (i = 0; i < rngs.size(); i++) {
+          colors[i] += sample_colors[i];
+        }
+      }
+      size_t i = 0;
+      for (size_t y = y0; y < y1; y++) {
+        for (size_t x = x0; x < x1; x++) {
+          image.SetPixel(x, y - image_y0, colors[i++] / float(samples_));
+        }
+      }
+    }
+  }
+}
+
+void Tracer::RenderTileWavefront(const Tile& tile,
+                                 Image& image,
+                                 size_t image_y0) const {
+  // Path p is sample p % samples_ of pixel p / samples_, counted in
+  // scanline order within the tile. Every hit of a path leaves a vertex:
+  // its direct light, or the background or magenta where the path ends,
+  // and the specular color that scales the light of the next vertex.
+  size_t width = tile.x1 - tile.x0;
+  size_t num_pixels = width * (tile.y1 - tile.y0);
+  size_t num_paths = num_pixels * samples_;
+  size_t max_vertices = max_bounces_ + 1;
+  std::vector<glm::vec3> vertex_light(num_paths * max_vertices);
+  std::vector<glm::vec3> vertex_specular(num_paths * max_vertices);
+  std::vector<uint32_t> path_lengths(num_paths, 0);
+  size_t num_lights = compiled_scene_.GetLights().size();
+  bool trace_shadows = shadows_enabled_ && !UsesLightBVH();
+
+  // Generate: camera rays in the order RenderTile takes their samples.
+  RayQueue queue;
+  queue.rays.reserve(num_paths);
+  queue.paths.reserve(num_paths);
+  for (size_t y = tile.y0; y < tile.y1; y++) {
+    for (size_t x = tile.x0; x < tile.x1; x++) {
+      Random rng(Random::ForPixel(options_.seed, x, y));
+      size_t pixel = (y - tile.y0) * width + (x - tile.x0);
+      for (size_t s = 0; s < samples_; s++) {
+        queue.Push(GenerateSampleRay(x, y, rng),
+                   static_cast<uint32_t>(pixel * samples_ + s));
+      }
+    }
+  }
+  RenderCounters::Local().primary_rays += num_paths;
+
+  RayQueue next;
+  std::vector<const CompiledMaterial*> materials;
+  std::unique_ptr<bool[]> light_visible;
+  std::vector<glm::vec3> miss_directions;
+  std::vector<glm::vec3> miss_colors;
+  std::vector<uint32_t> miss_paths;
+  for (size_t depth = 0; queue.GetSize() > 0; depth++) {
+    size_t num_rays = queue.GetSize();
+    // Extend: closest hits of the whole wave.
+    ExtendWave(queue);
+    materials.resize(num_rays);
+    for (size_t i = 0; i < num_rays; i++) {
+      materials[i] = queue.hits[i] ? GetMaterial(*queue.hits[i]) : nullptr;
+    }
+    // Shadow: one sweep over the wave per light.
+    if (trace_shadows) {
+      light_visible.reset(new bool[num_rays * num_lights]);
+      TraceWaveShadows(queue, materials.data(), light_visible.get());
+    }
+    // Shade: direct light at the hits, reflected rays into the next wave.
+    next.Clear();
+    miss_directions.clear();
+    miss_paths.clear();
+    for (size_t i = 0; i < num_rays; i++) {
+      uint32_t path = queue.paths[i];
+      size_t vertex = path * max_vertices + depth;
+      const Ray& ray = queue.rays[i];
+      if (queue.hits[i] == nullptr) {
+        miss_directions.push_back(ray.GetDirection());
+        miss_paths.push_back(path);
+        path_lengths[path] = static_cast<uint32_t>(depth + 1);
+        continue;
+      }
+      const CompiledMaterial* material = materials[i];
+      path_lengths[path] = static_cast<uint32_t>(depth + 1);
+      if (material == nullptr) {
+        vertex_light[vertex] = glm::vec3(1.0f, 0.0f, 1.0f);
+        continue;
+      }
+      const HitRecord& record = queue.records[i];
+      vertex_light[vertex] = ShadeDirect(
+          ray, record, *material,
+          trace_shadows ? light_visible.get() + i * num_lights : nullptr);
+      vertex_specular[vertex] = material->specular_color;
+      // Bounce: the reflected ray, if the path may go on.
+      if (depth < max_bounces_) {
+        next.Push(Ray(ray.At(record.time),
+                      glm::reflect(ray.GetDirection(), record.normal)),
+                  path);
+      }
+    }
+    RenderCounters::Local().bounce_rays += next.GetSize();
+    miss_colors.resize(miss_directions.size());
+    GetBackgroundColors(miss_directions.data(), miss_directions.size(),
+                        miss_colors.data());
+    for (size_t i = 0; i < miss_paths.size(); i++) {
+      vertex_light[miss_paths[i] * max_vertices + depth] = miss_colors[i];
+    }
+    std::swap(queue, next);
+  }
+
+  // Each path's color folds its vertices from the last one back, as the
+  // recursion of TraceRay adds them up, and each pixel averages its samples
+  // in order, so the image is the same as RenderTile's.
+  for (size_t y = tile.y0; y < tile.y1; y++) {
+    for (size_t x = tile.x0; x < tile.x1; x++) {
+      size_t pixel = (y - tile.y0) * width + (x - tile.x0);
       glm::vec3 color(0.0f);
-      if(samples_ == 1) {
-        color = sample_color(x, y);
+      for (size_t s = 0; s < samples_; s++) {
+        size_t path = pixel * samples_ + s;
+        const glm::vec3* light = &vertex_light[path * max_vertices];
+        const glm::vec3* specular = &vertex_specular[path * max_vertices];
+        size_t last = path_lengths[path] - 1;
+        glm::vec3 path_color = light[last];
+        for (size_t d = last; d-- > 0;) {
+          glm::vec3 final_color = light[d];
+          final_color += path_color * specular[d];
+          path_color = final_color;
+        }
+        color += path_color;
+      }
+      color /= samples_;
+      image.SetPixel(x, y - image_y0, color);
+    }
+  }
+}
+
+void Tracer::ExtendWave(RayQueue& queue) const {
+  size_t num_rays = queue.GetSize();
+  queue.records.assign(num_rays, HitRecord());
+  queue.hits.assign(num_rays, nullptr);
+  // Consecutive rays come from neighboring pixels, or from one bounce off
+  // neighboring hits, so runs of them are traced as packets where they
+  // point into the same octant.
+  RayPacket packet;
+  for (size_t begin = 0; begin < num_rays; begin += RayPacket::kMaxSize) {
+    size_t end = std::min(num_rays, begin + RayPacket::kMaxSize);
+    packet.Clear();
+    for (size_t i = begin; i < end; i++) {
+      packet.Add(queue.rays[i]);
+    }
+    TraversalTimer timer(options_.profile);
+    if (packet.IsCoherent(packet.GetFullMask())) {
+      scene_bvh_.IntersectPacket(packet, packet.GetFullMask(), 0.001f,
+                                 &queue.records[begin], &queue.hits[begin]);
+    } else {
+      for (size_t i = begin; i < end; i++) {
+        queue.hits[i] =
+            scene_bvh_.Intersect(queue.rays[i], 0.001f, queue.records[i]);
+      }
+    }
+  }
+}
+
+void Tracer::TraceWaveShadows(const RayQueue& queue,
+                              const CompiledMaterial* const* materials,
+                              bool* light_visible) const {
+  size_t num_rays = queue.GetSize();
+  size_t num_lights = compiled_scene_.GetLights().size();
+  // Rays i whose hits get shaded, and their shadow rays toward one light.
+  std::vector<uint32_t> shaded;
+  for (size_t i = 0; i < num_rays; i++) {
+    if (materials[i] != nullptr) {
+      shaded.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  RayPacket packet;
+  float max_t[RayPacket::kMaxSize];
+  for (size_t l = 0; l < num_lights; l++) {
+    const CompiledLight& light = compiled_scene_.GetLights()[l];
+    if (light.type == LightType::Ambient) {
+      for (uint32_t i : shaded) {
+        light_visible[i * num_lights + l] = true;
+      }
+      continue;
+    }
+    for (size_t begin = 0; begin < shaded.size();
+         begin += RayPacket::kMaxSize) {
+      size_t end = std::min(shaded.size(), begin + RayPacket::kMaxSize);
+      packet.Clear();
+      for (size_t k = begin; k < end; k++) {
+        const Ray& ray = queue.rays[shaded[k]];
+        glm::vec3 hit_pos = ray.At(queue.records[shaded[k]].time);
+        glm::vec3 light_intensity;
+        glm::vec3 dir_to_light;
+        float dist_to_light;
+        CompiledScene::GetIllumination(light, hit_pos, dir_to_light,
+                                       light_intensity, dist_to_light);
+        packet.Add(Ray(hit_pos, dir_to_light));
+        // Only occluders in front of the light count.
+        max_t[k - begin] = dist_to_light / glm::length(dir_to_light);
+      }
+      uint64_t occluded = 0;
+      if (packet.IsCoherent(packet.GetFullMask())) {
+        RenderCounters::Local().shadow_rays += end - begin;
+        TraversalTimer timer(options_.profile);
+        occluded = scene_bvh_.OccludedPacket(packet, packet.GetFullMask(),
+                                             0.001f, max_t);
       } else {
-        for (int s = 0; s < samples_; s++) {
-          color += sample_color(x, y);
+        for (size_t k = begin; k < end; k++) {
+          if (InShadow(packet.GetRay(k - begin), max_t[k - begin])) {
+            occluded |= uint64_t(1) << (k - begin);
+          }
         }
-        color /= samples_;
       }
-      // Set the pixel color in the image
-      image.SetPixel(x, y, color);
-      current_pixel++;
+      for (size_t k = begin; k < end; k++) {
+        light_visible[shaded[k] * num_lights + l] =
+            !((occluded >> (k - begin)) & 1);
+      }
     }
-    float fprogress = 100.0f * current_pixel / total_pixels;
-    if (fprogress > progress + 1) {
-      progress = fprogress;
-      std::cout << "Rendered: " << progress << "%" << std::endl;
+  }
+}
+
+void Tracer::RenderTileImage(const Tile& tile, Image& pixels) const {
+  // RenderTile writes whole-width rows.
+  size_t width = tile.x1 - tile.x0;
+  size_t height = tile.y1 - tile.y0;
+  Image rows(image_size_.x, height);
+  std::vector<size_t> sample_counts(
+      options_.adaptive_max_samples > 0 ? image_size_.x * height : 0);
+  RenderTile(tile, rows, tile.y0,
+             sample_counts.empty() ? nullptr : sample_counts.data());
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      pixels.SetPixel(x, y, rows.GetPixel(tile.x0 + x, y));
+    }
+  }
+}
+
+Ray Tracer::GenerateSampleRay(size_t x, size_t y, Random& rng) const {
+  // Jitter within the pixel, in [-0.5,0.5).
+  float u = (x + rng.NextFloat() - 0.5f) / (image_size_.x - 1);
+  float v = (y + rng.NextFloat() - 0.5f) / (image_size_.y - 1);
+  //make range to [-1,1]
+  u = 2.0f * u - 1.0f;
+  v = 2.0f * v - 1.0f;
+  return camera_->GenerateRay(glm::vec2(u, v));
+}
+
+glm::vec3 Tracer::SamplePixel(size_t x, size_t y, Random& rng) const {
+  Ray ray = GenerateSampleRay(x, y, rng);
+  RenderCounters::Local().primary_rays++;
+  HitRecord record;
+  record.time = std::numeric_limits<float>::max();
+  return TraceRay(ray, max_bounces_, record);
+}
+
+glm::vec3 Tracer::SamplePixelAdaptive(size_t x,
+                                      size_t y,
+                                      size_t& num_samples) const {
+  Random rng(Random::ForPixel(options_.seed, x, y));
+  // Welford's running mean and sum of squared deviations, per channel.
+  glm::vec3 mean(0.0f);
+  glm::vec3 m2(0.0f);
+  size_t n = 0;
+  while (n < options_.adaptive_max_samples) {
+    glm::vec3 color = SamplePixel(x, y, rng);
+    n++;
+    glm::vec3 delta = color - mean;
+    mean += delta / float(n);
+    m2 += delta * (color - mean);
+    if (n >= options_.adaptive_min_samples) {
+      // Standard error of the mean in the noisiest channel.
+      float variance = std::max(std::max(m2.x, m2.y), m2.z) / (n - 1);
+      if (std::sqrt(variance / n) <= options_.adaptive_threshold) {
+        break;
+      }
+    }
+  }
+  num_samples = n;
+  return mean;
+}
+
+void Tracer::TracePacket(const RayPacket& packet, glm::vec3* colors) const {
+  size_t num_rays = packet.GetSize();
+  RenderCounters::Local().primary_rays += num_rays;
+  if (!packet.IsCoherent(packet.GetFullMask())) {
+    for (size_t i = 0; i < num_rays; i++) {
+      HitRecord record;
+      colors[i] = TraceRay(packet.GetRay(i), max_bounces_, record);
+    }
+    return;
+  }
+
+  HitRecord records[RayPacket::kMaxSize];
+  const TracingInstance* hit_instances[RayPacket::kMaxSize] = {nullptr};
+  {
+    TraversalTimer timer(options_.profile);
+    scene_bvh_.IntersectPacket(packet, packet.GetFullMask(), 0.001f, records,
+                               hit_instances);
+  }
+
+  std::unique_ptr<bool[]> light_visible;
+  size_t num_lights = compiled_scene_.GetLights().size();
+  // Culled and sampled lights differ from hit to hit, so their shadow rays
+  // are traced one at a time.
+  if (shadows_enabled_ && !UsesLightBVH()) {
+    light_visible.reset(new bool[num_rays * num_lights]);
+    TraceShadowPackets(packet, records, hit_instances, light_visible.get());
+  }
+  // Rays that missed look up the background together.
+  glm::vec3 miss_directions[RayPacket::kMaxSize];
+  glm::vec3 miss_colors[RayPacket::kMaxSize];
+  size_t num_misses = 0;
+  for (size_t i = 0; i < num_rays; i++) {
+    if (hit_instances[i] == nullptr) {
+      miss_directions[num_misses++] = packet.GetRay(i).GetDirection();
+    }
+  }
+  GetBackgroundColors(miss_directions, num_misses, miss_colors);
+  num_misses = 0;
+  for (size_t i = 0; i < num_rays; i++) {
+    if (hit_instances[i] == nullptr) {
+      colors[i] = miss_colors[num_misses++];
+      continue;
+    }
+    Ray ray = packet.GetRay(i);
+    const bool* visible =
+        light_visible ? light_visible.get() + i * num_lights : nullptr;
+    colors[i] =
+        ShadeHit(ray, *hit_instances[i], records[i], max_bounces_, visible);
+  }
+}
+
+void Tracer::TraceShadowPackets(const RayPacket& packet,
+                                const HitRecord* records,
+                                const TracingInstance* const* hit_instances,
+                                bool* light_visible) const {
+  size_t num_rays = packet.GetSize();
+  size_t num_lights = compiled_scene_.GetLights().size();
+  uint64_t active = 0;
+  size_t num_active = 0;
+  for (size_t i = 0; i < num_rays; i++) {
+    if (hit_instances[i] != nullptr) {
+      active |= uint64_t(1) << i;
+      num_active++;
+    }
+  }
+
+  RayPacket shadow_packet;
+  float max_t[RayPacket::kMaxSize];
+  for (size_t l = 0; l < num_lights; l++) {
+    const CompiledLight& light = compiled_scene_.GetLights()[l];
+    if (light.type == LightType::Ambient) {
+      for (size_t i = 0; i < num_rays; i++) {
+        light_visible[i * num_lights + l] = true;
+      }
+      continue;
+    }
+    // Slot i of the shadow packet belongs to ray i; rays that missed get a
+    // placeholder and stay inactive.
+    shadow_packet.Clear();
+    for (size_t i = 0; i < num_rays; i++) {
+      Ray ray = packet.GetRay(i);
+      if (!((active >> i) & 1)) {
+        shadow_packet.Add(ray);
+        continue;
+      }
+      glm::vec3 hit_pos = ray.At(records[i].time);
+      glm::vec3 light_intensity;
+      glm::vec3 dir_to_light;
+      float dist_to_light;
+      CompiledScene::GetIllumination(light, hit_pos, dir_to_light,
+                                     light_intensity, dist_to_light);
+      shadow_packet.Add(Ray(hit_pos, dir_to_light));
+      // Only occluders in front of the light count.
+      max_t[i] = dist_to_light / glm::length(dir_to_light);
+    }
+
+    uint64_t occluded = 0;
+    if (shadow_packet.IsCoherent(active)) {
+      RenderCounters::Local().shadow_rays += num_active;
+      TraversalTimer timer(options_.profile);
+      occluded =
+          scene_bvh_.OccludedPacket(shadow_packet, active, 0.001f, max_t);
+    } else {
+      for (size_t i = 0; i < num_rays; i++) {
+        if (((active >> i) & 1) &&
+            InShadow(shadow_packet.GetRay(i), max_t[i])) {
+          occluded |= uint64_t(1) << i;
+        }
+      }
+    }
+    for (size_t i = 0; i < num_rays; i++) {
+      light_visible[i * num_lights + l] = !((occluded >> i) & 1);
     }
   }
-  if (output_file.size())
-    image.SavePNG(output_file);
 }
 
 bool Tracer::InShadow(const Ray& ray, float max_t) const {
-  for (auto& component : tracing_components_) {
-    const HittableBase& hittable = component->GetHittable();
-    glm::mat4 local_to_world = component->GetNodePtr()->GetTransform().GetLocalToWorldMatrix();
-    glm::mat4 world_to_local = glm::inverse(local_to_world);
-    Ray local_ray(
-      glm::vec3(world_to_local * glm::vec4(ray.GetOrigin(), 1.0f)),
-      glm::vec3(world_to_local * glm::vec4(ray.GetDirection(), 0.0f))
-    );
-    HitRecord temp_record;
-    temp_record.time = std::numeric_limits<float>::max();
-    if (hittable.Intersect(local_ray, 0.001f, temp_record) && temp_record.time < max_t) {
-      return true;
-    }
-  }
-  return false;
+  RenderCounters::Local().shadow_rays++;
+  TraversalTimer timer(options_.profile);
+  return scene_bvh_.Occluded(ray, 0.001f, max_t);
 }
 glm::vec3 Tracer::TraceRay(const Ray& ray,
                            size_t bounces,
                            HitRecord& record) const {
+  const TracingInstance* hit_instance;
+  {
+    TraversalTimer timer(options_.profile);
+    hit_instance = scene_bvh_.Intersect(ray, 0.001f, record);
+  }
+  if (hit_instance == nullptr) {
+    return GetBackgroundColor(ray.GetDirection());
+  }
+  return ShadeHit(ray, *hit_instance, record, bounces, nullptr);
+}
+
+glm::vec3 Tracer::ShadeHit(const Ray& ray,
+                           const TracingInstance& hit_instance,
+                           const HitRecord& record,
+                           size_t bounces,
+                           const bool* light_visible) const {
   // TODO: Compute the color for the cast ray.
-  bool hit_anything = false;
-  const TracingComponent* hit_object = nullptr;
+  const CompiledMaterial* material = GetMaterial(hit_instance);
+  if (material == nullptr) {
+    return glm::vec3(1.0f, 0.0f, 1.0f); // Magenta for missing material
+  }
+
+  glm::vec3 final_color = ShadeDirect(ray, record, *material, light_visible);
+  //add support for bounces
+  if (bounces > 0) {
+    // Reflected rays diverge, so they are always traced one at a time.
+    Ray bounce_ray(ray.At(record.time),
+                   glm::reflect(ray.GetDirection(), record.normal));
+    RenderCounters::Local().bounce_rays++;
+    HitRecord bounce_record;
+    bounce_record.time = std::numeric_limits<float>::max();
+    glm::vec3 bounce_color = TraceRay(bounce_ray, bounces - 1, bounce_record);
+    final_color += bounce_color * material->specular_color;
+  }
+  return final_color;
+}
+
+const CompiledMaterial* Tracer::GetMaterial(
+    const TracingInstance& instance) const {
+  return compiled_scene_.GetObjectMaterial(instance.object);
+}
+
+glm::vec3 Tracer::ShadeDirect(const Ray& ray,
+                              const HitRecord& record,
+                              const CompiledMaterial& material,
+                              const bool* light_visible) const {
+  glm::vec3 final_color(0.0f);
+  glm::vec3 hit_pos = ray.At(record.time);
+  if (!UsesLightBVH()) {
+    const std::vector<CompiledLight>& lights = compiled_scene_.GetLights();
+    for (size_t l = 0; l < lights.size(); l++) {
+      glm::vec3 color;
+      if (ShadeLight(lights[l], l, ray, record, hit_pos, material,
+                     light_visible, color)) {
+        final_color += color;
+      }
+    }
+  } else {
+    final_color += ShadeLightCandidates(ray, record, hit_pos, material);
+  }
+  return final_color;
+}
+
+bool Tracer::ShadeLight(const CompiledLight& light,
+                        size_t light_index,
+                        const Ray& ray,
+                        const HitRecord& record,
+                        const glm::vec3& hit_pos,
+                        const CompiledMaterial& material,
+                        const bool* light_visible,
+                        glm::vec3& color) const {
   auto clamp = [&](glm::vec3 A,glm::vec3 B) {
     return glm::max(0.0f,glm::dot(A,B));
   };
-  for (auto& component : tracing_components_){
-    const HittableBase& hittable = component->GetHittable();
-    glm::mat4 local_to_world = component->GetNodePtr()->GetTransform().GetLocalToWorldMatrix();
-    glm::mat4 world_to_local = glm::inverse(local_to_world);
-    Ray local_ray(
-      glm::vec3(world_to_local * glm::vec4(ray.GetOrigin(), 1.0f)),
-      glm::vec3(world_to_local * glm::vec4(ray.GetDirection(), 0.0f))
-    );
-    HitRecord temp_record;
-    temp_record.time = std::numeric_limits<float>::max();
-    
-    if (hittable.Intersect(local_ray, 0.001f, temp_record) && temp_record.time < record.time) {
-      hit_object = component;
-      hit_anything = true;
-      record = temp_record;
-    }
-}
-
-  if (hit_anything) {
-    // Get the material component from the hit object's node
-    auto material_component = hit_object->GetNodePtr()->GetComponentPtr<MaterialComponent>();
-    
-    if (material_component == nullptr) {
-      return glm::vec3(1.0f, 0.0f, 1.0f); // Magenta for missing material
-    }
-    
-    const auto& material = material_component->GetMaterial();
-    glm::vec3 final_color(0.0f);
-    glm::vec3 hit_pos = ray.At(record.time);
-    // Get material properties
-    glm::vec3 k_ambient = material.GetAmbientColor();
-    glm::vec3 k_diffuse = material.GetDiffuseColor();
-    glm::vec3 k_specular = material.GetSpecularColor();
-    float shininess = material.GetShininess();
-    for (auto& light : light_components_) {
-      glm::vec3 light_intensity;
-      glm::vec3 dir_to_light;
-      float dist_to_light;
-      Illuminator::GetIllumination(*light, hit_pos, dir_to_light, light_intensity, dist_to_light);
-      //check if the light is in the shadow
-      if (shadows_enabled_) {
-        Ray shadow_ray(hit_pos, dir_to_light);
-        float max_t = dist_to_light / glm::length(dir_to_light);
-        if (InShadow(shadow_ray, max_t)) {
-          continue;
-        }
+  // Get material properties
+  glm::vec3 k_ambient = material.ambient_color;
+  glm::vec3 k_diffuse = material.diffuse_color;
+  glm::vec3 k_specular = material.specular_color;
+  float shininess = material.shininess;
+  glm::vec3 light_intensity;
+  glm::vec3 dir_to_light;
+  float dist_to_light;
+  CompiledScene::GetIllumination(light, hit_pos, dir_to_light, light_intensity, dist_to_light);
+  //check if the light is in the shadow; ambient light has no direction
+  bool is_ambient = light.type == LightType::Ambient;
+  if (shadows_enabled_ && !is_ambient) {
+    if (light_visible != nullptr) {
+      if (!light_visible[light_index]) {
+        return false;
       }
-      //check if the light is ambient
-      if (light->GetLightPtr()->GetType() == LightType::Ambient) {
-        glm::vec3 ambient = k_ambient * light->GetLightPtr()->GetDiffuseColor();
-        final_color += ambient;
-        continue;
+    } else {
+      Ray shadow_ray(hit_pos, dir_to_light);
+      float max_t = dist_to_light / glm::length(dir_to_light);
+      if (InShadow(shadow_ray, max_t)) {
+        return false;
+      }
+    }
+  }
+  //check if the light is ambient
+  if (is_ambient) {
+    color = k_ambient * light.color;
+    return true;
+  }
+  //calculate diffuse light
+  glm::vec3 diffuse = k_diffuse * light_intensity * clamp(record.normal, dir_to_light);
+  //calculate specular light
+  //find perfect reflection direction
+  glm::vec3 R = glm::reflect(-dir_to_light, record.normal);
+  glm::vec3 V = -ray.GetDirection();
+  glm::vec3 specular = k_specular * light_intensity * glm::pow(clamp(R, V), shininess);
+  color = diffuse + specular;
+  return true;
+}
+
+glm::vec3 Tracer::ShadeLightCandidates(const Ray& ray,
+                                       const HitRecord& record,
+                                       const glm::vec3& hit_pos,
+                                       const CompiledMaterial& material) const {
+  // Per-thread scratch space; shading a light never recurses into here.
+  thread_local std::vector<const LightInstance*> candidates;
+  thread_local std::vector<const LightInstance*> point_lights;
+  thread_local std::vector<float> cdf;
+  const std::vector<CompiledLight>& lights = compiled_scene_.GetLights();
+  candidates.clear();
+  light_bvh_.Query(hit_pos, candidates);
+
+  // Lights that are shaded in full, and the point lights to sample from
+  // with their estimated intensity at the hit point as a running sum.
+  glm::vec3 final_color(0.0f);
+  size_t num_samples = options_.light_samples;
+  size_t num_shaded = 0;
+  point_lights.clear();
+  cdf.clear();
+  float total = 0.0f;
+  for (const LightInstance* light : candidates) {
+    if (num_samples == 0 || !light->is_point) {
+      glm::vec3 color;
+      if (ShadeLight(lights[light->index], light->index, ray, record, hit_pos,
+                     material, nullptr, color)) {
+        final_color += color;
+      }
+      num_shaded++;
+      continue;
+    }
+    glm::vec3 d = light->position - hit_pos;
+    point_lights.push_back(light);
+    total += light->power / std::max(glm::dot(d, d), kMinLightDistance2);
+    cdf.push_back(total);
+  }
+
+  size_t num_points = point_lights.size();
+  if (num_points <= num_samples) {
+    for (const LightInstance* light : point_lights) {
+      glm::vec3 color;
+      if (ShadeLight(lights[light->index], light->index, ray, record, hit_pos,
+                     material, nullptr, color)) {
+        final_color += color;
       }
-      //calculate diffuse light
-      glm::vec3 diffuse = k_diffuse * light_intensity * clamp(record.normal, dir_to_light);
-      //calculate specular light
-      //find perfect reflection direction
-      glm::vec3 R = glm::reflect(-dir_to_light, record.normal);
-      glm::vec3 V = -ray.GetDirection();
-      glm::vec3 specular = k_specular * light_intensity * glm::pow(clamp(R, V), shininess);
-      //calculate ambient light
-      final_color += diffuse + specular;
     }
-    //add support for bounces
-    if (bounces > 0) {
-      Ray bounce_ray(hit_pos, glm::reflect(ray.GetDirection(), record.normal));
-      HitRecord bounce_record;
-      bounce_record.time = std::numeric_limits<float>::max();
-      glm::vec3 bounce_color = TraceRay(bounce_ray, bounces - 1, bounce_record);
-      final_color += bounce_color * k_specular;
+    num_shaded += num_points;
+  } else {
+    // Sampling with replacement: each of the num_samples picks adds its
+    // color divided by num_samples times its probability. Lights with
+    // unusable weights are picked uniformly.
+    uint32_t bits[3];
+    std::memcpy(bits, &hit_pos[0], sizeof(bits));
+    uint64_t key = (static_cast<uint64_t>(bits[0]) << 32 | bits[1]) ^
+                   (static_cast<uint64_t>(bits[2]) * 0x9e3779b97f4a7c15ull);
+    Random rng(Random::ForKey(options_.seed, key));
+    bool uniform = !(total > 0.0f) || !std::isfinite(total);
+    for (size_t s = 0; s < num_samples; s++) {
+      size_t k;
+      float probability;
+      if (uniform) {
+        k = std::min(num_points - 1,
+                     static_cast<size_t>(rng.NextFloat() * num_points));
+        probability = 1.0f / num_points;
+      } else {
+        float u = rng.NextFloat() * total;
+        k = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        k = std::min(k, num_points - 1);
+        probability = (cdf[k] - (k > 0 ? cdf[k - 1] : 0.0f)) / total;
+      }
+      const LightInstance& light = *point_lights[k];
+      glm::vec3 color;
+      if (probability > 0.0f &&
+          ShadeLight(lights[light.index], light.index, ray, record, hit_pos,
+                     material, nullptr, color)) {
+        final_color += color / (num_samples * probability);
+      }
     }
-    return final_color;
+    num_shaded += num_samples;
   }
-  return GetBackgroundColor(ray.GetDirection());
+  RenderCounters& counters = RenderCounters::Local();
+  counters.shaded_hits++;
+  counters.shaded_lights += num_shaded;
+  return final_color;
 }
 
 glm::vec3 Tracer::GetBackgroundColor(const glm::vec3& direction) const {
   if (cube_map_ != nullptr) {
-    return cube_map_->GetTexel(direction);
+    return cube_map_->GetTexel(direction, background_footprint_);
   } else
     return background_color_;
 }
+
+void Tracer::GetBackgroundColors(const glm::vec3* directions,
+                                 size_t count,
+                                 glm::vec3* colors) const {
+  if (cube_map_ != nullptr) {
+    cube_map_->GetTexels(directions, count, background_footprint_, colors);
+  } else {
+    std::fill(colors, colors + count, background_color_);
+  }
+}
 }  // namespace GLOO
@@ -2,18 +2,27 @@
 #define TRACER_H_
 
 #include "gloo/Scene.hpp"
-#include "gloo/Material.hpp"
 #include "gloo/lights/LightBase.hpp"
 #include "gloo/components/LightComponent.hpp"
+#include "gloo/Image.hpp"
 
 #include "Ray.hpp"
+#include "RayPacket.hpp"
+#include "RayQueue.hpp"
 #include "HitRecord.hpp"
 #include "TracingComponent.hpp"
+#include "SceneBVH.hpp"
+#include "CompiledScene.hpp"
+#include "LightBVH.hpp"
 #include "CubeMap.hpp"
 #include "PerspectiveCamera.hpp"
 #include "FisheyeCamera.hpp"
 #include "CameraBase.hpp"
 #include "CameraType.hpp"
+#include "RenderOptions.hpp"
+#include "RenderStats.hpp"
+#include "TileScheduler.hpp"
+#include "Random.hpp"
 namespace GLOO {
 class Tracer {
  public:
@@ -24,13 +33,16 @@ class Tracer {
          const CubeMap* cube_map,
          bool shadows_enabled,
          size_t samples,
-         CameraType camera_type = CameraType::Perspective)
+         CameraType camera_type = CameraType::Perspective,
+         const RenderOptions& options = RenderOptions())
       : image_size_(image_size),
         max_bounces_(max_bounces),
         background_color_(background_color),
         cube_map_(cube_map),
+        background_footprint_(0.0f),
         shadows_enabled_(shadows_enabled),
         samples_(samples),
+        options_(options),
         scene_ptr_(nullptr) {
           if (camera_type == CameraType::Perspective) {
             camera_ = make_unique<PerspectiveCamera>(camera_spec);
@@ -40,24 +52,138 @@ class Tracer {
             throw std::invalid_argument("Invalid camera type");
           }
   }
+  // Renders the scene and saves it to output_file, if not empty, together
+  // with a JSON report of the render statistics (see GetStatsFileName).
+  // Files ending in .pfm receive linear float values, anything else 8-bit
+  // PNG. With RenderOptions::stream_output the image is written while it
+  // is rendered, and .ppm files are written as binary PPM. Can be called
+  // again for every frame of an animation; see
+  // RenderOptions::refit_threshold.
   void Render(const Scene& scene, const std::string& output_file);
+  // Builds what rendering scene needs: the compiled scene tables and the
+  // scene and light BVHs. Render does this itself; other callers prepare
+  // once before calling RenderTileImage.
+  void Prepare(const Scene& scene);
+  // Renders one tile of the prepared scene into pixels, which must be the
+  // size of the tile, exactly as Render would.
+  void RenderTileImage(const Tile& tile, Image& pixels) const;
+  const glm::ivec2& GetImageSize() const {
+    return image_size_;
+  }
+  // Statistics of the last Render call.
+  const RenderStats& GetStats() const {
+    return stats_;
+  }
+  // "image.png" -> "image.stats.json".
+  static std::string GetStatsFileName(const std::string& output_file);
+  // Saves a float PFM for .pfm files, an 8-bit binary PPM for .ppm files
+  // and an 8-bit PNG otherwise, as Render does without streaming. PFM and
+  // PPM files are the same as streamed ones; PNG files hold the same pixels
+  // but are encoded by Image::SavePNG.
+  static void SaveImage(const Image& image,
+                        const std::string& output_file,
+                        bool srgb);
 
  private:
+  // Pixel row y goes to row y - image_y0 of image, which holds the whole
+  // image or a row of tiles. sample_counts, if not null, receives the
+  // samples taken for each pixel in the same layout.
+  void RenderTile(const Tile& tile,
+                  Image& image,
+                  size_t image_y0,
+                  size_t* sample_counts) const;
+  void RenderTilePackets(const Tile& tile,
+                         Image& image,
+                         size_t image_y0) const;
+  // Renders the tile breadth first: all camera rays of the tile form the
+  // first wave, which goes through the extend, shadow and shade stages in
+  // turn, each looping over the whole wave, and the reflected rays form the
+  // next one. Gives the same image as RenderTile.
+  void RenderTileWavefront(const Tile& tile,
+                           Image& image,
+                           size_t image_y0) const;
+  // Finds the closest hits of a wave, filling its records and hits.
+  void ExtendWave(RayQueue& queue) const;
+  // Shadow tests of the hits of a wave that have a material, which receive
+  // light_visible[i * num_lights + l] for ray i and light l.
+  void TraceWaveShadows(const RayQueue& queue,
+                        const CompiledMaterial* const* materials,
+                        bool* light_visible) const;
+  Ray GenerateSampleRay(size_t x, size_t y, Random& rng) const;
+  glm::vec3 SamplePixel(size_t x, size_t y, Random& rng) const;
+  // Mean color of a pixel under adaptive sampling; num_samples receives the
+  // number of samples it took.
+  glm::vec3 SamplePixelAdaptive(size_t x, size_t y, size_t& num_samples) const;
+  void SaveHeatmap(const std::vector<size_t>& sample_counts) const;
   glm::vec3 TraceRay(const Ray& ray, size_t bounces, HitRecord& record) const;
+  // Traces a packet of camera rays; colors[i] receives the i-th ray's color.
+  // Incoherent packets are traced one ray at a time.
+  void TracePacket(const RayPacket& packet, glm::vec3* colors) const;
+  // Shading of a known closest hit. light_visible holds the shadow test
+  // result for each light; if it is null, shadow rays are traced here.
+  glm::vec3 ShadeHit(const Ray& ray,
+                     const TracingInstance& hit_instance,
+                     const HitRecord& record,
+                     size_t bounces,
+                     const bool* light_visible) const;
+  // Shadow tests for the hits of a packet, one packet of shadow rays per
+  // light. light_visible[i * num_lights + l] is set for ray i and light l.
+  void TraceShadowPackets(const RayPacket& packet,
+                          const HitRecord* records,
+                          const TracingInstance* const* hit_instances,
+                          bool* light_visible) const;
+  // The material of a hit object, or null if it has none.
+  const CompiledMaterial* GetMaterial(
+      const TracingInstance& instance) const;
+  // Light reflected directly from the lights at a hit, without bounces.
+  // light_visible as for ShadeHit.
+  glm::vec3 ShadeDirect(const Ray& ray,
+                        const HitRecord& record,
+                        const CompiledMaterial& material,
+                        const bool* light_visible) const;
+  // Color that one light adds at a hit, or false if it is in shadow.
+  // light_visible as for ShadeHit, indexed by light_index.
+  bool ShadeLight(const CompiledLight& light,
+                  size_t light_index,
+                  const Ray& ray,
+                  const HitRecord& record,
+                  const glm::vec3& hit_pos,
+                  const CompiledMaterial& material,
+                  const bool* light_visible,
+                  glm::vec3& color) const;
+  // Color that the lights reaching a hit add, culled and sampled as set by
+  // RenderOptions::light_threshold and light_samples.
+  glm::vec3 ShadeLightCandidates(const Ray& ray,
+                                 const HitRecord& record,
+                                 const glm::vec3& hit_pos,
+                                 const CompiledMaterial& material) const;
+  bool UsesLightBVH() const {
+    return options_.light_threshold > 0.0f || options_.light_samples > 0;
+  }
   bool InShadow(const Ray& ray, float max_t) const;
   glm::vec3 GetBackgroundColor(const glm::vec3& direction) const;
+  // colors[i] receives GetBackgroundColor(directions[i]).
+  void GetBackgroundColors(const glm::vec3* directions,
+                           size_t count,
+                           glm::vec3* colors) const;
 
   std::unique_ptr<CameraBase> camera_;
   glm::ivec2 image_size_;
   size_t max_bounces_;
 
   std::vector<TracingComponent*> tracing_components_;
-  std::vector<LightComponent*> light_components_;
+  SceneBVH scene_bvh_;
+  CompiledScene compiled_scene_;
+  LightBVH light_bvh_;
   glm::vec3 background_color_;
   const CubeMap* cube_map_;
+  // Cone width in radians of the cube map lookups, 0 for unfiltered ones.
+  float background_footprint_;
   bool shadows_enabled_;
   size_t samples_;
+  RenderOptions options_;
   const Scene* scene_ptr_;
+  RenderStats stats_;
 };
 }  // namespace GLOO
 
@@ -0,0 +1,205 @@
+#include "TriangleBlocks.hpp"
+
+#include <algorithm>
+
+#include "hittable/Mesh.hpp"
+#include "hittable/Triangle.hpp"
+#include "RenderStats.hpp"
+
+namespace {
+int CountBits(unsigned int mask) {
+#if defined(__GNUC__)
+  return __builtin_popcount(mask);
+#else
+  int count = 0;
+  for (; mask != 0; mask &= mask - 1) {
+    count++;
+  }
+  return count;
+#endif
+}
+}  // namespace
+
+namespace GLOO {
+const uint32_t TriangleBlocks::kWidth;
+const uint32_t TriangleBlocks::kInvalidTriangle;
+
+const char* TriangleBlocks::GetInstructionSet() {
+#if defined(GLOO_SIMD_AVX2)
+  return "avx2";
+#elif defined(GLOO_SIMD_SSE)
+  return "sse";
+#else
+  return "portable";
+#endif
+}
+
+void TriangleBlocks::PadToBlock(std::vector<uint32_t>& indices) {
+  while (indices.size() % kWidth != 0) {
+    indices.push_back(kInvalidTriangle);
+  }
+}
+
+void TriangleBlocks::Build(const Mesh& mesh,
+                           const std::vector<uint32_t>& indices) {
+  mesh_ = &mesh;
+  blocks_.clear();
+  // Blocks are value-initialized to zero. Zero edges give a zero
+  // determinant, so padding lanes never hit.
+  blocks_.resize((indices.size() + kWidth - 1) / kWidth);
+  for (size_t i = 0; i < indices.size(); i++) {
+    Block& block = blocks_[i / kWidth];
+    size_t lane = i % kWidth;
+    uint32_t triangle = indices[i];
+    block.triangle[lane] = triangle;
+    if (triangle == kInvalidTriangle) {
+      continue;
+    }
+    glm::vec3 p0 = mesh.GetPosition(triangle, 0);
+    glm::vec3 e1 = mesh.GetPosition(triangle, 1) - p0;
+    glm::vec3 e2 = mesh.GetPosition(triangle, 2) - p0;
+    for (int dim = 0; dim < 3; dim++) {
+      block.v0[dim][lane] = p0[dim];
+      block.e1[dim][lane] = e1[dim];
+      block.e2[dim][lane] = e2[dim];
+    }
+  }
+  // Leaves that end in a partial block were padded, so every lane past the
+  // end of indices is unused as well.
+  for (size_t i = indices.size(); i < blocks_.size() * kWidth; i++) {
+    blocks_[i / kWidth].triangle[i % kWidth] = kInvalidTriangle;
+  }
+}
+
+void TriangleBlocks::Clear() {
+  mesh_ = nullptr;
+  blocks_.clear();
+  blocks_.shrink_to_fit();
+}
+
+unsigned int TriangleBlocks::IntersectBlock(const Block& block,
+                                            const Ray& ray,
+                                            float t_min,
+                                            float t_max,
+                                            float* t,
+                                            float* u,
+                                            float* v) {
+#if defined(GLOO_SIMD_AVX2) || defined(GLOO_SIMD_SSE)
+  using namespace simd;
+  // Evaluated in the same order as Triangle::IntersectEdges, which keeps the
+  // results bit-identical to the scalar path.
+  const glm::vec3& direction = ray.GetDirection();
+  const glm::vec3& origin = ray.GetOrigin();
+  Lanes dx = Splat(direction.x), dy = Splat(direction.y),
+        dz = Splat(direction.z);
+  Lanes e1x = Load(block.e1[0]), e1y = Load(block.e1[1]),
+        e1z = Load(block.e1[2]);
+  Lanes e2x = Load(block.e2[0]), e2y = Load(block.e2[1]),
+        e2z = Load(block.e2[2]);
+
+  // s1 = cross(direction, e2), det = dot(e1, s1).
+  Lanes s1x = Sub(Mul(dy, e2z), Mul(e2y, dz));
+  Lanes s1y = Sub(Mul(dz, e2x), Mul(e2z, dx));
+  Lanes s1z = Sub(Mul(dx, e2y), Mul(e2x, dy));
+  Lanes det = Add(Add(Mul(e1x, s1x), Mul(e1y, s1y)), Mul(e1z, s1z));
+  Lanes mask = NotLess(det, Splat(1e-8f));
+  Lanes inv_det = Div(Splat(1.0f), det);
+
+  // s = origin - v0, u = inv_det * dot(s, s1).
+  Lanes sx = Sub(Splat(origin.x), Load(block.v0[0]));
+  Lanes sy = Sub(Splat(origin.y), Load(block.v0[1]));
+  Lanes sz = Sub(Splat(origin.z), Load(block.v0[2]));
+  Lanes lu =
+      Mul(inv_det, Add(Add(Mul(sx, s1x), Mul(sy, s1y)), Mul(sz, s1z)));
+  mask = And(mask, And(NotLess(lu, Splat(0.0f)), NotGreater(lu, Splat(1.0f))));
+
+  // s2 = cross(s, e1), v = inv_det * dot(direction, s2).
+  Lanes s2x = Sub(Mul(sy, e1z), Mul(e1y, sz));
+  Lanes s2y = Sub(Mul(sz, e1x), Mul(e1z, sx));
+  Lanes s2z = Sub(Mul(sx, e1y), Mul(e1x, sy));
+  Lanes lv =
+      Mul(inv_det, Add(Add(Mul(dx, s2x), Mul(dy, s2y)), Mul(dz, s2z)));
+  mask = And(mask, And(NotLess(lv, Splat(0.0f)),
+                       NotGreater(Add(lu, lv), Splat(1.0f))));
+
+  // t = inv_det * dot(e2, s2).
+  Lanes lt =
+      Mul(inv_det, Add(Add(Mul(e2x, s2x), Mul(e2y, s2y)), Mul(e2z, s2z)));
+  mask = And(mask,
+             And(GreaterEqual(lt, Splat(t_min)), Less(lt, Splat(t_max))));
+
+  Store(t, lt);
+  Store(u, lu);
+  Store(v, lv);
+  return MoveMask(mask);
+#else
+  // Portable fallback: the scalar test once per lane.
+  unsigned int hits = 0;
+  for (uint32_t lane = 0; lane < kWidth; lane++) {
+    glm::vec3 p0(block.v0[0][lane], block.v0[1][lane], block.v0[2][lane]);
+    glm::vec3 e1(block.e1[0][lane], block.e1[1][lane], block.e1[2][lane]);
+    glm::vec3 e2(block.e2[0][lane], block.e2[1][lane], block.e2[2][lane]);
+    if (Triangle::IntersectEdges(p0, e1, e2, ray, t_min, t_max, t[lane],
+                                 u[lane], v[lane])) {
+      hits |= 1u << lane;
+    }
+  }
+  return hits;
+#endif
+}
+
+bool TriangleBlocks::Intersect(uint32_t first,
+                               uint32_t count,
+                               const Ray& ray,
+                               float t_min,
+                               HitRecord& record) const {
+  float t[kWidth], u[kWidth], v[kWidth];
+  uint32_t hit_triangle = kInvalidTriangle;
+  float hit_u = 0.0f, hit_v = 0.0f;
+  uint64_t num_hits = 0;
+  uint32_t end = (first + count + kWidth - 1) / kWidth;
+  for (uint32_t b = first / kWidth; b < end; b++) {
+    unsigned int hits =
+        IntersectBlock(blocks_[b], ray, t_min, record.time, t, u, v);
+    num_hits += CountBits(hits);
+    // Keep the first lane with the smallest t, which is the triangle a
+    // sequential loop would have ended up with.
+    for (uint32_t lane = 0; hits != 0; lane++, hits >>= 1) {
+      if ((hits & 1) && t[lane] < record.time) {
+        record.time = t[lane];
+        hit_triangle = blocks_[b].triangle[lane];
+        hit_u = u[lane];
+        hit_v = v[lane];
+      }
+    }
+  }
+  RenderCounters& counters = RenderCounters::Local();
+  counters.triangle_tests += count;
+  counters.triangle_hits += num_hits;
+  if (hit_triangle == kInvalidTriangle) {
+    return false;
+  }
+  record.normal = mesh_->InterpolateNormal(hit_triangle, hit_u, hit_v);
+  return true;
+}
+
+bool TriangleBlocks::Occluded(uint32_t first,
+                              uint32_t count,
+                              const Ray& ray,
+                              float t_min,
+                              float t_max) const {
+  float t[kWidth], u[kWidth], v[kWidth];
+  RenderCounters& counters = RenderCounters::Local();
+  uint32_t end = (first + count + kWidth - 1) / kWidth;
+  for (uint32_t b = first / kWidth; b < end; b++) {
+    unsigned int hits = IntersectBlock(blocks_[b], ray, t_min, t_max, t, u, v);
+    if (hits != 0) {
+      counters.triangle_tests += std::min(count, (b + 1) * kWidth - first);
+      counters.triangle_hits += CountBits(hits);
+      return true;
+    }
+  }
+  counters.triangle_tests += count;
+  return false;
+}
+}  // namespace GLOO
@@ -0,0 +1,74 @@
+#ifndef TRIANGLE_BLOCKS_H_
+#define TRIANGLE_BLOCKS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "Ray.hpp"
+#include "HitRecord.hpp"
+#include "SimdLanes.hpp"
+
+namespace GLOO {
+// Forward declarations.
+class Mesh;
+
+// Leaf triangles transposed into fixed-width blocks, so that one ray is
+// tested against a whole block with a single run of SIMD Moller-Trumbore.
+// Blocks are built from an index array in which every leaf starts at a
+// multiple of kWidth; unused lanes hold kInvalidTriangle and never hit.
+class TriangleBlocks {
+ public:
+  static const uint32_t kWidth = simd::kLaneWidth;
+  static const uint32_t kInvalidTriangle = 0xffffffff;
+
+  // Name of the instruction set the kernel was compiled for.
+  static const char* GetInstructionSet();
+  // Pads indices with kInvalidTriangle up to the next multiple of kWidth.
+  static void PadToBlock(std::vector<uint32_t>& indices);
+
+  TriangleBlocks() : mesh_(nullptr) {
+  }
+  void Build(const Mesh& mesh, const std::vector<uint32_t>& indices);
+  void Clear();
+  // Closest hit among indices[first, first + count) of the array passed to
+  // Build. first must be a multiple of kWidth. Gives the same result as
+  // calling Mesh::IntersectTriangle on each triangle in order.
+  bool Intersect(uint32_t first,
+                 uint32_t count,
+                 const Ray& ray,
+                 float t_min,
+                 HitRecord& record) const;
+  // Whether any of the triangles is hit in [t_min, t_max).
+  bool Occluded(uint32_t first,
+                uint32_t count,
+                const Ray& ray,
+                float t_min,
+                float t_max) const;
+  size_t GetBlockCount() const {
+    return blocks_.size();
+  }
+
+ private:
+  struct Block {
+    float v0[3][kWidth];
+    float e1[3][kWidth];
+    float e2[3][kWidth];
+    uint32_t triangle[kWidth];
+  };
+
+  // Tests one block against the interval [t_min, t_max). Returns the lanes
+  // that hit as a bit mask and fills t, u and v for every lane.
+  static unsigned int IntersectBlock(const Block& block,
+                                     const Ray& ray,
+                                     float t_min,
+                                     float t_max,
+                                     float* t,
+                                     float* u,
+                                     float* v);
+
+  const Mesh* mesh_;
+  std::vector<Block> blocks_;
+};
+}  // namespace GLOO
+
+#endif
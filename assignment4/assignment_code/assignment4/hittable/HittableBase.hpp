@@ -1,16 +1,57 @@
 #ifndef HITTABLE_BASE_H_
 #define HITTABLE_BASE_H_
 
+#include <cstdint>
+
+#include "AABB.hpp"
 #include "Ray.hpp"
+#include "RayPacket.hpp"
 #include "HitRecord.hpp"
 
 namespace GLOO {
 class HittableBase {
  public:
-  // It is assumed that ray is in the local coordinates.
+  // It is assumed that ray is in the local coordinates. The ray interval is
+  // [t_min, record.time): a hit only counts, and only overwrites record, if
+  // it is closer than the hit already in record. Callers start with
+  // record.time at the farthest distance of interest.
   virtual bool Intersect(const Ray& ray,
                          float t_min,
                          HitRecord& record) const = 0;
+  // Any-hit query for shadow rays: whether the ray hits anything with t in
+  // [t_min, t_max). Stops at the first occluder and computes no normal.
+  virtual bool Occluded(const Ray& ray, float t_min, float t_max) const = 0;
+  // Closest hits for the active rays of a local-space packet. records[i]
+  // belongs to the i-th ray. Returns the rays whose record was updated. By
+  // default the rays are intersected one at a time.
+  virtual uint64_t IntersectPacket(const RayPacket& packet,
+                                   uint64_t active,
+                                   float t_min,
+                                   HitRecord* records) const {
+    uint64_t hits = 0;
+    for (size_t i = 0; i < packet.GetSize(); i++) {
+      if (((active >> i) & 1) && Intersect(packet.GetRay(i), t_min, records[i]))
+        hits |= uint64_t(1) << i;
+    }
+    return hits;
+  }
+  // Occluded for the active rays of a packet, with t_max[i] belonging to the
+  // i-th ray. Returns the occluded rays.
+  virtual uint64_t OccludedPacket(const RayPacket& packet,
+                                  uint64_t active,
+                                  float t_min,
+                                  const float* t_max) const {
+    uint64_t occluded = 0;
+    for (size_t i = 0; i < packet.GetSize(); i++) {
+      if (((active >> i) & 1) && Occluded(packet.GetRay(i), t_min, t_max[i]))
+        occluded |= uint64_t(1) << i;
+    }
+    return occluded;
+  }
+  // Local-space bounds. Returns false for unbounded shapes such as planes.
+  virtual bool GetBounds(AABB& bbox) const {
+    return false;
+  }
   virtual ~HittableBase() {
   }
 };
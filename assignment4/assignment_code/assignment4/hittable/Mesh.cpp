@@ -1,33 +1,192 @@
 #include "Mesh.hpp"
 
+#include <chrono>
 #include <functional>
 #include <stdexcept>
 #include <iostream>
 
 #include "gloo/utils.hpp"
 
+#include "Octree.hpp"
+#include "MeshBVH.hpp"
+
 namespace GLOO {
+namespace {
+// Holds the arrays a mesh has taken over.
+struct OwnedArrays {
+  std::unique_ptr<PositionArray> positions;
+  std::unique_ptr<NormalArray> normals;
+  std::unique_ptr<IndexArray> indices;
+};
+}  // namespace
+
+Mesh::Mesh(std::unique_ptr<PositionArray> positions,
+           std::unique_ptr<NormalArray> normals,
+           std::unique_ptr<IndexArray> indices,
+           const AcceleratorOptions& accelerator_options) {
+  TakeArrays(std::move(positions), std::move(normals), std::move(indices));
+  BuildAccelerator(accelerator_options);
+}
+
 Mesh::Mesh(std::unique_ptr<PositionArray> positions,
            std::unique_ptr<NormalArray> normals,
-           std::unique_ptr<IndexArray> indices) {
-  size_t num_vertices = indices->size();
-  if (num_vertices % 3 != 0 || normals->size() != positions->size())
+           std::unique_ptr<IndexArray> indices,
+           const AcceleratorOptions& accelerator_options,
+           BinaryReader& accelerator_data) {
+  TakeArrays(std::move(positions), std::move(normals), std::move(indices));
+  LoadAccelerator(accelerator_options, accelerator_data);
+}
+
+Mesh::Mesh(PositionView positions,
+           NormalView normals,
+           IndexView indices,
+           std::shared_ptr<const void> data_owner,
+           const AcceleratorOptions& accelerator_options)
+    : positions_(positions),
+      normals_(normals),
+      indices_(indices),
+      data_owner_(std::move(data_owner)) {
+  BuildAccelerator(accelerator_options);
+}
+
+Mesh::Mesh(PositionView positions,
+           NormalView normals,
+           IndexView indices,
+           std::shared_ptr<const void> data_owner,
+           const AcceleratorOptions& accelerator_options,
+           BinaryReader& accelerator_data)
+    : positions_(positions),
+      normals_(normals),
+      indices_(indices),
+      data_owner_(std::move(data_owner)) {
+  LoadAccelerator(accelerator_options, accelerator_data);
+}
+
+void Mesh::TakeArrays(std::unique_ptr<PositionArray> positions,
+                      std::unique_ptr<NormalArray> normals,
+                      std::unique_ptr<IndexArray> indices) {
+  if (positions == nullptr || normals == nullptr || indices == nullptr)
+    throw std::runtime_error("Bad mesh data in Mesh constuctor!");
+  auto owned = std::make_shared<OwnedArrays>();
+  owned->positions = std::move(positions);
+  owned->normals = std::move(normals);
+  owned->indices = std::move(indices);
+  positions_ = *owned->positions;
+  normals_ = *owned->normals;
+  indices_ = *owned->indices;
+  data_owner_ = std::move(owned);
+}
+
+void Mesh::BuildAccelerator(const AcceleratorOptions& accelerator_options) {
+  PrepareTriangles();
+  CreateAccelerator(accelerator_options);
+  auto start = std::chrono::steady_clock::now();
+  accelerator_->Build(*this);
+  auto end = std::chrono::steady_clock::now();
+  accelerator_stats_ = accelerator_->GetStats();
+  accelerator_stats_.build_ms =
+      std::chrono::duration<double, std::milli>(end - start).count();
+  std::cout << "Built " << accelerator_->GetName() << ": "
+            << accelerator_stats_ << std::endl;
+}
+
+void Mesh::LoadAccelerator(const AcceleratorOptions& accelerator_options,
+                           BinaryReader& accelerator_data) {
+  PrepareTriangles();
+  CreateAccelerator(accelerator_options);
+  auto start = std::chrono::steady_clock::now();
+  accelerator_->Load(*this, accelerator_data);
+  auto end = std::chrono::steady_clock::now();
+  accelerator_stats_ = accelerator_->GetStats();
+  accelerator_stats_.load_ms =
+      std::chrono::duration<double, std::milli>(end - start).count();
+  std::cout << "Loaded " << accelerator_->GetName() << ": "
+            << accelerator_stats_ << std::endl;
+}
+
+bool Mesh::UpdateVertices(std::unique_ptr<PositionArray> positions,
+                          std::unique_ptr<NormalArray> normals,
+                          float max_cost_ratio) {
+  if (positions == nullptr || normals == nullptr ||
+      positions->size() != positions_.size() ||
+      normals->size() != normals_.size()) {
+    throw std::runtime_error("Vertices do not match the mesh!");
+  }
+  updated_positions_ = std::move(positions);
+  updated_normals_ = std::move(normals);
+  positions_ = *updated_positions_;
+  normals_ = *updated_normals_;
+  PrepareTriangles();
+
+  auto start = std::chrono::steady_clock::now();
+  bool refit = accelerator_->Refit(*this, max_cost_ratio);
+  if (!refit) {
+    accelerator_->Build(*this);
+  }
+  auto end = std::chrono::steady_clock::now();
+  accelerator_stats_ = accelerator_->GetStats();
+  accelerator_stats_.build_ms =
+      std::chrono::duration<double, std::milli>(end - start).count();
+  return refit;
+}
+
+void Mesh::PrepareTriangles() {
+  size_t num_vertices = indices_.size();
+  if (num_vertices % 3 != 0 || normals_.size() != positions_.size())
     throw std::runtime_error("Bad mesh data in Mesh constuctor!");
+  for (unsigned int index : indices_) {
+    if (index >= positions_.size())
+      throw std::runtime_error("Bad mesh data in Mesh constuctor!");
+  }
+}
 
-  for (size_t i = 0; i < num_vertices; i += 3) {
-    triangles_.emplace_back(
-        positions->at(indices->at(i)), positions->at(indices->at(i + 1)),
-        positions->at(indices->at(i + 2)), normals->at(indices->at(i)),
-        normals->at(indices->at(i + 1)), normals->at(indices->at(i + 2)));
+void Mesh::CreateAccelerator(const AcceleratorOptions& accelerator_options) {
+  if (accelerator_options.type == AcceleratorType::BVH) {
+    accelerator_ = make_unique<MeshBVH>(accelerator_options);
+  } else {
+    accelerator_ = make_unique<Octree>(accelerator_options);
   }
-  // Let mesh data destruct.
+}
 
-  // Build Octree.
-  octree_ = make_unique<Octree>();
-  octree_->Build(*this);
+AABB Mesh::GetTriangleBounds(uint32_t triangle) const {
+  AABB bbox;
+  bbox.mn = bbox.mx = GetPosition(triangle, 0);
+  for (int i = 1; i < 3; i++) {
+    bbox.UnionWith(GetPosition(triangle, i));
+  }
+  return bbox;
+}
+
+glm::vec3 Mesh::InterpolateNormal(uint32_t triangle, float u, float v) const {
+  const unsigned int* index = &indices_[3 * triangle];
+  return glm::normalize(normals_[index[0]] * (1.0f - u - v) +
+                        normals_[index[1]] * u + normals_[index[2]] * v);
+}
+
+bool Mesh::GetBounds(AABB& bbox) const {
+  bbox = accelerator_->GetBounds();
+  return true;
 }
 
 bool Mesh::Intersect(const Ray& ray, float t_min, HitRecord& record) const {
-  return octree_->Intersect(ray, t_min, record);
+  return accelerator_->Intersect(ray, t_min, record);
+}
+
+uint64_t Mesh::IntersectPacket(const RayPacket& packet,
+                               uint64_t active,
+                               float t_min,
+                               HitRecord* records) const {
+  return accelerator_->IntersectPacket(packet, active, t_min, records);
+}
+
+bool Mesh::Occluded(const Ray& ray, float t_min, float t_max) const {
+  return accelerator_->Occluded(ray, t_min, t_max);
+}
+
+uint64_t Mesh::OccludedPacket(const RayPacket& packet,
+                              uint64_t active,
+                              float t_min,
+                              const float* t_max) const {
+  return accelerator_->OccludedPacket(packet, active, t_min, t_max);
 }
 }  // namespace GLOO
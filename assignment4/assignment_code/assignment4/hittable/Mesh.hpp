@@ -1,30 +1,161 @@
 #ifndef MESH_H_
 #define MESH_H_
 
+#include <cstdint>
+#include <memory>
+
 #include "HittableBase.hpp"
 
 #include "gloo/alias_types.hpp"
 
 #include "Triangle.hpp"
-#include "Octree.hpp"
+#include "ArrayView.hpp"
+#include "AcceleratorType.hpp"
+#include "MeshAccelerator.hpp"
+#include "RenderStats.hpp"
 
 namespace GLOO {
-class Octree;
-
+// Indexed triangle mesh. Vertex attributes and indices are stored once and
+// shared by all triangles; acceleration structures refer to triangles by
+// their 32-bit index. The mesh either takes over its arrays or refers to
+// arrays kept alive by a data owner, such as a mapped mesh file.
 class Mesh : public HittableBase {
  public:
+  using PositionView = ArrayView<glm::vec3>;
+  using NormalView = ArrayView<glm::vec3>;
+  using IndexView = ArrayView<unsigned int>;
+
+  Mesh(std::unique_ptr<PositionArray> positions,
+       std::unique_ptr<NormalArray> normals,
+       std::unique_ptr<IndexArray> indices,
+       const AcceleratorOptions& accelerator_options = AcceleratorOptions());
+  // Restores the acceleration structure saved with MeshAccelerator::Save
+  // instead of building it.
   Mesh(std::unique_ptr<PositionArray> positions,
        std::unique_ptr<NormalArray> normals,
-       std::unique_ptr<IndexArray> indices);
+       std::unique_ptr<IndexArray> indices,
+       const AcceleratorOptions& accelerator_options,
+       BinaryReader& accelerator_data);
+  // Refers to the arrays without copying them; data_owner keeps them alive
+  // for the lifetime of the mesh.
+  Mesh(PositionView positions,
+       NormalView normals,
+       IndexView indices,
+       std::shared_ptr<const void> data_owner,
+       const AcceleratorOptions& accelerator_options = AcceleratorOptions());
+  Mesh(PositionView positions,
+       NormalView normals,
+       IndexView indices,
+       std::shared_ptr<const void> data_owner,
+       const AcceleratorOptions& accelerator_options,
+       BinaryReader& accelerator_data);
+
+  // Replaces the vertex positions and normals, which must be as many as
+  // before, for the next frame of an animation. The acceleration structure
+  // is refit to them if it can be and its SAH cost stays within
+  // max_cost_ratio times that of its last build, and built again otherwise.
+  // Returns whether it was refit. Not thread-safe with tracing.
+  bool UpdateVertices(std::unique_ptr<PositionArray> positions,
+                      std::unique_ptr<NormalArray> normals,
+                      float max_cost_ratio);
 
   bool Intersect(const Ray& ray, float t_min, HitRecord& record) const override;
-  const std::vector<Triangle>& GetTriangles() const {
-    return triangles_;
+  uint64_t IntersectPacket(const RayPacket& packet,
+                           uint64_t active,
+                           float t_min,
+                           HitRecord* records) const override;
+  bool Occluded(const Ray& ray, float t_min, float t_max) const override;
+  uint64_t OccludedPacket(const RayPacket& packet,
+                          uint64_t active,
+                          float t_min,
+                          const float* t_max) const override;
+  bool GetBounds(AABB& bbox) const override;
+
+  size_t GetTriangleCount() const {
+    return indices_.size() / 3;
+  }
+  glm::vec3 GetPosition(uint32_t triangle, int corner) const {
+    return positions_[indices_[3 * triangle + corner]];
+  }
+  AABB GetTriangleBounds(uint32_t triangle) const;
+  // Closest-hit test against a single triangle, respecting record.time.
+  // Edges are computed from the shared arrays on each call; the SIMD leaves
+  // keep their own copies in TriangleBlocks.
+  bool IntersectTriangle(uint32_t triangle,
+                         const Ray& ray,
+                         float t_min,
+                         HitRecord& record) const {
+    glm::vec3 p0 = GetPosition(triangle, 0);
+    glm::vec3 e1 = GetPosition(triangle, 1) - p0;
+    glm::vec3 e2 = GetPosition(triangle, 2) - p0;
+    float t, u, v;
+    RenderCounters& counters = RenderCounters::Local();
+    counters.triangle_tests++;
+    if (!Triangle::IntersectEdges(p0, e1, e2, ray, t_min, record.time, t, u,
+                                  v)) {
+      return false;
+    }
+    counters.triangle_hits++;
+    record.time = t;
+    record.normal = InterpolateNormal(triangle, u, v);
+    return true;
+  }
+  // Any-hit test against a single triangle in [t_min, t_max).
+  bool OccludedByTriangle(uint32_t triangle,
+                          const Ray& ray,
+                          float t_min,
+                          float t_max) const {
+    glm::vec3 p0 = GetPosition(triangle, 0);
+    glm::vec3 e1 = GetPosition(triangle, 1) - p0;
+    glm::vec3 e2 = GetPosition(triangle, 2) - p0;
+    float t, u, v;
+    RenderCounters& counters = RenderCounters::Local();
+    counters.triangle_tests++;
+    if (!Triangle::IntersectEdges(p0, e1, e2, ray, t_min, t_max, t, u, v)) {
+      return false;
+    }
+    counters.triangle_hits++;
+    return true;
+  }
+  glm::vec3 InterpolateNormal(uint32_t triangle, float u, float v) const;
+
+  const AcceleratorStats& GetAcceleratorStats() const {
+    return accelerator_stats_;
+  }
+  const MeshAccelerator& GetAccelerator() const {
+    return *accelerator_;
+  }
+  PositionView GetPositions() const {
+    return positions_;
+  }
+  NormalView GetNormals() const {
+    return normals_;
+  }
+  IndexView GetIndices() const {
+    return indices_;
   }
 
  private:
-  std::vector<Triangle> triangles_;
-  std::unique_ptr<Octree> octree_;
+  void TakeArrays(std::unique_ptr<PositionArray> positions,
+                  std::unique_ptr<NormalArray> normals,
+                  std::unique_ptr<IndexArray> indices);
+  // Validates the mesh data.
+  void PrepareTriangles();
+  void BuildAccelerator(const AcceleratorOptions& accelerator_options);
+  void LoadAccelerator(const AcceleratorOptions& accelerator_options,
+                       BinaryReader& accelerator_data);
+  void CreateAccelerator(const AcceleratorOptions& accelerator_options);
+
+  PositionView positions_;
+  NormalView normals_;
+  IndexView indices_;
+  std::shared_ptr<const void> data_owner_;
+  // Vertices set by UpdateVertices; the indices stay with data_owner_.
+  std::unique_ptr<PositionArray> updated_positions_;
+  std::unique_ptr<NormalArray> updated_normals_;
+
+  std::unique_ptr<MeshAccelerator> accelerator_;
+  AcceleratorStats accelerator_stats_;
 };
 }  // namespace GLOO
 
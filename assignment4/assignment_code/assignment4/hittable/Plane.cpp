@@ -13,11 +13,20 @@ bool Plane::Intersect(const Ray& ray, float t_min, HitRecord& record) const {
     return false;
   }
   float t = (d_ - glm::dot(ray.GetOrigin(), normal_)) / glm::dot(ray.GetDirection(), normal_);
-  if (t < t_min) {
+  if (t < t_min || t >= record.time) {
     return false;
   }
   record.time = t;
   record.normal = normal_;
   return true;
 }
+
+bool Plane::Occluded(const Ray& ray, float t_min, float t_max) const {
+  float denominator = glm::dot(ray.GetDirection(), normal_);
+  if (denominator == 0) {
+    return false;
+  }
+  float t = (d_ - glm::dot(ray.GetOrigin(), normal_)) / denominator;
+  return t >= t_min && t < t_max;
+}
 }  // namespace GLOO
@@ -8,6 +8,7 @@ class Plane : public HittableBase {
  public:
   Plane(const glm::vec3& normal, float d);
   bool Intersect(const Ray& ray, float t_min, HitRecord& record) const override;
+  bool Occluded(const Ray& ray, float t_min, float t_max) const override;
   private:
   glm::vec3 normal_;
   float d_; 
@@ -10,6 +10,11 @@ class Sphere : public HittableBase {
   Sphere(float radius) : radius_(radius) {
   }
   bool Intersect(const Ray& ray, float t_min, HitRecord& record) const override;
+  bool Occluded(const Ray& ray, float t_min, float t_max) const override;
+  bool GetBounds(AABB& bbox) const override {
+    bbox = AABB(glm::vec3(-radius_), glm::vec3(radius_));
+    return true;
+  }
 
  private:
   float radius_;
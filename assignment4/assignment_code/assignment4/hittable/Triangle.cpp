@@ -25,34 +25,17 @@ Triangle::Triangle(const std::vector<glm::vec3>& positions,
   normals_ = normals;
 }
 
+bool Triangle::GetBounds(AABB& bbox) const {
+  bbox = AABB::FromTriangle(*this);
+  return true;
+}
+
 bool Triangle::Intersect(const Ray& ray, float t_min, HitRecord& record) const {
-  // TODO: Implement ray-triangle intersection.
   glm::vec3 e1 = positions_[1] - positions_[0];
   glm::vec3 e2 = positions_[2] - positions_[0];
-  glm::vec3 s1 = glm::cross(ray.GetDirection(), e2);
-  float det = glm::dot(e1, s1);
-  //on the same plane
-  if (det < 1e-8f) {
-    return false;
-  }
-  float inv_det = 1.0f / det;
-  //calculate u and v
-  glm::vec3 s = ray.GetOrigin() - positions_[0];
-  float u = inv_det * glm::dot(s, s1);
-  if (u < 0.0f || u > 1.0f) {
-    return false;
-  }
-  // Calculate barycentric coordinate v
-  glm::vec3 s2 = glm::cross(s, e1);
-  float v = inv_det * glm::dot(ray.GetDirection(), s2);
-  
-  // Check if intersection is outside triangle (v < 0 or u + v > 1)
-  if (v < 0.0f || u + v > 1.0f) {
-    return false;
-  }
-  //calculate t
-  float t = inv_det * glm::dot(e2, s2);
-  if (t < t_min) {
+  float t, u, v;
+  if (!IntersectEdges(positions_[0], e1, e2, ray, t_min, record.time, t, u,
+                      v)) {
     return false;
   }
   record.time = t;
@@ -60,4 +43,11 @@ bool Triangle::Intersect(const Ray& ray, float t_min, HitRecord& record) const {
   record.normal = glm::normalize(normals_[0] * (1.0f - u - v) + normals_[1] * u + normals_[2] * v);
   return true;
 }
+
+bool Triangle::Occluded(const Ray& ray, float t_min, float t_max) const {
+  glm::vec3 e1 = positions_[1] - positions_[0];
+  glm::vec3 e2 = positions_[2] - positions_[0];
+  float t, u, v;
+  return IntersectEdges(positions_[0], e1, e2, ray, t_min, t_max, t, u, v);
+}
 }  // namespace GLOO
@@ -18,6 +18,8 @@ class Triangle : public HittableBase {
            const std::vector<glm::vec3>& normals);
 
   bool Intersect(const Ray& ray, float t_min, HitRecord& record) const override;
+  bool Occluded(const Ray& ray, float t_min, float t_max) const override;
+  bool GetBounds(AABB& bbox) const override;
   glm::vec3 GetPosition(size_t i) const {
     return positions_[i];
   }
@@ -25,6 +27,44 @@ class Triangle : public HittableBase {
     return normals_[i];
   }
 
+  // Moller-Trumbore test against the triangle with first vertex p0 and edges
+  // e1 = p1 - p0, e2 = p2 - p0. On a hit in [t_min, t_max) it returns t and
+  // the barycentric weights u, v of p1 and p2.
+  static bool IntersectEdges(const glm::vec3& p0,
+                             const glm::vec3& e1,
+                             const glm::vec3& e2,
+                             const Ray& ray,
+                             float t_min,
+                             float t_max,
+                             float& t,
+                             float& u,
+                             float& v) {
+    glm::vec3 s1 = glm::cross(ray.GetDirection(), e2);
+    float det = glm::dot(e1, s1);
+    //on the same plane
+    if (det < 1e-8f) {
+      return false;
+    }
+    float inv_det = 1.0f / det;
+    //calculate u and v
+    glm::vec3 s = ray.GetOrigin() - p0;
+    u = inv_det * glm::dot(s, s1);
+    if (u < 0.0f || u > 1.0f) {
+      return false;
+    }
+    // Calculate barycentric coordinate v
+    glm::vec3 s2 = glm::cross(s, e1);
+    v = inv_det * glm::dot(ray.GetDirection(), s2);
+    // Check if intersection is outside triangle (v < 0 or u + v > 1)
+    if (v < 0.0f || u + v > 1.0f) {
+      return false;
+    }
+    //calculate t
+    t = inv_det * glm::dot(e2, s2);
+    // Keep the closest hit when several triangles are tested in a row.
+    return t >= t_min && t < t_max;
+  }
+
  private:
   std::vector<glm::vec3> positions_;
   std::vector<glm::vec3> normals_;
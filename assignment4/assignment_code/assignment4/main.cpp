@@ -5,21 +5,159 @@
 #include "gloo/components/MaterialComponent.hpp"
 
 #include "hittable/Sphere.hpp"
+#include "DistributedRender.hpp"
 #include "Tracer.hpp"
 #include "SceneParser.hpp"
 #include "ArgParser.hpp"
 
 using namespace GLOO;
 
+namespace {
+// Output file of an animation frame: "out.png" -> "out_0007.png", or the
+// run of '#' replaced as in GetFramePath if the name has one.
+std::string GetFrameOutputFile(const std::string& output_file, size_t frame) {
+  if (output_file.find('#') != std::string::npos) {
+    return GetFramePath(output_file, frame);
+  }
+  size_t slash = output_file.find_last_of("/\\");
+  size_t dot = output_file.find_last_of('.');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    dot = output_file.size();
+  }
+  return GetFramePath(output_file.substr(0, dot) + "_####" +
+                          output_file.substr(dot),
+                      frame);
+}
+
+// Coordinates worker processes, each running this executable with the same
+// arguments, and saves the image they render. The scene is only loaded by
+// the workers.
+int RenderDistributed(const ArgParser& arg_parser,
+                      int argc,
+                      const char* argv[]) {
+  if (arg_parser.frames > 0 || arg_parser.stream ||
+      arg_parser.heatmap_file.size()) {
+    throw std::invalid_argument(
+        "Distributed rendering cannot be combined with animation frames, "
+        "streaming output or heatmaps!");
+  }
+  DistributedOptions options;
+  options.workers = arg_parser.workers;
+  options.timeout_ms = arg_parser.worker_timeout;
+  options.ready_timeout_ms = arg_parser.worker_ready_timeout;
+  glm::ivec2 image_size(arg_parser.width, arg_parser.height);
+  TileCoordinator coordinator(
+      std::vector<std::string>(argv, argv + argc), image_size,
+      glm::ivec2(arg_parser.tile_width, arg_parser.tile_height), options);
+  std::unique_ptr<Image> image = coordinator.Render();
+  if (arg_parser.output_file.size()) {
+    Tracer::SaveImage(*image, arg_parser.output_file, arg_parser.srgb);
+    // The builds happen in the workers, so their times stay 0.
+    RenderStats stats = coordinator.GetStats();
+    stats.samples = arg_parser.samples;
+    stats.profiled = arg_parser.profile;
+    stats.WriteJson(Tracer::GetStatsFileName(arg_parser.output_file));
+  }
+  return 0;
+}
+}  // namespace
+
 int main(int argc, const char* argv[]) {
   ArgParser arg_parser(argc, argv);
+  if (arg_parser.frames > 0 && arg_parser.heatmap_file.size()) {
+    // Every frame would overwrite the same heatmap.
+    throw std::invalid_argument(
+        "Heatmaps cannot be combined with animation frames!");
+  }
+  if (arg_parser.workers > 0 && arg_parser.worker_fd < 0) {
+    return RenderDistributed(arg_parser, argc, argv);
+  }
   SceneParser scene_parser;
+  if (arg_parser.accelerator.size()) {
+    scene_parser.SetAcceleratorOverride(
+        ParseAcceleratorType(arg_parser.accelerator));
+  }
+  AcceleratorOptions accelerator_options;
+  accelerator_options.max_leaf_size = arg_parser.leaf_size;
+  accelerator_options.simd = !arg_parser.scalar;
+  scene_parser.SetAcceleratorOptions(accelerator_options);
+  if (arg_parser.mesh_cache.size()) {
+    scene_parser.SetMeshCacheDirectory(arg_parser.mesh_cache);
+  }
+  auto load_start = std::chrono::steady_clock::now();
   auto scene = scene_parser.ParseScene("assignment4/" + arg_parser.input_file);
+  std::cout << "Loaded scene in " << MsSince(load_start) << " ms";
+  if (scene_parser.GetMeshInstanceCount() > 0) {
+    std::cout << ", " << scene_parser.GetMeshCount() << " meshes for "
+              << scene_parser.GetMeshInstanceCount() << " objects";
+  }
+  if (const MeshCache* mesh_cache = scene_parser.GetMeshCache()) {
+    std::cout << " (" << mesh_cache->GetHits() << " meshes from cache, "
+              << mesh_cache->GetMisses() << " built)";
+  }
+  std::cout << std::endl;
+
+  RenderOptions options;
+  options.threads = arg_parser.threads;
+  options.tile_size = glm::ivec2(arg_parser.tile_width, arg_parser.tile_height);
+  options.seed = arg_parser.seed;
+  options.packet_size = arg_parser.packet_size;
+  options.adaptive_min_samples = arg_parser.adaptive_min_samples;
+  options.adaptive_max_samples = arg_parser.adaptive_max_samples;
+  options.adaptive_threshold = arg_parser.adaptive_threshold;
+  options.profile = arg_parser.profile;
+  options.heatmap_file = arg_parser.heatmap_file;
+  options.stream_output = arg_parser.stream;
+  options.srgb_output = arg_parser.srgb;
+  options.filter_background = arg_parser.filter_background;
+  options.light_threshold = arg_parser.light_threshold;
+  options.light_samples = arg_parser.light_samples;
+  options.wavefront = arg_parser.wavefront;
+  if (arg_parser.frames > 0) {
+    options.refit_threshold = arg_parser.refit_threshold;
+  }
 
   Tracer tracer(scene_parser.GetCameraSpec(),
                 glm::ivec2(arg_parser.width, arg_parser.height),
                 arg_parser.bounces, scene_parser.GetBackgroundColor(),
-                scene_parser.GetCubeMapPtr(), arg_parser.shadows, arg_parser.samples, arg_parser.camera_type);
-  tracer.Render(*scene, arg_parser.output_file);
+                scene_parser.GetCubeMapPtr(), arg_parser.shadows, arg_parser.samples, arg_parser.camera_type,
+                options);
+  if (arg_parser.worker_fd >= 0) {
+    tracer.Prepare(*scene);
+    RunTileWorker(arg_parser.worker_fd, arg_parser.worker_index, tracer);
+    return 0;
+  }
+  if (arg_parser.frames == 0) {
+    tracer.Render(*scene, arg_parser.output_file);
+    return 0;
+  }
+
+  // Animation: the scene and its acceleration structures stay loaded, and
+  // each frame only moves what the scene file animates.
+  Animation& animation = scene_parser.GetAnimation();
+  double total_ms = 0.0;
+  for (size_t frame = 0; frame < arg_parser.frames; frame++) {
+    auto frame_start = std::chrono::steady_clock::now();
+    FrameUpdate update =
+        animation.SetFrame(frame, arg_parser.refit_threshold);
+    tracer.Render(*scene, arg_parser.output_file.size()
+                              ? GetFrameOutputFile(arg_parser.output_file,
+                                                   frame)
+                              : "");
+    double frame_ms = MsSince(frame_start);
+    total_ms += frame_ms;
+    const RenderStats& stats = tracer.GetStats();
+    std::cout << "Frame " << frame << ": " << frame_ms << " ms (update "
+              << update.ms << " ms, " << update.refit_meshes
+              << " meshes refit, " << update.rebuilt_meshes
+              << " rebuilt; scene BVH "
+              << (stats.scene_refit ? "refit" : "built") << " in "
+              << stats.scene_build_ms << " ms; render " << stats.render_ms
+              << " ms)" << std::endl;
+  }
+  std::cout << "Rendered " << arg_parser.frames << " frames in " << total_ms
+            << " ms, " << total_ms / arg_parser.frames << " ms per frame"
+            << std::endl;
   return 0;
 }
@@ -0,0 +1,262 @@
+// Measures cube map lookups per second of the original branchy, clamping
+// lookup, of CubeMap::GetTexel and GetTexels, and of footprint filtered
+// lookups, and checks that unfiltered lookups match the original up to
+// rounding: CubeMap divides by the major component of the direction as
+// given, the original by that of the normalized direction.
+//
+// Directions sweep a panorama in scanline order unless -shuffle is given.
+//
+// Usage: assignment4_cube_map_benchmark [-size N] [-lookups N] [-repeat N]
+//                                       [-shuffle] [-seed S]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "gloo/utils.hpp"
+
+#include "CubeMap.hpp"
+#include "Random.hpp"
+
+using namespace GLOO;
+
+namespace {
+// The lookup that CubeMap replaced, on unpadded face images.
+class ReferenceCubeMap {
+ public:
+  ReferenceCubeMap(const Image* const faces[6]) {
+    for (int i = 0; i < 6; i++) {
+      faces_[i] = faces[i];
+    }
+  }
+
+  glm::vec3 GetTexel(const glm::vec3& direction) const {
+    glm::vec3 dir = glm::normalize(direction);
+    glm::vec3 color(0.0f);
+    if ((std::abs(dir[0]) >= std::abs(dir[1])) &&
+        (std::abs(dir[0]) >= std::abs(dir[2]))) {
+      if (dir[0] > 0.0f) {
+        color = GetFaceTexel((dir[2] / dir[0] + 1.0f) * 0.5f,
+                             (dir[1] / dir[0] + 1.0f) * 0.5f, 1);
+      } else if (dir[0] < 0.0f) {
+        color = GetFaceTexel((dir[2] / dir[0] + 1.0f) * 0.5f,
+                             1.0f - (dir[1] / dir[0] + 1.0f) * 0.5f, 0);
+      }
+    } else if ((std::abs(dir[1]) >= std::abs(dir[0])) &&
+               (std::abs(dir[1]) >= std::abs(dir[2]))) {
+      if (dir[1] > 0.0f) {
+        color = GetFaceTexel((dir[0] / dir[1] + 1.0f) * 0.5f,
+                             (dir[2] / dir[1] + 1.0f) * 0.5f, 2);
+      } else if (dir[1] < 0.0f) {
+        color = GetFaceTexel(1.0f - (dir[0] / dir[1] + 1.0f) * 0.5f,
+                             1.0f - (dir[2] / dir[1] + 1.0f) * 0.5f, 3);
+      }
+    } else {
+      if (dir[2] > 0.0f) {
+        color = GetFaceTexel(1.0f - (dir[0] / dir[2] + 1.0f) * 0.5f,
+                             (dir[1] / dir[2] + 1.0f) * 0.5f, 4);
+      } else if (dir[2] < 0.0f) {
+        color = GetFaceTexel((dir[0] / dir[2] + 1.0f) * 0.5f,
+                             1.0f - (dir[1] / dir[2] + 1.0f) * 0.5f, 5);
+      }
+    }
+    return color;
+  }
+
+ private:
+  glm::vec3 GetFaceTexel(float x, float y, int face) const {
+    x = x * faces_[face]->GetWidth();
+    y = (1 - y) * faces_[face]->GetHeight();
+    int ix = (int)x;
+    int iy = (int)y;
+    float alpha = x - ix;
+    float beta = y - iy;
+    const glm::vec3& pixel0 = GetPixel(ix + 0, iy + 0, face);
+    const glm::vec3& pixel1 = GetPixel(ix + 1, iy + 0, face);
+    const glm::vec3& pixel2 = GetPixel(ix + 0, iy + 1, face);
+    const glm::vec3& pixel3 = GetPixel(ix + 1, iy + 1, face);
+    glm::vec3 color;
+    for (int i = 0; i < 3; i++) {
+      color[i] = (1 - alpha) * (1 - beta) * pixel0[i] +
+                 alpha * (1 - beta) * pixel1[i] +
+                 (1 - alpha) * beta * pixel2[i] + alpha * beta * pixel3[i];
+    }
+    return color;
+  }
+
+  const glm::vec3& GetPixel(int x, int y, int face) const {
+    x = std::min(std::max(0, x), (int)(faces_[face]->GetWidth() - 1));
+    y = std::min(std::max(0, y), (int)(faces_[face]->GetHeight() - 1));
+    return faces_[face]->GetPixel(x, y);
+  }
+
+  const Image* faces_[6];
+};
+
+// Directions of a panorama swept in scanline order, like the rays of a
+// camera, or in random order with shuffle. The axes and the diagonals
+// between them, where the face choice has ties, come first.
+std::vector<glm::vec3> MakeDirections(size_t count, bool shuffle,
+                                      Random& rng) {
+  std::vector<glm::vec3> directions;
+  directions.reserve(count + 26);
+  for (int x = -1; x <= 1; x++) {
+    for (int y = -1; y <= 1; y++) {
+      for (int z = -1; z <= 1; z++) {
+        if (x != 0 || y != 0 || z != 0) {
+          directions.emplace_back(x, y, z);
+        }
+      }
+    }
+  }
+  size_t height = std::max<size_t>(1, std::sqrt(count / 2.0));
+  size_t width = std::max<size_t>(1, count / height);
+  for (size_t row = 0; row < height; row++) {
+    float theta = kPi * (row + rng.NextFloat()) / height;
+    for (size_t column = 0; column < width; column++) {
+      float phi = 2.0f * kPi * (column + rng.NextFloat()) / width;
+      directions.emplace_back(std::sin(theta) * std::cos(phi),
+                              std::cos(theta),
+                              std::sin(theta) * std::sin(phi));
+    }
+  }
+  if (shuffle) {
+    for (size_t i = directions.size() - 1; i > 0; i--) {
+      size_t j = static_cast<size_t>(rng.NextFloat() * (i + 1));
+      std::swap(directions[i], directions[std::min(j, i)]);
+    }
+  }
+  return directions;
+}
+
+// Best of several runs, as the first one also warms the caches.
+template <class F>
+double TimeMs(size_t repeat, F&& f) {
+  double best = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < repeat; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+void Report(const std::string& name, double ms, size_t lookups) {
+  std::cout << name << ": " << ms << " ms, " << lookups / (ms * 1e3)
+            << " M lookups/s" << std::endl;
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  size_t size = 512;
+  size_t num_lookups = 1000000;
+  size_t repeat = 3;
+  bool shuffle = false;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-size") && i + 1 < argc) {
+      size = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-lookups") && i + 1 < argc) {
+      num_lookups = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-repeat") && i + 1 < argc) {
+      repeat = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+    } else if (!strcmp(argv[i], "-shuffle")) {
+      shuffle = true;
+    } else if (!strcmp(argv[i], "-seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Unknown command line argument: " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  Random rng(seed);
+  std::unique_ptr<Image> images[6];
+  const Image* faces[6];
+  for (int f = 0; f < 6; f++) {
+    images[f] = make_unique<Image>(size, size);
+    for (size_t y = 0; y < size; y++) {
+      for (size_t x = 0; x < size; x++) {
+        images[f]->SetPixel(
+            x, y, glm::vec3(rng.NextFloat(), rng.NextFloat(), rng.NextFloat()));
+      }
+    }
+    faces[f] = images[f].get();
+  }
+  ReferenceCubeMap reference(faces);
+  CubeMap cube_map(faces);
+  std::vector<glm::vec3> directions =
+      MakeDirections(num_lookups, shuffle, rng);
+  size_t count = directions.size();
+
+  std::vector<glm::vec3> reference_colors(count);
+  std::vector<glm::vec3> single_colors(count);
+  std::vector<glm::vec3> batch_colors(count);
+  std::vector<glm::vec3> filtered_colors(count);
+  double reference_ms = TimeMs(repeat, [&]() {
+    for (size_t i = 0; i < count; i++) {
+      reference_colors[i] = reference.GetTexel(directions[i]);
+    }
+  });
+  double single_ms = TimeMs(repeat, [&]() {
+    for (size_t i = 0; i < count; i++) {
+      single_colors[i] = cube_map.GetTexel(directions[i]);
+    }
+  });
+  double batch_ms = TimeMs(repeat, [&]() {
+    cube_map.GetTexels(directions.data(), count, 0.0f, batch_colors.data());
+  });
+  // The footprint of 4 texels at the center of a face.
+  float footprint = 8.0f / size;
+  double filtered_ms = TimeMs(repeat, [&]() {
+    cube_map.GetTexels(directions.data(), count, footprint,
+                       filtered_colors.data());
+  });
+
+  // Rounding moves a lookup by a small fraction of a texel, so its color by
+  // a small fraction of the difference between neighboring texels.
+  const float kTolerance = 1e-3f;
+  size_t mismatches = 0;
+  float max_difference = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 difference =
+        glm::max(glm::abs(single_colors[i] - reference_colors[i]),
+                 glm::abs(batch_colors[i] - reference_colors[i]));
+    float max_component =
+        std::max(difference.x, std::max(difference.y, difference.z));
+    max_difference = std::max(max_difference, max_component);
+    if (!(max_component <= kTolerance) ||
+        cube_map.GetTexel(directions[i], footprint) != filtered_colors[i]) {
+      mismatches++;
+    }
+  }
+  // Random texels average out to about 0.5 on coarse levels.
+  double reference_spread = 0.0;
+  double filtered_spread = 0.0;
+  for (size_t i = 0; i < count; i++) {
+    reference_spread += std::abs(reference_colors[i].x - 0.5f);
+    filtered_spread += std::abs(filtered_colors[i].x - 0.5f);
+  }
+
+  std::cout << count << (shuffle ? " shuffled" : " panorama")
+            << " lookups, 6 faces of " << size << "x" << size
+            << ", " << cube_map.GetLevelCount() << " mip levels" << std::endl;
+  Report("reference", reference_ms, count);
+  Report("GetTexel", single_ms, count);
+  Report("GetTexels", batch_ms, count);
+  Report("GetTexels filtered", filtered_ms, count);
+  std::cout << "speedup: " << reference_ms / single_ms << "x single, "
+            << reference_ms / batch_ms << "x batch, max difference: "
+            << max_difference << ", mismatches: " << mismatches << std::endl;
+  std::cout << "mean |red - 0.5|: " << reference_spread / count
+            << " unfiltered, " << filtered_spread / count << " filtered"
+            << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
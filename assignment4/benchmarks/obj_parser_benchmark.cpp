@@ -0,0 +1,216 @@
+// Measures the throughput of ObjParser in MB/s, next to a line-by-line
+// stream parser like the one it replaced, and checks that both produce
+// bit-identical vertex data and indices.
+//
+// Without -obj, a terrain grid with positions, normals, texture coordinates
+// and v/vt/vn faces is generated and written to a file in the temporary
+// directory ($TMPDIR, $TEMP or /tmp).
+//
+// Usage: assignment4_obj_parser_benchmark [-obj FILE] [-triangles N]
+//                                         [-repeat N] [-seed S]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gloo/utils.hpp"
+#include "gloo/parsers/ObjParser.hpp"
+
+#include "Random.hpp"
+
+using namespace GLOO;
+
+namespace {
+// Writes a (side + 1)^2 vertex grid with two triangles per cell.
+void WriteTerrain(const std::string& filename,
+                  size_t num_triangles,
+                  Random& rng) {
+  size_t side = std::max<size_t>(
+      1, static_cast<size_t>(std::sqrt(num_triangles / 2.0)));
+  size_t verts = side + 1;
+  std::ofstream os(filename);
+  os << "# Terrain grid, " << 2 * side * side << " triangles\n";
+  os << std::fixed << std::setprecision(6);
+  for (size_t i = 0; i < verts; i++) {
+    for (size_t j = 0; j < verts; j++) {
+      float x = static_cast<float>(i) / side;
+      float z = static_cast<float>(j) / side;
+      os << "v " << x << " " << 0.1f * rng.NextFloat() << " " << z << "\n";
+    }
+  }
+  for (size_t i = 0; i < verts; i++) {
+    for (size_t j = 0; j < verts; j++) {
+      glm::vec3 n = glm::normalize(glm::vec3(rng.NextFloat() - 0.5f, 4.0f,
+                                             rng.NextFloat() - 0.5f));
+      os << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+    }
+  }
+  for (size_t i = 0; i < verts; i++) {
+    for (size_t j = 0; j < verts; j++) {
+      os << "vt " << static_cast<float>(i) / side << " "
+         << static_cast<float>(j) / side << "\n";
+    }
+  }
+  os << "g terrain\n";
+  for (size_t i = 0; i < side; i++) {
+    for (size_t j = 0; j < side; j++) {
+      size_t a = i * verts + j + 1;
+      size_t b = a + 1;
+      size_t c = a + verts;
+      size_t d = c + 1;
+      os << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/"
+         << b << " " << d << "/" << d << "/" << d << "\n";
+      os << "f " << a << "/" << a << "/" << a << " " << d << "/" << d << "/"
+         << d << " " << c << "/" << c << "/" << c << "\n";
+    }
+  }
+}
+
+// The line-by-line parsing of vertex data and faces that ObjParser used
+// before it was chunked, for comparison.
+ObjParser::ParsedData ParseLines(const std::string& filename) {
+  ObjParser::ParsedData data;
+  data.positions = make_unique<PositionArray>();
+  data.normals = make_unique<NormalArray>();
+  data.tex_coords = make_unique<TexCoordArray>();
+  data.indices = make_unique<IndexArray>();
+  std::fstream fs(filename);
+  std::string line;
+  while (std::getline(fs, line)) {
+    std::stringstream ss(line);
+    std::string command;
+    ss >> command;
+    if (command == "v") {
+      glm::vec3 p;
+      ss >> p.x >> p.y >> p.z;
+      data.positions->push_back(p);
+    } else if (command == "vn") {
+      glm::vec3 n;
+      ss >> n.x >> n.y >> n.z;
+      data.normals->push_back(n);
+    } else if (command == "vt") {
+      glm::vec2 uv;
+      ss >> uv.s >> uv.t;
+      data.tex_coords->push_back(uv);
+    } else if (command == "f") {
+      for (int t = 0; t < 3; t++) {
+        std::string str;
+        ss >> str;
+        data.indices->push_back(std::stoul(Split(str, '/')[0]) - 1);
+      }
+    }
+  }
+  return data;
+}
+
+template <typename T>
+bool SameArrays(const std::unique_ptr<std::vector<T>>& a,
+                const std::unique_ptr<std::vector<T>>& b) {
+  size_t size_a = a ? a->size() : 0;
+  size_t size_b = b ? b->size() : 0;
+  return size_a == size_b &&
+         (size_a == 0 ||
+          std::memcmp(a->data(), b->data(), size_a * sizeof(T)) == 0);
+}
+
+template <class F>
+double TimeMs(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::string GetTempPath(const std::string& name) {
+  const char* dir = std::getenv("TMPDIR");
+  if (dir == nullptr) {
+    dir = std::getenv("TEMP");
+  }
+  return std::string(dir != nullptr ? dir : "/tmp") + "/" + name;
+}
+
+void Report(const std::string& name, double value, const char* unit) {
+  std::cout << name << " " << value << " " << unit << std::endl;
+}
+
+void ReportRate(const std::string& name, double ms, size_t bytes) {
+  Report(name + ".parse", ms, "ms");
+  Report(name + ".throughput", bytes / (ms * 1e3), "MB/s");
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  std::string obj_file;
+  size_t num_triangles = 2000000;
+  size_t repeat = 3;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-obj") && i + 1 < argc) {
+      obj_file = argv[++i];
+    } else if (!strcmp(argv[i], "-triangles") && i + 1 < argc) {
+      num_triangles = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-repeat") && i + 1 < argc) {
+      repeat = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+    } else if (!strcmp(argv[i], "-seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Unknown command line argument: " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  bool generated = obj_file.empty();
+  if (generated) {
+    obj_file = GetTempPath("obj_parser_benchmark.obj");
+    Random rng(seed);
+    WriteTerrain(obj_file, num_triangles, rng);
+  }
+  size_t bytes;
+  {
+    std::ifstream file(obj_file, std::ios::binary | std::ios::ate);
+    if (!file) {
+      std::cerr << "Unable to read " << obj_file << std::endl;
+      return 1;
+    }
+    bytes = static_cast<size_t>(file.tellg());
+  }
+
+  // Best of several runs, as the first one also warms the page cache.
+  bool success = false;
+  ObjParser::ParsedData parsed;
+  double parser_ms = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < repeat; i++) {
+    parser_ms = std::min(parser_ms, TimeMs([&]() {
+      parsed = ObjParser::Parse(obj_file, success);
+    }));
+  }
+  ObjParser::ParsedData reference;
+  double reference_ms = TimeMs([&]() { reference = ParseLines(obj_file); });
+  if (generated) {
+    std::remove(obj_file.c_str());
+  }
+
+  std::cout << "# assignment4 obj parser benchmark, " << bytes / 1e6
+            << " MB, " << (parsed.indices ? parsed.indices->size() / 3 : 0)
+            << " triangles" << std::endl;
+  ReportRate("line_by_line", reference_ms, bytes);
+  ReportRate("obj_parser", parser_ms, bytes);
+  if (!success || !SameArrays(parsed.positions, reference.positions) ||
+      !SameArrays(parsed.normals, reference.normals) ||
+      !SameArrays(parsed.tex_coords, reference.tex_coords) ||
+      !SameArrays(parsed.indices, reference.indices)) {
+    std::cerr << "ObjParser and the line-by-line parser disagree!"
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,517 @@
+// Benchmark suite for the ray tracer on procedurally generated scenes, so it
+// runs without any assets. Measures accelerator build times, the leaf
+// triangle kernels, primary/shadow/bounce ray throughput against single
+// meshes, and end-to-end Tracer::Render.
+//
+// Every result is printed as one "<name> <value> <unit>" line; lines that
+// start with '#' are comments. Outputs of two commits can be compared with
+// join or diff.
+//
+// Usage: assignment4_tracer_benchmark [-max_triangles N] [-rays N]
+//                                     [-size W H] [-threads N]
+//                                     [-sphere_grid N] [-lights N]
+//                                     [-seed S]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gloo/utils.hpp"
+#include "gloo/Scene.hpp"
+#include "gloo/components/LightComponent.hpp"
+#include "gloo/components/MaterialComponent.hpp"
+#include "gloo/lights/AmbientLight.hpp"
+#include "gloo/lights/DirectionalLight.hpp"
+#include "gloo/lights/PointLight.hpp"
+
+#include "hittable/Mesh.hpp"
+#include "hittable/Plane.hpp"
+#include "hittable/Sphere.hpp"
+#include "MeshBVH.hpp"
+#include "Random.hpp"
+#include "Tracer.hpp"
+#include "TracingComponent.hpp"
+#include "TriangleBlocks.hpp"
+
+using namespace GLOO;
+
+namespace {
+const float kPi = 3.14159265358979f;
+
+struct Options {
+  size_t max_triangles = 1000000;
+  size_t num_rays = 262144;
+  glm::ivec2 image_size = glm::ivec2(320, 240);
+  size_t threads = 0;
+  size_t sphere_grid = 16;
+  size_t num_lights = 32;
+  unsigned int seed = 1;
+};
+
+// Mutes std::cout (progress and build messages) while in scope.
+class QuietScope {
+ public:
+  QuietScope() : saved_(std::cout.rdbuf(sink_.rdbuf())) {
+  }
+  ~QuietScope() {
+    std::cout.rdbuf(saved_);
+  }
+
+ private:
+  std::ostringstream sink_;
+  std::streambuf* saved_;
+};
+
+template <class F>
+double TimeMs(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void Report(const std::string& name, double value, const char* unit) {
+  std::cout << name << " " << value << " " << unit << std::endl;
+}
+
+void ReportRate(const std::string& name, size_t rays, double ms) {
+  Report(name, rays / (ms * 1e3), "Mrays/s");
+}
+
+std::string CountName(size_t n) {
+  if (n >= 1000000 && n % 1000000 == 0) {
+    return std::to_string(n / 1000000) + "m";
+  }
+  if (n >= 1000 && n % 1000 == 0) {
+    return std::to_string(n / 1000) + "k";
+  }
+  return std::to_string(n);
+}
+
+// Latitude-longitude unit sphere with about num_triangles triangles. The
+// triangles at the poles are degenerate and never hit.
+std::unique_ptr<Mesh> MakeSphereMesh(size_t num_triangles,
+                                     const AcceleratorOptions& options) {
+  size_t rings = std::max<size_t>(
+      2, static_cast<size_t>(std::sqrt(num_triangles / 4.0)));
+  size_t segments = 2 * rings;
+  auto positions = make_unique<PositionArray>();
+  auto normals = make_unique<NormalArray>();
+  auto indices = make_unique<IndexArray>();
+  for (size_t r = 0; r <= rings; r++) {
+    float theta = kPi * r / rings;
+    for (size_t s = 0; s <= segments; s++) {
+      float phi = 2.0f * kPi * s / segments;
+      glm::vec3 p(std::sin(theta) * std::cos(phi), std::cos(theta),
+                  std::sin(theta) * std::sin(phi));
+      positions->push_back(p);
+      normals->push_back(p);
+    }
+  }
+  for (size_t r = 0; r < rings; r++) {
+    for (size_t s = 0; s < segments; s++) {
+      unsigned int a = static_cast<unsigned int>(r * (segments + 1) + s);
+      unsigned int b = a + static_cast<unsigned int>(segments + 1);
+      indices->insert(indices->end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  return make_unique<Mesh>(std::move(positions), std::move(normals),
+                           std::move(indices), options);
+}
+
+// Rolling height field over [-1, 1]^2 with about num_triangles triangles.
+std::unique_ptr<Mesh> MakeTerrainMesh(size_t num_triangles,
+                                      const AcceleratorOptions& options) {
+  size_t cells = std::max<size_t>(
+      1, static_cast<size_t>(std::sqrt(num_triangles / 2.0)));
+  auto height = [](float x, float z) {
+    return 0.15f * std::sin(5.0f * x) * std::cos(4.0f * z) +
+           0.05f * std::sin(17.0f * x + 11.0f * z);
+  };
+  auto positions = make_unique<PositionArray>();
+  auto normals = make_unique<NormalArray>();
+  auto indices = make_unique<IndexArray>();
+  float step = 2.0f / cells;
+  for (size_t j = 0; j <= cells; j++) {
+    for (size_t i = 0; i <= cells; i++) {
+      float x = -1.0f + step * i;
+      float z = -1.0f + step * j;
+      positions->emplace_back(x, height(x, z), z);
+      // Normal from central differences.
+      float h = 0.5f * step;
+      float dx = height(x + h, z) - height(x - h, z);
+      float dz = height(x, z + h) - height(x, z - h);
+      normals->push_back(glm::normalize(glm::vec3(-dx, 2.0f * h, -dz)));
+    }
+  }
+  for (size_t j = 0; j < cells; j++) {
+    for (size_t i = 0; i < cells; i++) {
+      unsigned int a = static_cast<unsigned int>(j * (cells + 1) + i);
+      unsigned int b = a + static_cast<unsigned int>(cells + 1);
+      indices->insert(indices->end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  return make_unique<Mesh>(std::move(positions), std::move(normals),
+                           std::move(indices), options);
+}
+
+// A width x height grid of rays from eye toward the origin.
+std::vector<Ray> MakePrimaryRays(const glm::vec3& eye, size_t num_rays) {
+  size_t width = static_cast<size_t>(std::sqrt(double(num_rays)));
+  size_t height = (num_rays + width - 1) / width;
+  glm::vec3 forward = glm::normalize(-eye);
+  glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0, 1, 0)));
+  glm::vec3 up = glm::cross(right, forward);
+  float extent = std::tan(0.5f * 45.0f * kPi / 180.0f);
+  std::vector<Ray> rays;
+  rays.reserve(num_rays);
+  for (size_t k = 0; k < num_rays; k++) {
+    float u = (2.0f * (k % width) + 1.0f) / width - 1.0f;
+    float v = (2.0f * (k / width) + 1.0f) / height - 1.0f;
+    glm::vec3 direction = forward + extent * (u * right + v * up);
+    rays.emplace_back(eye, glm::normalize(direction));
+  }
+  return rays;
+}
+
+// Time to update the mesh's acceleration structure for a wave that moves
+// every vertex up or down by up to a tenth of the mesh's height: a refit
+// where the structure allows it, a rebuild otherwise. For BVHs also reports
+// how much the refit raised the SAH cost.
+void BenchmarkRefit(const std::string& prefix, Mesh& mesh) {
+  const MeshBVH* bvh = dynamic_cast<const MeshBVH*>(&mesh.GetAccelerator());
+  float build_cost = bvh ? bvh->GetSahCost() : 0.0f;
+  auto positions = make_unique<PositionArray>(mesh.GetPositions().begin(),
+                                              mesh.GetPositions().end());
+  auto normals = make_unique<NormalArray>(mesh.GetNormals().begin(),
+                                          mesh.GetNormals().end());
+  for (glm::vec3& p : *positions) {
+    p.y += 0.1f * std::sin(3.0f * p.x + 2.0f * p.z);
+  }
+  double ms = TimeMs([&]() {
+    mesh.UpdateVertices(std::move(positions), std::move(normals),
+                        std::numeric_limits<float>::max());
+  });
+  Report(prefix + (bvh ? ".refit" : ".rebuild"), ms, "ms");
+  if (bvh && build_cost > 0.0f) {
+    Report(prefix + ".refit_cost_ratio", bvh->GetSahCost() / build_cost,
+           "x");
+  }
+}
+
+// Primary, shadow and bounce ray throughput of one accelerator on one mesh,
+// traced one ray at a time on this thread.
+void BenchmarkRays(const std::string& prefix,
+                   const Mesh& mesh,
+                   const glm::vec3& eye,
+                   const Options& options) {
+  std::vector<Ray> primary = MakePrimaryRays(eye, options.num_rays);
+  std::vector<HitRecord> records(primary.size());
+  double primary_ms = TimeMs([&]() {
+    for (size_t i = 0; i < primary.size(); i++) {
+      mesh.Intersect(primary[i], 0.0f, records[i]);
+    }
+  });
+  ReportRate(prefix + ".primary", primary.size(), primary_ms);
+
+  const glm::vec3 light(2.0f, 4.0f, 3.0f);
+  std::vector<Ray> shadow;
+  std::vector<float> shadow_t_max;
+  std::vector<Ray> bounce;
+  for (size_t i = 0; i < primary.size(); i++) {
+    if (records[i].time == std::numeric_limits<float>::max()) {
+      continue;
+    }
+    glm::vec3 hit = primary[i].At(records[i].time);
+    glm::vec3 to_light = light - hit;
+    shadow.emplace_back(hit, glm::normalize(to_light));
+    shadow_t_max.push_back(glm::length(to_light));
+    bounce.emplace_back(
+        hit, glm::reflect(primary[i].GetDirection(), records[i].normal));
+  }
+  Report(prefix + ".primary_hits", double(shadow.size()), "rays");
+  if (shadow.empty()) {
+    return;
+  }
+
+  size_t occluded = 0;
+  double shadow_ms = TimeMs([&]() {
+    for (size_t i = 0; i < shadow.size(); i++) {
+      occluded += mesh.Occluded(shadow[i], 1e-3f, shadow_t_max[i]);
+    }
+  });
+  ReportRate(prefix + ".shadow", shadow.size(), shadow_ms);
+
+  double bounce_ms = TimeMs([&]() {
+    for (size_t i = 0; i < bounce.size(); i++) {
+      HitRecord record;
+      mesh.Intersect(bounce[i], 1e-3f, record);
+    }
+  });
+  ReportRate(prefix + ".bounce", bounce.size(), bounce_ms);
+}
+
+// Scalar and SIMD leaf kernels on one leaf made of the first triangles of
+// mesh, with rays from the primary grid.
+void BenchmarkKernels(const Mesh& mesh, const Options& options) {
+  size_t num_triangles = std::min<size_t>(1024, mesh.GetTriangleCount());
+  std::vector<uint32_t> indices(num_triangles);
+  for (size_t i = 0; i < num_triangles; i++) {
+    indices[i] = static_cast<uint32_t>(i);
+  }
+  TriangleBlocks blocks;
+  blocks.Build(mesh, indices);
+  uint32_t count = static_cast<uint32_t>(num_triangles);
+  std::vector<Ray> rays =
+      MakePrimaryRays(glm::vec3(0.0f, 3.0f, 0.5f), options.num_rays / 16);
+
+  size_t tests = rays.size() * num_triangles;
+  double scalar_ms = TimeMs([&]() {
+    for (const Ray& ray : rays) {
+      HitRecord record;
+      for (uint32_t t = 0; t < count; t++) {
+        mesh.IntersectTriangle(t, ray, 0.0f, record);
+      }
+    }
+  });
+  Report("kernel.scalar", tests / (scalar_ms * 1e3), "Mtests/s");
+  double simd_ms = TimeMs([&]() {
+    for (const Ray& ray : rays) {
+      HitRecord record;
+      blocks.Intersect(0, count, ray, 0.0f, record);
+    }
+  });
+  Report(std::string("kernel.") + TriangleBlocks::GetInstructionSet(),
+         tests / (simd_ms * 1e3), "Mtests/s");
+}
+
+void BenchmarkMeshes(const Options& options) {
+  const AcceleratorType types[] = {AcceleratorType::Octree,
+                                   AcceleratorType::BVH};
+  const char* type_names[] = {"octree", "bvh"};
+  for (size_t n = 1000; n <= options.max_triangles; n *= 10) {
+    for (int shape = 0; shape < 2; shape++) {
+      for (int t = 0; t < 2; t++) {
+        AcceleratorOptions accelerator;
+        accelerator.type = types[t];
+        std::unique_ptr<Mesh> mesh;
+        {
+          QuietScope quiet;
+          mesh = shape == 0 ? MakeSphereMesh(n, accelerator)
+                            : MakeTerrainMesh(n, accelerator);
+        }
+        std::string prefix = std::string(shape == 0 ? "sphere_" : "terrain_") +
+                             CountName(n) + "." + type_names[t];
+        const AcceleratorStats& stats = mesh->GetAcceleratorStats();
+        Report(prefix + ".triangles", double(mesh->GetTriangleCount()),
+               "triangles");
+        Report(prefix + ".build", stats.build_ms, "ms");
+        Report(prefix + ".nodes", double(stats.node_count), "nodes");
+        glm::vec3 eye = shape == 0 ? glm::vec3(0.0f, 1.0f, 3.0f)
+                                   : glm::vec3(0.0f, 1.2f, 2.2f);
+        BenchmarkRays(prefix, *mesh, eye, options);
+        if (n == 1000 && shape == 1 && t == 0) {
+          BenchmarkKernels(*mesh, options);
+        }
+        BenchmarkRefit(prefix, *mesh);
+      }
+    }
+  }
+}
+
+std::shared_ptr<Material> MakeMaterial(const glm::vec3& diffuse) {
+  auto material = std::make_shared<Material>();
+  material->SetAmbientColor(diffuse);
+  material->SetDiffuseColor(diffuse);
+  material->SetSpecularColor(glm::vec3(0.3f));
+  material->SetShininess(20.0f);
+  return material;
+}
+
+void AddObject(SceneNode& root,
+               std::shared_ptr<HittableBase> object,
+               const glm::vec3& position,
+               std::shared_ptr<Material> material) {
+  auto node = make_unique<SceneNode>();
+  node->GetTransform().SetPosition(position);
+  node->CreateComponent<MaterialComponent>(std::move(material));
+  node->CreateComponent<TracingComponent>(std::move(object));
+  root.AddChild(std::move(node));
+}
+
+void AddLight(SceneNode& root,
+              std::shared_ptr<LightBase> light,
+              const glm::vec3& position) {
+  auto node = make_unique<SceneNode>();
+  node->GetTransform().SetPosition(position);
+  node->CreateComponent<LightComponent>(std::move(light));
+  root.AddChild(std::move(node));
+}
+
+// Ground plane, one directional light and num_point_lights point lights
+// spread over the scene, plus the ambient light SceneParser always adds.
+std::unique_ptr<SceneNode> MakeStage(size_t num_point_lights, Random& rng) {
+  auto root = make_unique<SceneNode>();
+  AddObject(*root, std::make_shared<Plane>(glm::vec3(0, 1, 0), -1.0f),
+            glm::vec3(0.0f), MakeMaterial(glm::vec3(0.6f)));
+  auto ambient = std::make_shared<AmbientLight>();
+  ambient->SetAmbientColor(glm::vec3(0.1f));
+  AddLight(*root, ambient, glm::vec3(0.0f));
+  auto sun = std::make_shared<DirectionalLight>();
+  sun->SetDiffuseColor(glm::vec3(0.8f));
+  sun->SetSpecularColor(glm::vec3(0.8f));
+  sun->SetDirection(glm::normalize(glm::vec3(-0.3f, -1.0f, -0.5f)));
+  AddLight(*root, sun, glm::vec3(0.0f));
+  for (size_t i = 0; i < num_point_lights; i++) {
+    auto light = std::make_shared<PointLight>();
+    glm::vec3 color(2.0f / num_point_lights);
+    light->SetDiffuseColor(color);
+    light->SetSpecularColor(color);
+    light->SetAttenuation(glm::vec3(0.1f));
+    glm::vec3 position(8.0f * rng.NextFloat() - 4.0f,
+                       1.0f + 3.0f * rng.NextFloat(),
+                       8.0f * rng.NextFloat() - 4.0f);
+    AddLight(*root, light, position);
+  }
+  return root;
+}
+
+void AddSphereGrid(SceneNode& root, size_t grid, Random& rng) {
+  float spacing = 6.0f / grid;
+  for (size_t j = 0; j < grid; j++) {
+    for (size_t i = 0; i < grid; i++) {
+      glm::vec3 position(-3.0f + spacing * (i + 0.5f), -0.6f,
+                         -3.0f + spacing * (j + 0.5f));
+      glm::vec3 color(rng.NextFloat(), rng.NextFloat(), rng.NextFloat());
+      AddObject(root, std::make_shared<Sphere>(0.4f * spacing), position,
+                MakeMaterial(color));
+    }
+  }
+}
+
+void BenchmarkRender(const std::string& name,
+                     std::unique_ptr<SceneNode> root,
+                     const Options& options,
+                     RenderOptions render_options = RenderOptions()) {
+  Scene scene(std::move(root));
+  CameraSpec camera;
+  camera.center = glm::vec3(0.0f, 3.0f, 7.0f);
+  camera.direction = glm::normalize(glm::vec3(0.0f, -0.4f, -1.0f));
+  camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
+  camera.fov = 45.0f;
+  render_options.threads = options.threads;
+  render_options.seed = options.seed;
+  Tracer tracer(camera, options.image_size, 1, glm::vec3(0.1f, 0.2f, 0.3f),
+                nullptr, true, 1, CameraType::Perspective, render_options);
+  double ms;
+  {
+    QuietScope quiet;
+    ms = TimeMs([&]() { tracer.Render(scene, ""); });
+  }
+  Report("render." + name, ms, "ms");
+  ReportRate("render." + name + ".camera",
+             size_t(options.image_size.x) * options.image_size.y, ms);
+  const RenderCounters& totals = tracer.GetStats().totals;
+  ReportRate("render." + name + ".all",
+             totals.primary_rays + totals.shadow_rays + totals.bounce_rays,
+             ms);
+}
+
+void BenchmarkRenders(const Options& options) {
+  Random rng(options.seed);
+  // The spheres and the terrain again, rendered breadth first.
+  RenderOptions wavefront;
+  wavefront.wavefront = true;
+  std::string spheres_name = "spheres_" + std::to_string(options.sphere_grid) +
+                             "x" + std::to_string(options.sphere_grid);
+  Random spheres_rng = rng;
+  auto spheres = MakeStage(0, rng);
+  AddSphereGrid(*spheres, options.sphere_grid, rng);
+  BenchmarkRender(spheres_name, std::move(spheres), options);
+  spheres = MakeStage(0, spheres_rng);
+  AddSphereGrid(*spheres, options.sphere_grid, spheres_rng);
+  BenchmarkRender(spheres_name + ".wavefront", std::move(spheres), options,
+                  wavefront);
+
+  // The same lights again, culled and then sampled.
+  std::string lights_name = "lights_" + std::to_string(options.num_lights);
+  Random lights_rng = rng;
+  auto lights = MakeStage(options.num_lights, rng);
+  AddSphereGrid(*lights, 4, rng);
+  BenchmarkRender(lights_name, std::move(lights), options);
+  for (int sampled = 0; sampled < 2; sampled++) {
+    Random rng_copy = lights_rng;
+    lights = MakeStage(options.num_lights, rng_copy);
+    AddSphereGrid(*lights, 4, rng_copy);
+    RenderOptions light_options;
+    light_options.light_threshold = sampled ? 0.0f : 0.05f;
+    light_options.light_samples = sampled ? 4 : 0;
+    BenchmarkRender(lights_name + (sampled ? ".sampled" : ".culled"),
+                    std::move(lights), options, light_options);
+  }
+
+  size_t num_triangles = std::min<size_t>(100000, options.max_triangles);
+  for (int breadth_first = 0; breadth_first < 2; breadth_first++) {
+    Random terrain_rng = rng;
+    auto terrain = MakeStage(1, terrain_rng);
+    {
+      QuietScope quiet;
+      std::shared_ptr<Mesh> mesh =
+          MakeTerrainMesh(num_triangles, AcceleratorOptions());
+      // Scale the unit terrain up to the stage.
+      auto node = make_unique<SceneNode>();
+      node->GetTransform().SetScale(glm::vec3(3.0f));
+      node->GetTransform().SetPosition(glm::vec3(0.0f, -0.5f, 0.0f));
+      node->CreateComponent<MaterialComponent>(
+          MakeMaterial(glm::vec3(0.4f, 0.7f, 0.3f)));
+      node->CreateComponent<TracingComponent>(std::move(mesh));
+      terrain->AddChild(std::move(node));
+    }
+    BenchmarkRender("terrain_" + CountName(num_triangles) +
+                        (breadth_first ? ".wavefront" : ""),
+                    std::move(terrain), options,
+                    breadth_first ? wavefront : RenderOptions());
+  }
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-max_triangles") && i + 1 < argc) {
+      options.max_triangles = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-rays") && i + 1 < argc) {
+      options.num_rays = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-size") && i + 2 < argc) {
+      options.image_size.x = atoi(argv[++i]);
+      options.image_size.y = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-threads") && i + 1 < argc) {
+      options.threads = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-sphere_grid") && i + 1 < argc) {
+      options.sphere_grid = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-lights") && i + 1 < argc) {
+      options.num_lights = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "-seed") && i + 1 < argc) {
+      options.seed = strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Unknown command line argument: " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << "# assignment4 tracer benchmark, kernel "
+            << TriangleBlocks::GetInstructionSet() << " x"
+            << TriangleBlocks::kWidth << ", " << options.num_rays
+            << " rays per mesh, render " << options.image_size.x << "x"
+            << options.image_size.y << std::endl;
+  BenchmarkMeshes(options);
+  BenchmarkRenders(options);
+  return 0;
+}
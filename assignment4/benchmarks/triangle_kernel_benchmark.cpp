@@ -0,0 +1,147 @@
+// Measures ray-triangle tests per second of the scalar Moller-Trumbore test
+// and of the SIMD leaf kernel, and checks that both find the same hits.
+//
+// Usage: assignment4_triangle_kernel_benchmark [-triangles N] [-rays N]
+//                                              [-seed S]
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "gloo/utils.hpp"
+
+#include "hittable/Mesh.hpp"
+#include "Random.hpp"
+#include "TriangleBlocks.hpp"
+
+using namespace GLOO;
+
+namespace {
+glm::vec3 RandomVec3(Random& rng) {
+  float x = rng.NextFloat();
+  float y = rng.NextFloat();
+  float z = rng.NextFloat();
+  return glm::vec3(x, y, z);
+}
+
+// Triangles of roughly a tenth of the unit cube, so a decent fraction of
+// the rays aimed at the cube hit some of them.
+std::unique_ptr<Mesh> MakeMesh(size_t num_triangles, Random& rng) {
+  auto positions = make_unique<PositionArray>();
+  auto normals = make_unique<NormalArray>();
+  auto indices = make_unique<IndexArray>();
+  for (size_t i = 0; i < num_triangles; i++) {
+    glm::vec3 center = RandomVec3(rng);
+    glm::vec3 n = glm::normalize(RandomVec3(rng) - 0.5f);
+    for (int corner = 0; corner < 3; corner++) {
+      positions->push_back(center + 0.2f * (RandomVec3(rng) - 0.5f));
+      normals->push_back(n);
+      indices->push_back(static_cast<unsigned int>(3 * i + corner));
+    }
+  }
+  AcceleratorOptions options;
+  options.type = AcceleratorType::BVH;
+  options.simd = false;
+  return make_unique<Mesh>(std::move(positions), std::move(normals),
+                           std::move(indices), options);
+}
+
+std::vector<Ray> MakeRays(size_t num_rays, Random& rng) {
+  std::vector<Ray> rays;
+  rays.reserve(num_rays);
+  for (size_t i = 0; i < num_rays; i++) {
+    glm::vec3 origin = 4.0f * (RandomVec3(rng) - 0.5f);
+    glm::vec3 target = glm::vec3(0.25f) + 0.5f * RandomVec3(rng);
+    rays.emplace_back(origin, glm::normalize(target - origin));
+  }
+  return rays;
+}
+
+template <class F>
+double TimeMs(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void Report(const std::string& name, double ms, size_t tests) {
+  std::cout << name << ": " << ms << " ms, " << tests / (ms * 1e3)
+            << " M tests/s" << std::endl;
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  size_t num_triangles = 1024;
+  size_t num_rays = 100000;
+  unsigned int seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-triangles") && i + 1 < argc) {
+      num_triangles = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-rays") && i + 1 < argc) {
+      num_rays = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-seed") && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Unknown command line argument: " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  Random rng(seed);
+  std::unique_ptr<Mesh> mesh = MakeMesh(num_triangles, rng);
+  std::vector<Ray> rays = MakeRays(num_rays, rng);
+
+  // All triangles form one long leaf, so both paths do the same tests.
+  std::vector<uint32_t> indices(num_triangles);
+  for (size_t i = 0; i < num_triangles; i++) {
+    indices[i] = static_cast<uint32_t>(i);
+  }
+  TriangleBlocks blocks;
+  blocks.Build(*mesh, indices);
+  uint32_t count = static_cast<uint32_t>(num_triangles);
+
+  std::vector<HitRecord> scalar_records(num_rays);
+  std::vector<HitRecord> simd_records(num_rays);
+  double scalar_ms = TimeMs([&]() {
+    for (size_t r = 0; r < num_rays; r++) {
+      for (uint32_t t = 0; t < count; t++) {
+        mesh->IntersectTriangle(t, rays[r], 0.0f, scalar_records[r]);
+      }
+    }
+  });
+  double simd_ms = TimeMs([&]() {
+    for (size_t r = 0; r < num_rays; r++) {
+      blocks.Intersect(0, count, rays[r], 0.0f, simd_records[r]);
+    }
+  });
+
+  size_t hits = 0;
+  size_t mismatches = 0;
+  for (size_t r = 0; r < num_rays; r++) {
+    const HitRecord& a = scalar_records[r];
+    const HitRecord& b = simd_records[r];
+    if (a.time != b.time) {
+      mismatches++;
+    } else if (a.time != std::numeric_limits<float>::max()) {
+      hits++;
+      if (a.normal != b.normal) {
+        mismatches++;
+      }
+    }
+  }
+
+  size_t tests = num_rays * num_triangles;
+  std::cout << num_rays << " rays x " << num_triangles << " triangles, "
+            << hits << " rays hit" << std::endl;
+  Report("scalar", scalar_ms, tests);
+  Report(std::string(TriangleBlocks::GetInstructionSet()) + " x" +
+             std::to_string(TriangleBlocks::kWidth),
+         simd_ms, tests);
+  std::cout << "speedup: " << scalar_ms / simd_ms << "x, mismatches: "
+            << mismatches << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
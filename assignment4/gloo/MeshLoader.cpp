@@ -4,12 +4,23 @@
 #include <algorithm>
 
 #include "gloo/utils.hpp"
+#include "gloo/parsers/BinaryMeshFile.hpp"
 
 namespace GLOO {
 MeshData MeshLoader::Import(const std::string& filename) {
   std::string file_path = GetAssetDir() + filename;
   bool success;
-  auto parsed_data = ObjParser::Parse(file_path, success);
+  ObjParser::ParsedData parsed_data;
+  if (BinaryMeshFile::IsBinaryMeshPath(filename)) {
+    // The vertex object owns its arrays, so each section is copied once.
+    BinaryMeshFile mesh_file;
+    success = mesh_file.Open(file_path);
+    if (success) {
+      parsed_data = mesh_file.ToParsedData();
+    }
+  } else {
+    parsed_data = ObjParser::Parse(file_path, success);
+  }
   if (!success) {
     std::cerr << "Load mesh file " << filename << " failed!" << std::endl;
     return {};
@@ -0,0 +1,274 @@
+// Checks that TileCoordinator recovers from workers that fail, on a
+// procedurally generated scene, so it runs without any assets. The test is
+// the coordinator, and TileCoordinator starts it again with
+// "-worker_fd F -worker_index I" as each of the workers; the scenario
+// decides which of them exit or hang, and when.
+//
+// Scenarios:
+//   recover: of three workers, one exits and one hangs partway through.
+//     The render must complete, with the lost worker's tiles handed out
+//     again, and match a single-process render.
+//   hang_loading: of two workers, one hangs before it has loaded the scene
+//     and the other exits. The render must fail at the ready timeout
+//     instead of waiting forever.
+//
+// Usage: assignment4_distributed_render_test [-scenario NAME]
+// Runs every scenario unless one is given; exits with the number of
+// scenarios that failed.
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gloo/utils.hpp"
+#include "gloo/Scene.hpp"
+#include "gloo/components/LightComponent.hpp"
+#include "gloo/components/MaterialComponent.hpp"
+#include "gloo/lights/AmbientLight.hpp"
+#include "gloo/lights/DirectionalLight.hpp"
+#include "gloo/lights/PointLight.hpp"
+
+#include "hittable/Plane.hpp"
+#include "hittable/Sphere.hpp"
+#include "DistributedRender.hpp"
+#include "Tracer.hpp"
+#include "TracingComponent.hpp"
+
+using namespace GLOO;
+
+namespace {
+const glm::ivec2 kImageSize(96, 64);
+const glm::ivec2 kTileSize(16, 16);
+
+// Workers that misbehave in each scenario, and after how many tiles.
+const size_t kRecoverFailWorker = 1;
+const size_t kRecoverFailAfter = 2;
+const size_t kRecoverStallWorker = 2;
+const size_t kRecoverStallAfter = 1;
+const size_t kLoadingHangWorker = 1;
+const size_t kLoadingFailWorker = 0;
+const size_t kLoadingFailAfter = 1;
+
+void Hang() {
+  while (true) {
+    pause();
+  }
+}
+
+std::shared_ptr<Material> MakeMaterial(const glm::vec3& diffuse) {
+  auto material = std::make_shared<Material>();
+  material->SetAmbientColor(diffuse);
+  material->SetDiffuseColor(diffuse);
+  material->SetSpecularColor(glm::vec3(0.3f));
+  material->SetShininess(20.0f);
+  return material;
+}
+
+void AddObject(SceneNode& root,
+               std::shared_ptr<HittableBase> object,
+               const glm::vec3& position,
+               std::shared_ptr<Material> material) {
+  auto node = make_unique<SceneNode>();
+  node->GetTransform().SetPosition(position);
+  node->CreateComponent<MaterialComponent>(std::move(material));
+  node->CreateComponent<TracingComponent>(std::move(object));
+  root.AddChild(std::move(node));
+}
+
+void AddLight(SceneNode& root,
+              std::shared_ptr<LightBase> light,
+              const glm::vec3& position) {
+  auto node = make_unique<SceneNode>();
+  node->GetTransform().SetPosition(position);
+  node->CreateComponent<LightComponent>(std::move(light));
+  root.AddChild(std::move(node));
+}
+
+// A ground plane with a row of spheres, lit by an ambient, a directional
+// and a point light. Every process builds the same scene.
+std::unique_ptr<Scene> MakeScene() {
+  auto root = make_unique<SceneNode>();
+  AddObject(*root, std::make_shared<Plane>(glm::vec3(0, 1, 0), -1.0f),
+            glm::vec3(0.0f), MakeMaterial(glm::vec3(0.6f)));
+  for (int i = 0; i < 3; i++) {
+    AddObject(*root, std::make_shared<Sphere>(0.8f),
+              glm::vec3(2.0f * i - 2.0f, -0.2f, 0.0f),
+              MakeMaterial(glm::vec3(0.2f + 0.3f * i, 0.5f, 0.8f - 0.3f * i)));
+  }
+  auto ambient = std::make_shared<AmbientLight>();
+  ambient->SetAmbientColor(glm::vec3(0.1f));
+  AddLight(*root, ambient, glm::vec3(0.0f));
+  auto sun = std::make_shared<DirectionalLight>();
+  sun->SetDiffuseColor(glm::vec3(0.6f));
+  sun->SetSpecularColor(glm::vec3(0.6f));
+  sun->SetDirection(glm::normalize(glm::vec3(-0.3f, -1.0f, -0.5f)));
+  AddLight(*root, sun, glm::vec3(0.0f));
+  auto lamp = std::make_shared<PointLight>();
+  lamp->SetDiffuseColor(glm::vec3(0.8f));
+  lamp->SetSpecularColor(glm::vec3(0.8f));
+  lamp->SetAttenuation(glm::vec3(0.1f));
+  AddLight(*root, lamp, glm::vec3(1.0f, 3.0f, 2.0f));
+  return make_unique<Scene>(std::move(root));
+}
+
+std::unique_ptr<Tracer> MakeTracer() {
+  CameraSpec camera;
+  camera.center = glm::vec3(0.0f, 1.5f, 6.0f);
+  camera.direction = glm::normalize(glm::vec3(0.0f, -0.3f, -1.0f));
+  camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
+  camera.fov = 45.0f;
+  RenderOptions options;
+  options.tile_size = kTileSize;
+  return make_unique<Tracer>(camera, kImageSize, 1,
+                             glm::vec3(0.1f, 0.2f, 0.3f), nullptr, true, 2,
+                             CameraType::Perspective, options);
+}
+
+int RunWorker(const std::string& scenario, int fd, size_t worker_index) {
+  std::unique_ptr<Scene> scene = MakeScene();
+  std::unique_ptr<Tracer> tracer = MakeTracer();
+  if (scenario == "hang_loading" && worker_index == kLoadingHangWorker) {
+    Hang();
+  }
+  tracer->Prepare(*scene);
+  RunTileWorker(fd, worker_index, *tracer, [&](size_t tiles_done) {
+    if (scenario == "recover") {
+      if (worker_index == kRecoverFailWorker &&
+          tiles_done == kRecoverFailAfter) {
+        _exit(1);
+      }
+      if (worker_index == kRecoverStallWorker &&
+          tiles_done == kRecoverStallAfter) {
+        Hang();
+      }
+    } else if (scenario == "hang_loading" &&
+               worker_index == kLoadingFailWorker &&
+               tiles_done == kLoadingFailAfter) {
+      _exit(1);
+    }
+  });
+  return 0;
+}
+
+// The whole image rendered in this process, as one tile.
+std::unique_ptr<Image> RenderReference() {
+  std::unique_ptr<Scene> scene = MakeScene();
+  std::unique_ptr<Tracer> tracer = MakeTracer();
+  tracer->Prepare(*scene);
+  auto image = make_unique<Image>(kImageSize.x, kImageSize.y);
+  Tile tile = {0, 0, size_t(kImageSize.x), size_t(kImageSize.y)};
+  tracer->RenderTileImage(tile, *image);
+  return image;
+}
+
+bool Check(bool condition, const std::string& scenario, const char* what) {
+  if (!condition) {
+    std::cerr << scenario << ": FAILED: " << what << std::endl;
+  }
+  return condition;
+}
+
+bool TestRecover(const char* program) {
+  const std::string scenario = "recover";
+  std::unique_ptr<Image> reference = RenderReference();
+  DistributedOptions options;
+  options.workers = 3;
+  options.timeout_ms = 200.0;
+  TileCoordinator coordinator({program, "-scenario", scenario}, kImageSize,
+                              kTileSize, options);
+  std::unique_ptr<Image> image = coordinator.Render();
+
+  size_t mismatches = 0;
+  for (int y = 0; y < kImageSize.y; y++) {
+    for (int x = 0; x < kImageSize.x; x++) {
+      if (image->GetPixel(x, y) != reference->GetPixel(x, y)) {
+        mismatches++;
+      }
+    }
+  }
+  const std::vector<size_t>& tiles = coordinator.GetTilesPerWorker();
+  size_t tile_count = 0;
+  for (size_t count : tiles) {
+    tile_count += count;
+  }
+  size_t expected_tiles = ((kImageSize.x + kTileSize.x - 1) / kTileSize.x) *
+                          ((kImageSize.y + kTileSize.y - 1) / kTileSize.y);
+  bool ok = Check(mismatches == 0, scenario,
+                  "image differs from the single-process render");
+  ok &= Check(tile_count == expected_tiles, scenario,
+              "tiles were lost or counted twice");
+  ok &= Check(coordinator.GetLostWorkers() == 1, scenario,
+              "the exiting worker was not the only one lost");
+  ok &= Check(coordinator.GetReassignedTiles() > 0, scenario,
+              "no tiles were reassigned");
+  ok &= Check(tiles[kRecoverFailWorker] <= kRecoverFailAfter &&
+                  tiles[kRecoverStallWorker] <= kRecoverStallAfter,
+              scenario, "a failing worker delivered too many tiles");
+  std::cout << scenario << ": " << mismatches << " mismatched pixels, "
+            << coordinator.GetReassignedTiles() << " tiles reassigned, "
+            << coordinator.GetLostWorkers() << " workers lost" << std::endl;
+  return ok;
+}
+
+bool TestHangLoading(const char* program) {
+  const std::string scenario = "hang_loading";
+  DistributedOptions options;
+  options.workers = 2;
+  options.timeout_ms = 200.0;
+  options.ready_timeout_ms = 500.0;
+  auto start = std::chrono::steady_clock::now();
+  bool failed = false;
+  try {
+    TileCoordinator coordinator({program, "-scenario", scenario}, kImageSize,
+                                kTileSize, options);
+    coordinator.Render();
+  } catch (const std::runtime_error&) {
+    failed = true;
+  }
+  double ms = MsSince(start);
+  std::cout << scenario << ": render " << (failed ? "failed" : "completed")
+            << " after " << ms << " ms" << std::endl;
+  return Check(failed, scenario, "the render did not fail");
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  std::string scenario;
+  int worker_fd = -1;
+  size_t worker_index = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-scenario") && i + 1 < argc) {
+      scenario = argv[++i];
+    } else if (!strcmp(argv[i], "-worker_fd") && i + 1 < argc) {
+      worker_fd = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-worker_index") && i + 1 < argc) {
+      worker_index = strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Unknown command line argument: " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  if (worker_fd >= 0) {
+    return RunWorker(scenario, worker_fd, worker_index);
+  }
+
+  int failures = 0;
+  if (scenario.empty() || scenario == "recover") {
+    failures += !TestRecover(argv[0]);
+  }
+  if (scenario.empty() || scenario == "hang_loading") {
+    failures += !TestHangLoading(argv[0]);
+  }
+  if (failures == 0) {
+    std::cout << "All scenarios passed" << std::endl;
+  } else {
+    std::cout << failures << " scenarios failed" << std::endl;
+  }
+  return failures;
+}
@@ -0,0 +1,95 @@
+// Converts an OBJ file, with the materials of its MTL files, into the binary
+// mesh format of BinaryMeshFile. The written file is opened again and
+// checked against the parsed OBJ, and the time to load either is reported.
+//
+// Usage: assignment4_obj_to_gmesh INPUT.obj OUTPUT.gmesh
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "gloo/parsers/BinaryMeshFile.hpp"
+#include "gloo/parsers/ObjParser.hpp"
+
+using namespace GLOO;
+
+namespace {
+template <typename T>
+bool SameArray(const std::unique_ptr<std::vector<T>>& values,
+               const T* mapped,
+               size_t count) {
+  if (values == nullptr) {
+    return mapped == nullptr;
+  }
+  return mapped != nullptr && values->size() == count &&
+         (count == 0 ||
+          std::memcmp(values->data(), mapped, count * sizeof(T)) == 0);
+}
+
+double MsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " INPUT.obj OUTPUT.gmesh"
+              << std::endl;
+    return 1;
+  }
+  std::string obj_file = argv[1];
+  std::string mesh_file = argv[2];
+
+  auto start = std::chrono::steady_clock::now();
+  bool success;
+  auto data = ObjParser::Parse(obj_file, success);
+  double parse_ms = MsSince(start);
+  if (!success) {
+    std::cerr << "Unable to parse " << obj_file << std::endl;
+    return 1;
+  }
+  if (!BinaryMeshFile::Write(mesh_file, data)) {
+    std::cerr << "Unable to write " << mesh_file << std::endl;
+    return 1;
+  }
+
+  start = std::chrono::steady_clock::now();
+  BinaryMeshFile mapped;
+  if (!mapped.Open(mesh_file)) {
+    return 1;
+  }
+  double open_ms = MsSince(start);
+  std::vector<MeshGroup> groups = mapped.GetGroups();
+  bool same_groups = groups.size() == data.groups.size();
+  for (size_t i = 0; same_groups && i < groups.size(); i++) {
+    same_groups = groups[i].name == data.groups[i].name &&
+                  groups[i].start_face_index ==
+                      data.groups[i].start_face_index &&
+                  groups[i].num_indices == data.groups[i].num_indices &&
+                  groups[i].material_name == data.groups[i].material_name &&
+                  (groups[i].material != nullptr) ==
+                      (data.groups[i].material != nullptr);
+  }
+  if (!same_groups ||
+      !SameArray(data.positions, mapped.GetPositions(),
+                 mapped.GetPositionCount()) ||
+      !SameArray(data.normals, mapped.GetNormals(),
+                 mapped.GetNormalCount()) ||
+      !SameArray(data.tex_coords, mapped.GetTexCoords(),
+                 mapped.GetTexCoordCount()) ||
+      !SameArray(data.indices, mapped.GetIndices(),
+                 mapped.GetIndexCount())) {
+    std::cerr << mesh_file << " does not match " << obj_file << "!"
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote " << mesh_file << ": " << mapped.GetPositionCount()
+            << " vertices, " << mapped.GetIndexCount() / 3 << " triangles, "
+            << groups.size() << " groups" << std::endl;
+  std::cout << "Parsing the OBJ took " << parse_ms << " ms, opening the mesh "
+            << open_ms << " ms" << std::endl;
+  return 0;
+}